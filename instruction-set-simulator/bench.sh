@@ -0,0 +1,52 @@
+#!/bin/sh
+# MIPS / startup benchmark for myISS, run with `make bench`
+# generates a fixed suite with genprog (fixed seeds so every run sees the same
+# programs), runs every engine `./myISS --engine list` reports on each one and
+# prints the best of $REPS runs. startup = read + parse + resolve from --stats.
+
+ISS=${ISS:-./myISS}
+GEN=${GEN:-./genprog}
+DIR=${BENCH_DIR:-bench}
+REPS=${REPS:-5}
+
+mkdir -p "$DIR"
+
+# name | genprog args
+SUITE="
+alu-loop|-n 32 -d 1 -t 120 -l 0 -b 0 -s 1
+ldst-mix|-n 256 -d 2 -t 100 -l 0.3 -f 64 -b 0.05 -s 2
+ldst-heavy|-n 256 -d 2 -t 100 -l 0.5 -f 256 -b 0 -s 3
+branchy|-n 256 -d 2 -t 100 -l 0.1 -f 32 -b 0.35 -s 4
+deep-nest|-n 64 -d 3 -t 40 -l 0.2 -f 128 -b 0.1 -s 5
+small-footprint|-n 128 -d 2 -t 120 -l 0.4 -f 4 -b 0.05 -s 6
+big-static|-n 200000 -d 1 -t 2 -l 0.25 -f 256 -b 0.1 -s 7
+"
+
+echo "$SUITE" | while IFS='|' read -r name args; do
+	[ -z "$name" ] && continue
+	$GEN $args > "$DIR/$name.assembly" || exit 1
+done
+
+printf "%-16s %-8s %12s %10s %12s %10s\n" program engine instr MIPS "startup(us)" "total(us)"
+
+for engine in $($ISS --engine list); do
+	echo "$SUITE" | while IFS='|' read -r name args; do
+		[ -z "$name" ] && continue
+
+		# keep the fastest of REPS runs, stats come out on stderr
+		i=0
+		while [ $i -lt "$REPS" ]; do
+			$ISS --engine "$engine" --stats "$DIR/$name.assembly" 2>&1 >/dev/null
+			i=$((i + 1))
+		done | awk -v name="$name" -v engine="$engine" '
+			$1 == "read" || $1 == "parse" || $1 == "resolve" { start += $2 }
+			$1 == "execute" { instr = $6; sub(/\(/, "", instr); mips = $3 }
+			$1 == "total" {
+				if (best_mips == "" || mips > best_mips) { best_mips = mips; best_instr = instr }
+				if (best_start == "" || start < best_start) best_start = start
+				if (best_total == "" || $2 < best_total) best_total = $2
+				start = 0
+			}
+			END { printf "%-16s %-8s %12s %10.2f %12.1f %10.1f\n", name, engine, best_instr, best_mips, best_start, best_total }'
+	done
+done
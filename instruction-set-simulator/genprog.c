@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "issgen.h"
+
+/***********************************************************
+ * Synthetic workload generator for myISS
+ *
+ * Usage:
+ * 	./genprog [options] > prog.assembly
+ *
+ * 		-n [SIZE]	static instruction count (default 64)
+ * 		-d [DEPTH]	loop nest depth 0-3 (default 1)
+ * 		-t [TRIPS]	iterations of every loop 1-127 (default 10)
+ * 		-l [RATIO]	share of LD/ST in the loop body (default 0.25)
+ * 		-f [BYTES]	address footprint 1-256 (default 64)
+ * 		-b [RATIO]	share of JE in the loop body (default 0.1)
+ * 		-s [SEED]	random seed (default 1)
+ *
+ * 	-l + -b can be at most 0.5, every LD/ST needs a MOV for its address
+ * 	and every JE needs a CMP.
+ *
+ ***********************************************************/
+
+static void print_usage(void)
+{
+	fprintf(stderr, "Usage: ./genprog [-n size] [-d depth] [-t trips] [-l ldst] [-f footprint] [-b branch] [-s seed]\n");
+}
+
+int main(int argc, char **argv){
+	GenParams params;
+	gen_defaults(&params);
+	uint64_t seed = 1;
+
+	for(int i = 1; i < argc; i++){
+		if(argv[i][0] != '-' || argv[i][1] == '\0' || argv[i][2] != '\0' || i + 1 >= argc){
+			print_usage();
+			return 1;
+		}
+
+		const char *val = argv[++i];
+		switch(argv[i - 1][1]){
+			case 'n': params.size = atoi(val); break;
+			case 'd': params.depth = atoi(val); break;
+			case 't': params.trips = atoi(val); break;
+			case 'l': params.ldst = atof(val); break;
+			case 'f': params.footprint = atoi(val); break;
+			case 'b': params.branch = atof(val); break;
+			case 's': seed = strtoull(val, NULL, 10); break;
+			default:
+				print_usage();
+				return 1;
+		}
+	}
+
+	if(gen_program(stdout, &params, seed) < 0){
+		fprintf(stderr, "genprog: parameters out of range\n");
+		print_usage();
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,370 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "isscache.h"
+
+//bump this whenever the cached format or the meaning of a result changes
+#define CACHE_MAGIC "myISS-cache 1"
+
+//temp files older than this were left behind by a worker that died mid-write
+#define CACHE_STALE_TMP_SEC 3600
+
+//running total of the entry sizes, so a store only scans the directory once the
+//cap is crossed. Not a .res file, the scan skips it
+#define CACHE_SIZE_FILE ".size"
+
+//a full cache evicts down to this % of the cap, otherwise every store after
+//the first eviction would cross the cap again and scan
+#define CACHE_EVICT_TO_PCT 90
+
+//one entry of the cache directory, used while evicting
+typedef struct{
+	char name[64];
+	long long size;
+	time_t mtime;
+}CacheEntry;
+
+//lane 1 is plain FNV-1a 64, lane 2 uses a different multiplier and a xorshift
+//reference: http://www.isthe.com/chongo/tech/comp/fnv/
+void cache_key_init(CacheKey *key)
+{
+	key->h1 = 0xcbf29ce484222325ULL;
+	key->h2 = 0x84222325cbf29ce4ULL;
+}
+
+void cache_key_update(CacheKey *key, const void *data, size_t len)
+{
+	const unsigned char *p = (const unsigned char*)data;
+	uint64_t h1 = key->h1;
+	uint64_t h2 = key->h2;
+
+	for(size_t i = 0; i < len; i++){
+		h1 ^= p[i];
+		h1 *= 0x100000001b3ULL;
+
+		h2 = (h2 + p[i]) * 0x9e3779b97f4a7c15ULL;
+		h2 ^= h2 >> 29;
+	}
+
+	key->h1 = h1;
+	key->h2 = h2;
+}
+
+static void cache_key_int(CacheKey *key, int v)
+{
+	int32_t v32 = (int32_t)v;
+	cache_key_update(key, &v32, sizeof(v32));
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t*)a;
+	uint32_t y = *(const uint32_t*)b;
+	return x < y ? -1 : (x > y);
+}
+
+//memory is sparse, so only pages that hold something go in, by page index
+//(a page that was touched but is still all zero is the same as no page)
+static void cache_key_mem(CacheKey *key, const SimMem *mem)
+{
+	cache_key_int(key, mem->addr_bits);
+
+	uint32_t *idx = (uint32_t*)malloc((mem->ntouched ? mem->ntouched : 1) * sizeof(*idx));
+	if(!idx){
+		//can't sort, the allocation order is still deterministic for a given input
+		for(size_t i = 0; i < mem->ntouched; i++){
+			const MemPage *p = mem->pages[mem->touched[i]];
+			cache_key_int(key, (int)mem->touched[i]);
+			cache_key_update(key, p, sizeof(*p));
+		}
+		return;
+	}
+
+	memcpy(idx, mem->touched, mem->ntouched * sizeof(*idx));
+	qsort(idx, mem->ntouched, sizeof(*idx), cmp_u32);
+
+	static const MemPage zero;
+	for(size_t i = 0; i < mem->ntouched; i++){
+		const MemPage *p = mem->pages[idx[i]];
+		if(memcmp(p, &zero, sizeof(zero)) == 0)
+			continue;
+
+		cache_key_int(key, (int)idx[i]);
+		cache_key_update(key, p, sizeof(*p));
+	}
+
+	free(idx);
+}
+
+//only the fields execute_program looks at go into the key, so the line text
+//(comments, spacing, line numbers) doesn't cause misses
+void cache_key_run(CacheKey *key, const Instr *prog, size_t n, const CPU *cpu, const char *options)
+{
+	cache_key_update(key, CACHE_MAGIC, strlen(CACHE_MAGIC));
+	cache_key_update(key, options, strlen(options) + 1);
+
+	cache_key_int(key, (int)n);
+	for(size_t i = 0; i < n; i++){
+		cache_key_int(key, (int)prog[i].op);
+		cache_key_int(key, prog[i].rn);
+		cache_key_int(key, prog[i].rm);
+		cache_key_int(key, prog[i].num);
+		cache_key_int(key, prog[i].addr);
+	}
+
+	for(int i = 0; i < NUMREGS; i++)
+		cache_key_int(key, cpu->R[i]);
+	cache_key_mem(key, &cpu->mem);
+	cache_key_int(key, cpu->last_je);
+	cache_key_int(key, cpu->last_lt);
+	cache_key_int(key, cpu->sp);
+	for(int i = 0; i < cpu->sp; i++)
+		cache_key_int(key, cpu->stack[i]);
+	cache_key_int(key, cpu->pc);
+	cache_key_int(key, cpu->num_instr);
+	cache_key_int(key, cpu->num_cycles);
+	cache_key_int(key, cpu->local_hits);
+	cache_key_int(key, cpu->num_ldst);
+}
+
+static void cache_key_hex(const CacheKey *key, char out[33])
+{
+	snprintf(out, 33, "%016llx%016llx", (unsigned long long)key->h1, (unsigned long long)key->h2);
+}
+
+static void cache_path(const char *dir, const CacheKey *key, char *path, size_t size)
+{
+	char hex[33];
+	cache_key_hex(key, hex);
+	snprintf(path, size, "%s/%s.res", dir, hex);
+}
+
+bool cache_lookup(const char *dir, const CacheKey *key, CPU *cpu)
+{
+	char path[4096];
+	cache_path(dir, key, path, sizeof(path));
+
+	FILE *pFile = fopen(path, "r");
+	if(pFile == NULL)
+		return false; //miss (or no cache dir yet)
+
+	char magic[32];
+	char hex[33];
+	char want[33];
+	int num_instr, num_cycles, local_hits, num_ldst;
+
+	bool ok = fgets(magic, sizeof(magic), pFile) != NULL
+		&& strncmp(magic, CACHE_MAGIC "\n", sizeof(magic)) == 0
+		&& fscanf(pFile, "key %32s\n", hex) == 1
+		&& fscanf(pFile, "instr %d\n", &num_instr) == 1
+		&& fscanf(pFile, "cycles %d\n", &num_cycles) == 1
+		&& fscanf(pFile, "hits %d\n", &local_hits) == 1
+		&& fscanf(pFile, "ldst %d\n", &num_ldst) == 1;
+	fclose(pFile);
+
+	cache_key_hex(key, want);
+	if(!ok || strcmp(hex, want) != 0)
+		return false; //truncated/foreign file, treat as a miss and let the store overwrite it
+
+	cpu->num_instr = num_instr;
+	cpu->num_cycles = num_cycles;
+	cpu->local_hits = local_hits;
+	cpu->num_ldst = num_ldst;
+
+	//touch the entry so eviction is least-recently-used instead of oldest-written
+	utime(path, NULL);
+	return true;
+}
+
+static int cmp_entry_mtime(const void *a, const void *b)
+{
+	const CacheEntry *ea = (const CacheEntry*)a;
+	const CacheEntry *eb = (const CacheEntry*)b;
+
+	if(ea->mtime != eb->mtime)
+		return ea->mtime < eb->mtime ? -1 : 1;
+	return strcmp(ea->name, eb->name);
+}
+
+//scan the directory and unlink the oldest entries until it is under max_bytes
+//returns what is left, -1 if the directory can't be read
+//other workers may be evicting at the same time, so a failed unlink is fine
+static long long cache_evict(const char *dir, long long max_bytes)
+{
+	DIR *d = opendir(dir);
+	if(d == NULL)
+		return -1;
+
+	size_t size = 64;
+	size_t n = 0;
+	CacheEntry *entries = (CacheEntry*)malloc(size * sizeof(*entries));
+	if(!entries){
+		closedir(d);
+		return -1;
+	}
+
+	long long total = 0;
+	time_t now = time(NULL);
+	char path[4096];
+	struct dirent *de;
+
+	while((de = readdir(d)) != NULL){
+		size_t len = strlen(de->d_name);
+		bool is_res = len > 4 && strcmp(de->d_name + len - 4, ".res") == 0;
+		bool is_tmp = strncmp(de->d_name, ".tmp-", 5) == 0;
+		if((!is_res && !is_tmp) || len >= sizeof(entries[0].name))
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+		struct stat st;
+		if(stat(path, &st) != 0)
+			continue;
+
+		if(is_tmp){
+			if(now - st.st_mtime > CACHE_STALE_TMP_SEC)
+				unlink(path);
+			continue;
+		}
+
+		if(n == size){
+			size *= 2;
+			CacheEntry *tmp = (CacheEntry*)realloc(entries, size * sizeof(*entries));
+			if(!tmp)
+				break;
+			entries = tmp;
+		}
+
+		memcpy(entries[n].name, de->d_name, len + 1);
+		entries[n].size = (long long)st.st_size;
+		entries[n].mtime = st.st_mtime;
+		total += entries[n].size;
+		n++;
+	}
+	closedir(d);
+
+	if(total > max_bytes){
+		qsort(entries, n, sizeof(*entries), cmp_entry_mtime);
+
+		for(size_t i = 0; i < n && total > max_bytes; i++){
+			snprintf(path, sizeof(path), "%s/%s", dir, entries[i].name);
+			unlink(path);
+			total -= entries[i].size;
+		}
+	}
+
+	free(entries);
+	return total;
+}
+
+//adds a new entry's bytes to the size file and evicts (down to
+//CACHE_EVICT_TO_PCT) if that goes over max_bytes. The flock on the size file is held through the scan, so workers
+//sharing the directory don't scan at the same time. A missing or unreadable
+//total (first store, an older myISS filled the directory) scans to get one,
+//the scan also corrects the drift from entries that were overwritten
+static void cache_account(const char *dir, long long added, long long max_bytes)
+{
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/%s", dir, CACHE_SIZE_FILE);
+	int fd = open(path, O_RDWR | O_CREAT, 0644);
+	if(fd < 0){
+		cache_evict(dir, max_bytes);
+		return;
+	}
+	if(flock(fd, LOCK_EX) != 0){
+		close(fd);
+		cache_evict(dir, max_bytes);
+		return;
+	}
+
+	char buf[32];
+	ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+	long long total = -1;
+	if(len > 0){
+		buf[len] = '\0';
+		char *end;
+		total = strtoll(buf, &end, 10);
+		if(end == buf || *end != '\n' || total < 0)
+			total = -1;
+	}
+
+	if(total < 0)
+		total = cache_evict(dir, max_bytes);
+	else if(total + added > max_bytes)
+		total = cache_evict(dir, max_bytes / 100 * CACHE_EVICT_TO_PCT);
+	else
+		total += added;
+
+	if(total >= 0){
+		len = snprintf(buf, sizeof(buf), "%lld\n", total);
+		if(pwrite(fd, buf, (size_t)len, 0) == len)
+			ftruncate(fd, len);
+	}else{
+		ftruncate(fd, 0); //next store scans again
+	}
+
+	flock(fd, LOCK_UN);
+	close(fd);
+}
+
+bool cache_store(const char *dir, const CacheKey *key, const CPU *cpu, long long max_bytes)
+{
+	if(mkdir(dir, 0755) != 0 && errno != EEXIST)
+		return false;
+
+	//write into a temp file in the same directory and rename it into place,
+	//rename is atomic so a concurrent reader sees either nothing or the whole entry
+	char tmp_path[4096];
+	snprintf(tmp_path, sizeof(tmp_path), "%s/.tmp-XXXXXX", dir);
+
+	int fd = mkstemp(tmp_path);
+	if(fd < 0)
+		return false;
+	fchmod(fd, 0644);
+
+	FILE *pFile = fdopen(fd, "w");
+	if(pFile == NULL){
+		close(fd);
+		unlink(tmp_path);
+		return false;
+	}
+
+	char hex[33];
+	cache_key_hex(key, hex);
+
+	fprintf(pFile, "%s\n", CACHE_MAGIC);
+	fprintf(pFile, "key %s\n", hex);
+	fprintf(pFile, "instr %d\n", cpu->num_instr);
+	fprintf(pFile, "cycles %d\n", cpu->num_cycles);
+	fprintf(pFile, "hits %d\n", cpu->local_hits);
+	fprintf(pFile, "ldst %d\n", cpu->num_ldst);
+
+	long long bytes = ftell(pFile);
+	bool ok = !ferror(pFile) && bytes >= 0;
+	if(fclose(pFile) != 0)
+		ok = false;
+
+	char path[4096];
+	cache_path(dir, key, path, sizeof(path));
+	if(!ok || rename(tmp_path, path) != 0){
+		unlink(tmp_path);
+		return false;
+	}
+
+	if(max_bytes > 0)
+		cache_account(dir, bytes, max_bytes);
+
+	return true;
+}
@@ -0,0 +1,34 @@
+#ifndef ISSCACHE_H
+#define ISSCACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "myiss.h"
+
+//default size cap for the on-disk result cache (--cache-max)
+#define CACHE_DEFAULT_MAX (64LL * 1024 * 1024)
+
+//content hash of a run: decoded program + initial cpu state + simulator options
+//two independent 64-bit lanes so a collision needs both to line up
+typedef struct{
+	uint64_t h1;
+	uint64_t h2;
+}CacheKey;
+
+void cache_key_init(CacheKey *key);
+void cache_key_update(CacheKey *key, const void *data, size_t len);
+
+//hashes everything that can change the output of execute_program
+void cache_key_run(CacheKey *key, const Instr *prog, size_t n, const CPU *cpu, const char *options);
+
+//returns true on a hit and fills the counters of cpu (the ones print_output uses)
+bool cache_lookup(const char *dir, const CacheKey *key, CPU *cpu);
+
+//writes the counters of cpu atomically (temp file + rename) and evicts the
+//least recently used entries once the directory is over max_bytes (0 = no cap),
+//the directory is only scanned when a running total in it says it's over
+bool cache_store(const char *dir, const CacheKey *key, const CPU *cpu, long long max_bytes);
+
+#endif
@@ -0,0 +1,404 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "isscov.h"
+#include "isscache.h"
+
+//bump this whenever the file format changes
+#define COV_MAGIC "myISS-coverage 1"
+
+//report lists longer than this are cut off
+#define COV_REPORT_MAX 32
+
+//bitmaps kept per program, bit i of each is pc i
+//je is static (which pcs are a conditional branch, JE/BNE/BLT, the name is
+//from before they existed), the rest are the flags ORed over all runs
+typedef enum{
+	MAP_JE,
+	MAP_EXEC,
+	MAP_TAKEN,
+	MAP_NOT_TAKEN,
+	NUM_MAPS
+}CovMap;
+
+static const char *map_names[NUM_MAPS] = {"je", "exec", "taken", "nottaken"};
+
+typedef struct{
+	char key[33];
+	size_t n;
+	long long runs;
+	char *source; //path of the first run that merged it, for the report
+	uint8_t *maps[NUM_MAPS]; //(n + 7) / 8 bytes each
+}CovProgram;
+
+typedef struct{
+	CovProgram *progs;
+	size_t count;
+	size_t size;
+}CovFile;
+
+static size_t map_bytes(size_t n)
+{
+	return (n + 7) / 8;
+}
+
+static bool map_test(const uint8_t *map, size_t pc)
+{
+	return (map[pc >> 3] >> (pc & 7)) & 1;
+}
+
+//same fields as the result cache key, so comments and line numbers don't matter
+static void cov_key(const Instr *prog, size_t n, char out[33])
+{
+	CacheKey key;
+	cache_key_init(&key);
+	cache_key_update(&key, COV_MAGIC, strlen(COV_MAGIC));
+
+	int32_t n32 = (int32_t)n;
+	cache_key_update(&key, &n32, sizeof(n32));
+	for(size_t i = 0; i < n; i++){
+		int32_t f[5] = {(int32_t)prog[i].op, prog[i].rn, prog[i].rm, prog[i].num, prog[i].addr};
+		cache_key_update(&key, f, sizeof(f));
+	}
+
+	snprintf(out, 33, "%016llx%016llx", (unsigned long long)key.h1, (unsigned long long)key.h2);
+}
+
+static void cov_free(CovFile *f)
+{
+	for(size_t i = 0; i < f->count; i++){
+		free(f->progs[i].source);
+		for(int m = 0; m < NUM_MAPS; m++)
+			free(f->progs[i].maps[m]);
+	}
+	free(f->progs);
+	memset(f, 0, sizeof(*f));
+}
+
+static CovProgram *cov_add(CovFile *f, const char *key, size_t n, const char *source)
+{
+	if(f->count == f->size){
+		size_t size = f->size ? f->size * 2 : 8;
+		CovProgram *tmp = (CovProgram*)realloc(f->progs, size * sizeof(*tmp));
+		if(!tmp)
+			return NULL;
+		f->progs = tmp;
+		f->size = size;
+	}
+
+	CovProgram *p = &f->progs[f->count];
+	memset(p, 0, sizeof(*p));
+	memcpy(p->key, key, sizeof(p->key));
+	p->n = n;
+	p->source = strdup(source);
+
+	bool ok = p->source != NULL;
+	for(int m = 0; m < NUM_MAPS; m++){
+		p->maps[m] = (uint8_t*)calloc(map_bytes(n) ? map_bytes(n) : 1, 1);
+		ok = ok && p->maps[m] != NULL;
+	}
+	f->count++;
+
+	return ok ? p : NULL;
+}
+
+static int hex_val(char c)
+{
+	if(c >= '0' && c <= '9')
+		return c - '0';
+	if(c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+//"<name> <hex>" into map, false if the line doesn't fit
+static bool parse_map(const char *line, const char *name, uint8_t *map, size_t bytes)
+{
+	size_t len = strlen(name);
+	if(strncmp(line, name, len) != 0 || line[len] != ' ')
+		return false;
+
+	const char *hex = line + len + 1;
+	for(size_t i = 0; i < bytes; i++){
+		int hi = hex_val(hex[2 * i]);
+		int lo = hi < 0 ? -1 : hex_val(hex[2 * i + 1]);
+		if(lo < 0)
+			return false;
+		map[i] = (uint8_t)(hi << 4 | lo);
+	}
+	return hex[2 * bytes] == '\0';
+}
+
+//reads the whole file, a missing file is an empty one
+static bool cov_load(const char *path, CovFile *f)
+{
+	memset(f, 0, sizeof(*f));
+
+	FILE *pFile = fopen(path, "r");
+	if(pFile == NULL)
+		return errno == ENOENT;
+
+	char *line = NULL;
+	size_t cap = 0;
+	ssize_t len;
+	bool ok = false;
+	CovProgram *p = NULL;
+	int next_map = NUM_MAPS;
+
+	if((len = getline(&line, &cap, pFile)) < 0 || strncmp(line, COV_MAGIC "\n", (size_t)len + 1) != 0)
+		goto out;
+
+	while((len = getline(&line, &cap, pFile)) >= 0){
+		if(len > 0 && line[len - 1] == '\n')
+			line[--len] = '\0';
+
+		if(next_map < NUM_MAPS){
+			if(!parse_map(line, map_names[next_map], p->maps[next_map], map_bytes(p->n)))
+				goto out;
+			next_map++;
+			continue;
+		}
+
+		char key[33];
+		unsigned long long n;
+		long long runs;
+		int off = 0;
+		if(sscanf(line, "program %32s %llu %lld %n", key, &n, &runs, &off) != 3 || off == 0)
+			goto out;
+
+		p = cov_add(f, key, (size_t)n, line + off);
+		if(p == NULL)
+			goto out;
+		p->runs = runs;
+		next_map = 0;
+	}
+	ok = next_map == NUM_MAPS;
+
+out:
+	free(line);
+	fclose(pFile);
+	if(!ok)
+		cov_free(f);
+	return ok;
+}
+
+static void write_map(FILE *pFile, const char *name, const uint8_t *map, size_t bytes)
+{
+	fprintf(pFile, "%s ", name);
+	for(size_t i = 0; i < bytes; i++)
+		fprintf(pFile, "%02x", map[i]);
+	fprintf(pFile, "\n");
+}
+
+//same temp file + rename as the result cache, readers never see half a file
+static bool cov_save(const char *path, const CovFile *f)
+{
+	char tmp_path[4096];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp-XXXXXX", path);
+
+	int fd = mkstemp(tmp_path);
+	if(fd < 0)
+		return false;
+	fchmod(fd, 0644);
+
+	FILE *pFile = fdopen(fd, "w");
+	if(pFile == NULL){
+		close(fd);
+		unlink(tmp_path);
+		return false;
+	}
+
+	fprintf(pFile, "%s\n", COV_MAGIC);
+	for(size_t i = 0; i < f->count; i++){
+		const CovProgram *p = &f->progs[i];
+		fprintf(pFile, "program %s %zu %lld %s\n", p->key, p->n, p->runs, p->source);
+		for(int m = 0; m < NUM_MAPS; m++)
+			write_map(pFile, map_names[m], p->maps[m], map_bytes(p->n));
+	}
+
+	bool ok = !ferror(pFile);
+	if(fclose(pFile) != 0)
+		ok = false;
+
+	if(!ok || rename(tmp_path, path) != 0){
+		unlink(tmp_path);
+		return false;
+	}
+	return true;
+}
+
+bool cov_merge(const char *path, const char *source, const Instr *prog, size_t n, const uint8_t *flags)
+{
+	char key[33];
+	cov_key(prog, n, key);
+
+	//the lock file is separate because rename swaps the inode under a lock on path itself
+	char lock_path[4096];
+	snprintf(lock_path, sizeof(lock_path), "%s.lock", path);
+	int lock = open(lock_path, O_RDWR | O_CREAT, 0644);
+	if(lock < 0)
+		return false;
+	if(flock(lock, LOCK_EX) != 0){
+		close(lock);
+		return false;
+	}
+
+	CovFile f;
+	bool ok = cov_load(path, &f);
+	if(!ok)
+		errno = EINVAL; //not a coverage file, leave it alone
+
+	CovProgram *p = NULL;
+	for(size_t i = 0; ok && i < f.count && p == NULL; i++){
+		if(f.progs[i].n == n && strcmp(f.progs[i].key, key) == 0)
+			p = &f.progs[i];
+	}
+	if(ok && p == NULL){
+		p = cov_add(&f, key, n, source);
+		ok = p != NULL;
+	}
+
+	if(ok){
+		p->runs++;
+		for(size_t pc = 0; pc < n; pc++){
+			uint8_t bit = (uint8_t)(1u << (pc & 7));
+			if(isa_is_cond(prog[pc].op))
+				p->maps[MAP_JE][pc >> 3] |= bit;
+			if(flags[pc])
+				p->maps[MAP_EXEC][pc >> 3] |= bit;
+			if(flags[pc] & COV_TAKEN)
+				p->maps[MAP_TAKEN][pc >> 3] |= bit;
+			if(flags[pc] & COV_NOT_TAKEN)
+				p->maps[MAP_NOT_TAKEN][pc >> 3] |= bit;
+		}
+		ok = cov_save(path, &f);
+	}
+
+	cov_free(&f);
+	flock(lock, LOCK_UN);
+	close(lock);
+	return ok;
+}
+
+//prints the source lines of the pcs where want(pc) is true, runs of
+//consecutive pcs as one range
+static void report_lines(FILE *out, const char *title, const CovProgram *p, const Instr *prog,
+	bool (*want)(const CovProgram *p, size_t pc))
+{
+	size_t shown = 0;
+	size_t total = 0;
+
+	for(size_t pc = 0; pc < p->n; pc++){
+		if(!want(p, pc))
+			continue;
+
+		size_t end = pc;
+		while(end + 1 < p->n && want(p, end + 1))
+			end++;
+
+		if(shown < COV_REPORT_MAX){
+			fprintf(out, shown == 0 ? "  %s: " : ", ", title);
+			if(end == pc)
+				fprintf(out, "%d", prog[pc].line_num);
+			else
+				fprintf(out, "%d-%d", prog[pc].line_num, prog[end].line_num);
+			shown++;
+		}
+		total++;
+		pc = end;
+	}
+
+	if(total > shown)
+		fprintf(out, " (and %zu more)", total - shown);
+	if(shown)
+		fprintf(out, "\n");
+}
+
+static bool never_run(const CovProgram *p, size_t pc)
+{
+	return !map_test(p->maps[MAP_EXEC], pc);
+}
+
+static bool never_taken(const CovProgram *p, size_t pc)
+{
+	return map_test(p->maps[MAP_EXEC], pc) && map_test(p->maps[MAP_JE], pc) && !map_test(p->maps[MAP_TAKEN], pc);
+}
+
+static bool never_fell_through(const CovProgram *p, size_t pc)
+{
+	return map_test(p->maps[MAP_EXEC], pc) && map_test(p->maps[MAP_JE], pc) && !map_test(p->maps[MAP_NOT_TAKEN], pc);
+}
+
+static double percent(size_t a, size_t b)
+{
+	return b ? 100.0 * (double)a / (double)b : 100.0;
+}
+
+bool cov_report(FILE *out, const char *path, CovLoader load)
+{
+	CovFile f;
+	if(!cov_load(path, &f) || f.count == 0){
+		cov_free(&f);
+		return false;
+	}
+
+	size_t all_instr = 0, all_exec = 0, all_dirs = 0, all_seen = 0;
+
+	for(size_t i = 0; i < f.count; i++){
+		const CovProgram *p = &f.progs[i];
+		size_t exec = 0, je = 0, taken = 0, not_taken = 0;
+
+		for(size_t pc = 0; pc < p->n; pc++){
+			exec += map_test(p->maps[MAP_EXEC], pc);
+			if(map_test(p->maps[MAP_JE], pc)){
+				je++;
+				taken += map_test(p->maps[MAP_TAKEN], pc);
+				not_taken += map_test(p->maps[MAP_NOT_TAKEN], pc);
+			}
+		}
+
+		fprintf(out, "%s (%lld run%s)\n", p->source, p->runs, p->runs == 1 ? "" : "s");
+		fprintf(out, "  instructions: %zu/%zu (%.1f%%)\n", exec, p->n, percent(exec, p->n));
+		fprintf(out, "  branch directions: %zu/%zu (%.1f%%), taken %zu, not taken %zu\n",
+			taken + not_taken, 2 * je, percent(taken + not_taken, 2 * je), taken, not_taken);
+
+		all_instr += p->n;
+		all_exec += exec;
+		all_dirs += 2 * je;
+		all_seen += taken + not_taken;
+
+		//line numbers aren't in the file, they come from the source if it hasn't changed
+		size_t n = 0;
+		Instr *prog = load ? load(p->source, &n) : NULL;
+		char key[33] = "";
+		if(prog)
+			cov_key(prog, n, key);
+
+		if(prog && n == p->n && strcmp(key, p->key) == 0){
+			report_lines(out, "never executed, lines", p, prog, never_run);
+			report_lines(out, "branch never taken, lines", p, prog, never_taken);
+			report_lines(out, "branch never fell through, lines", p, prog, never_fell_through);
+		}else if(exec < p->n || taken + not_taken < 2 * je){
+			fprintf(out, "  (source changed or missing, no line details)\n");
+		}
+		free(prog);
+	}
+
+	if(f.count > 1){
+		fprintf(out, "Total: instructions %zu/%zu (%.1f%%), branch directions %zu/%zu (%.1f%%)\n",
+			all_exec, all_instr, percent(all_exec, all_instr), all_seen, all_dirs, percent(all_seen, all_dirs));
+	}
+
+	cov_free(&f);
+	return true;
+}
@@ -0,0 +1,33 @@
+#ifndef ISSCOV_H
+#define ISSCOV_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "myiss.h"
+
+//--coverage: while running, one flag byte per pc (cpu->cov) gets COV_EXEC ORed
+//in per executed instruction. A conditional branch (JE/BNE/BLT) also ORs in the
+//way it went from inside its case, COV_NOT_TAKEN << taken, so the two have to stay
+//next to each other. Only in memory, the coverage file has a bitmap per flag
+#define COV_EXEC 1
+#define COV_NOT_TAKEN 2
+#define COV_TAKEN 4
+
+//reloads a program for the report, NULL if the source is gone
+typedef Instr *(*CovLoader)(const char *path, size_t *n);
+
+//ORs one run's flags into the coverage file at path (created if missing)
+//the file keeps a packed bitmap per flag and program, keyed by a hash of the
+//decoded program, so any number of batch workers can merge into it: they
+//take an flock on path.lock and replace the file with temp file + rename
+bool cov_merge(const char *path, const char *source, const Instr *prog, size_t n, const uint8_t *flags);
+
+//prints instruction and branch direction coverage for every program in the file,
+//with the lines that never ran if load can still give the same program
+//returns false if the file can't be read
+bool cov_report(FILE *out, const char *path, CovLoader load);
+
+#endif
@@ -0,0 +1,333 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "issdbg.h"
+
+typedef struct{
+	CPU *cpu;
+	Instr *prog;
+	size_t n;
+
+	//real opcode under each TRAP (only meaningful where prog[pc].op == TRAP)
+	Opcode *orig;
+
+	WatchMap watch;
+	bool watching; //LD/ST are currently swapped for LD_W/ST_W
+}Debugger;
+
+static bool has_bp(const Debugger *d, size_t pc)
+{
+	return d->prog[pc].op == TRAP;
+}
+
+static void set_bp(Debugger *d, size_t pc)
+{
+	if(!has_bp(d, pc)){
+		d->orig[pc] = d->prog[pc].op;
+		d->prog[pc].op = TRAP;
+	}
+}
+
+static void clear_bp(Debugger *d, size_t pc)
+{
+	if(has_bp(d, pc))
+		d->prog[pc].op = d->orig[pc];
+}
+
+//swap every LD/ST (including the ones hiding under a breakpoint) for the
+//watch-checking versions or back
+static void set_watching(Debugger *d, bool on)
+{
+	if(d->watching == on)
+		return;
+
+	for(size_t pc = 0; pc < d->n; pc++){
+		Opcode *op = has_bp(d, pc) ? &d->orig[pc] : &d->prog[pc].op;
+
+		if(on && *op == LD)
+			*op = LD_W;
+		else if(on && *op == ST)
+			*op = ST_W;
+		else if(!on && *op == LD_W)
+			*op = LD;
+		else if(!on && *op == ST_W)
+			*op = ST;
+	}
+
+	d->watching = on;
+}
+
+static bool running(const Debugger *d)
+{
+	return d->cpu->pc >= 0 && (size_t)d->cpu->pc < d->n;
+}
+
+//the source line without its newline
+static void print_line(const Instr *ins)
+{
+	size_t len = strcspn(ins->full_line, "\r\n");
+	printf("%.*s", (int)len, ins->full_line);
+}
+
+static void print_where(const Debugger *d)
+{
+	if(!running(d)){
+		printf("Program halted.\n");
+		return;
+	}
+
+	printf("pc %d: ", d->cpu->pc);
+	print_line(&d->prog[d->cpu->pc]);
+	printf("\n");
+}
+
+//executes the instruction at pc even if it has a breakpoint on it
+static void step_one(Debugger *d)
+{
+	size_t pc = (size_t)d->cpu->pc;
+	bool bp = has_bp(d, pc);
+
+	if(bp)
+		d->prog[pc].op = d->orig[pc];
+	execute_step(d->cpu, d->prog, d->n);
+	if(bp)
+		set_bp(d, pc);
+}
+
+//prints why execution stopped, returns true if it was a watchpoint
+static bool report_watch(Debugger *d)
+{
+	CPU *cpu = d->cpu;
+	if(cpu->watch_hit < 0)
+		return false;
+
+	uint32_t addr = (uint32_t)cpu->watch_hit;
+	const MemPage *page = mem_peek(&cpu->mem, addr);
+	const Instr *ins = &d->prog[cpu->pc - 1]; //LD_W/ST_W already moved pc on
+	Opcode op = has_bp(d, (size_t)(cpu->pc - 1)) ? d->orig[cpu->pc - 1] : ins->op;
+
+	printf("Watchpoint: %s of address %u (value %d) at ", op == ST_W ? "store" : "load",
+		addr, page ? page->data[addr & PAGE_MASK] : 0);
+	print_line(ins);
+	printf("\n");
+
+	cpu->watch_hit = -1;
+	return true;
+}
+
+static void do_continue(Debugger *d)
+{
+	if(!running(d)){
+		printf("Program halted.\n");
+		return;
+	}
+
+	//step off the breakpoint we are sitting on first
+	if(has_bp(d, (size_t)d->cpu->pc)){
+		step_one(d);
+		if(report_watch(d) || !running(d)){
+			print_where(d);
+			return;
+		}
+	}
+
+	execute_program(d->cpu, d->prog, d->n);
+
+	if(!report_watch(d) && running(d) && has_bp(d, (size_t)d->cpu->pc))
+		printf("Breakpoint at pc %d\n", d->cpu->pc);
+	print_where(d);
+}
+
+static void do_step(Debugger *d, long count)
+{
+	for(long i = 0; i < count && running(d); i++){
+		step_one(d);
+		if(report_watch(d))
+			break;
+	}
+	print_where(d);
+}
+
+static void do_regs(const Debugger *d)
+{
+	const CPU *cpu = d->cpu;
+
+	for(int i = 0; i < NUMREGS; i++)
+		printf("R%d=%d%s", i + 1, cpu->R[i], i + 1 < NUMREGS ? " " : "\n");
+	printf("pc=%d last_je=%d last_lt=%d sp=%d instr=%d cycles=%d hits=%d ldst=%d\n", cpu->pc, cpu->last_je,
+		cpu->last_lt, cpu->sp, cpu->num_instr, cpu->num_cycles, cpu->local_hits, cpu->num_ldst);
+}
+
+static void do_mem(const Debugger *d, uint32_t addr, long count)
+{
+	const SimMem *mem = &d->cpu->mem;
+
+	for(long i = 0; i < count; i++){
+		uint32_t a = (addr + (uint32_t)i) & mem->mask;
+		const MemPage *page = mem_peek(mem, a);
+		uint32_t off = a & PAGE_MASK;
+
+		printf("mem[%u] = %d%s\n", a, page ? page->data[off] : 0,
+			(page && page->cached[off]) ? " (cached)" : "");
+	}
+}
+
+static void do_info(const Debugger *d)
+{
+	printf("Breakpoints:");
+	bool any = false;
+	for(size_t pc = 0; pc < d->n; pc++){
+		if(has_bp(d, pc)){
+			printf(" %d", d->prog[pc].line_num);
+			any = true;
+		}
+	}
+	printf(any ? "\n" : " none\n");
+
+	printf("Watchpoints:");
+	if(d->watch.count == 0){
+		printf(" none\n");
+		return;
+	}
+
+	size_t npages = ((size_t)d->watch.mask >> PAGE_BITS) + 1;
+	for(size_t p = 0; p < npages; p++){
+		const uint64_t *bits = d->watch.pages[p];
+		if(!bits)
+			continue;
+		for(uint32_t off = 0; off < PAGE_SIZE; off++){
+			if((bits[off >> 6] >> (off & 63)) & 1)
+				printf(" %u", (uint32_t)(p << PAGE_BITS) | off);
+		}
+	}
+	printf("\n");
+}
+
+static void do_help(void)
+{
+	printf("break <line>     stop before the instruction on that line (b)\n");
+	printf("delete [line]    remove one breakpoint, or all of them (d)\n");
+	printf("watch <addr>     stop after any LD/ST of that address (w)\n");
+	printf("unwatch <addr>   remove a watchpoint\n");
+	printf("continue         run until a breakpoint, watchpoint or halt (c, run)\n");
+	printf("step [n]         execute n instructions, default 1 (s)\n");
+	printf("regs             registers, pc and counters (r)\n");
+	printf("mem <addr> [n]   n bytes of memory starting at addr (x)\n");
+	printf("info             list breakpoints and watchpoints (i)\n");
+	printf("where            current instruction (l)\n");
+	printf("quit             stop debugging and run to the end (q)\n");
+}
+
+//breakpoints are by source line number, like the jump targets
+static bool set_line_bp(Debugger *d, long line, bool on)
+{
+	bool found = false;
+	for(size_t pc = 0; pc < d->n; pc++){
+		if(d->prog[pc].line_num == line){
+			if(on)
+				set_bp(d, pc);
+			else
+				clear_bp(d, pc);
+			found = true;
+		}
+	}
+	return found;
+}
+
+int debug_session(CPU *cpu, Instr *prog, size_t n, FILE *in, bool prompt)
+{
+	Debugger d;
+	memset(&d, 0, sizeof(d));
+	d.cpu = cpu;
+	d.prog = prog;
+	d.n = n;
+	d.orig = (Opcode*)calloc(n ? n : 1, sizeof(*d.orig));
+	if(!d.orig || !watch_init(&d.watch, cpu->mem.addr_bits)){
+		free(d.orig);
+		return 1;
+	}
+	cpu->watch = &d.watch;
+	cpu->watch_hit = -1;
+
+	char line[256];
+	const char *delimiters = " \t\r\n";
+	int ret = 0;
+
+	print_where(&d);
+	for(;;){
+		if(prompt){
+			printf("(iss) ");
+			fflush(stdout);
+		}
+		if(!fgets(line, sizeof(line), in))
+			break;
+
+		char *save = NULL;
+		char *cmd = strtok_r(line, delimiters, &save);
+		char *arg1 = strtok_r(NULL, delimiters, &save);
+		char *arg2 = strtok_r(NULL, delimiters, &save);
+		if(!cmd || cmd[0] == '#')
+			continue; //blank line or comment in a script
+
+		if(strcmp(cmd, "break") == 0 || strcmp(cmd, "b") == 0){
+			if(!arg1 || !set_line_bp(&d, strtol(arg1, NULL, 10), true))
+				printf("No instruction at line %s\n", arg1 ? arg1 : "?");
+		}else if(strcmp(cmd, "delete") == 0 || strcmp(cmd, "d") == 0){
+			if(!arg1){
+				for(size_t pc = 0; pc < n; pc++)
+					clear_bp(&d, pc);
+			}else if(!set_line_bp(&d, strtol(arg1, NULL, 10), false)){
+				printf("No instruction at line %s\n", arg1);
+			}
+		}else if(strcmp(cmd, "watch") == 0 || strcmp(cmd, "w") == 0 || strcmp(cmd, "unwatch") == 0){
+			bool on = cmd[0] == 'w';
+			if(!arg1){
+				printf("Usage: %s <addr>\n", cmd);
+				continue;
+			}
+			if(!watch_set(&d.watch, (uint32_t)strtoul(arg1, NULL, 0), on)){
+				ret = 1;
+				break;
+			}
+			set_watching(&d, d.watch.count > 0);
+		}else if(strcmp(cmd, "continue") == 0 || strcmp(cmd, "c") == 0 || strcmp(cmd, "run") == 0){
+			do_continue(&d);
+		}else if(strcmp(cmd, "step") == 0 || strcmp(cmd, "s") == 0){
+			do_step(&d, arg1 ? strtol(arg1, NULL, 10) : 1);
+		}else if(strcmp(cmd, "regs") == 0 || strcmp(cmd, "r") == 0){
+			do_regs(&d);
+		}else if(strcmp(cmd, "mem") == 0 || strcmp(cmd, "x") == 0){
+			if(!arg1){
+				printf("Usage: mem <addr> [n]\n");
+				continue;
+			}
+			long count = arg2 ? strtol(arg2, NULL, 10) : 1;
+			do_mem(&d, (uint32_t)strtoul(arg1, NULL, 0), count < 1 ? 1 : (count > 4096 ? 4096 : count));
+		}else if(strcmp(cmd, "info") == 0 || strcmp(cmd, "i") == 0){
+			do_info(&d);
+		}else if(strcmp(cmd, "where") == 0 || strcmp(cmd, "l") == 0){
+			print_where(&d);
+		}else if(strcmp(cmd, "help") == 0 || strcmp(cmd, "h") == 0){
+			do_help();
+		}else if(strcmp(cmd, "quit") == 0 || strcmp(cmd, "q") == 0){
+			break;
+		}else{
+			printf("Unknown command: %s (try help)\n", cmd);
+		}
+	}
+
+	//leave the program the way it was loaded and let it finish
+	for(size_t pc = 0; pc < n; pc++)
+		clear_bp(&d, pc);
+	set_watching(&d, false);
+	if(ret == 0)
+		execute_program(cpu, prog, n);
+
+	cpu->watch = NULL;
+	watch_free(&d.watch);
+	free(d.orig);
+	return ret;
+}
@@ -0,0 +1,18 @@
+#ifndef ISSDBG_H
+#define ISSDBG_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "myiss.h"
+
+//interactive / scripted debugger (--debug, --debug-script)
+//breakpoints swap the decoded instruction for TRAP and watchpoints swap every
+//LD/ST for LD_W/ST_W, so with nothing set the program runs through the normal
+//execute loop untouched. Reads commands from `in` until quit or EOF, then
+//runs the program to the end. `prompt` prints "(iss) " before each command.
+//returns 0, or 1 if it ran out of memory
+int debug_session(CPU *cpu, Instr *prog, size_t n, FILE *in, bool prompt);
+
+#endif
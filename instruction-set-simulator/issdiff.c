@@ -0,0 +1,680 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "issdiff.h"
+#include "issfold.h"
+
+//generated code only writes R1-R4: R5 stays 0 for the loop compares and R6
+//counts loop trips, so every loop ends and the program always halts
+#define DIFF_SCRATCH 4
+#define DIFF_ZERO_REG 4 //R5, as an index
+#define DIFF_TRIP_REG 5 //R6
+#define DIFF_FIRST_LINE 10
+#define DIFF_MAX_INSTR 1024
+
+//options a program is run with
+typedef struct{
+	int addr_bits;
+	const LatencyModel *lat;
+}DiffOpts;
+
+//a program in line-number form: addr of a jump is its target line, so
+//instructions can be dropped without fixing the others up
+typedef struct{
+	Instr *ins;
+	size_t n;
+}DiffProg;
+
+typedef struct Diff Diff;
+
+typedef struct{
+	Diff *d;
+	pthread_t thread;
+
+	Instr *prog; //the program being checked
+	Instr *resolved; //prog after resolve_targets
+	Instr *scratch; //what an engine runs (fold rewrites it)
+	Instr *cand; //shrink candidate
+	//one reference and one engine CPU per address width, reset between runs
+	//(a 32-bit page table is too big to allocate for every program)
+	CPU ref[3];
+	CPU got[3];
+	bool ready[3];
+
+	//for the hang check, start_ms is 0 while the worker is between programs
+	long long current;
+	DiffOpts opts;
+	size_t n;
+	long long start_ms;
+}DiffWorker;
+
+struct Diff{
+	const DiffConfig *cfg;
+	long long next; //next program index, atomic
+	long long done; //atomic
+	int finished; //workers that returned, atomic
+	bool stop;
+
+	pthread_mutex_t lock; //reports
+	int reports;
+	bool error;
+};
+
+static double diff_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+//--- generator ---
+
+typedef struct{
+	Instr *ins;
+	size_t n;
+	uint64_t rng;
+}DiffGen;
+
+static uint64_t gen_next(DiffGen *g)
+{
+	g->rng ^= g->rng >> 12;
+	g->rng ^= g->rng << 25;
+	g->rng ^= g->rng >> 27;
+	return g->rng * 0x2545f4914f6cdd1dULL;
+}
+
+static int gen_int(DiffGen *g, int lo, int hi) // [lo, hi]
+{
+	return lo + (int)(gen_next(g) % (uint64_t)(hi - lo + 1));
+}
+
+//small numbers, anything in the 8-bit range and past it, and the values
+//where the 8/16/32-bit wrapping and shifting change
+static int gen_num(DiffGen *g)
+{
+	static const int edges[] = {127, 128, -128, -129, 255, 256, 32767, 32768, -32768, 65535, 65536,
+		2147483647, -2147483647 - 1, -1, 7, 8, 15, 16, 31, 32, 33};
+
+	switch(gen_int(g, 0, 3)){
+		case 0:
+			return edges[gen_int(g, 0, (int)(sizeof(edges) / sizeof(edges[0])) - 1)];
+		case 1:
+			return gen_int(g, -300, 300);
+		default:
+			return gen_int(g, -8, 8);
+	}
+}
+
+static Instr *gen_emit(DiffGen *g, Opcode op)
+{
+	Instr *ins = &g->ins[g->n];
+	memset(ins, 0, offsetof(Instr, full_line));
+	ins->op = op;
+	ins->rn = -1;
+	ins->rm = -1;
+	ins->line_num = DIFF_FIRST_LINE + (int)g->n;
+	g->n++;
+	return ins;
+}
+
+//len random instructions from the whole ISA, jumps only go forward inside
+//the block (or to just after it), CALL goes to one of the subroutines in
+//calls (their index is patched in later), RET is rare
+static void gen_block(DiffGen *g, int len, int first_sub, int nsubs, int *call_sub)
+{
+	//leaves room for the loop tail, the halt and the subroutine RETs
+	if(len > DIFF_MAX_INSTR - 16 - (int)g->n)
+		len = DIFF_MAX_INSTR - 16 - (int)g->n;
+
+	size_t start = g->n;
+	for(int j = 0; j < len; j++){
+		Opcode op = (Opcode)gen_int(g, 0, NUM_ISA_OPS - 1);
+		if((op == CALL && first_sub >= nsubs) || (op == RET && gen_int(g, 0, 7) != 0)){
+			j--;
+			continue;
+		}
+
+		Instr *ins = gen_emit(g, op);
+		switch(isa_info[op].form){
+			case FORM_RN_NUM:
+				ins->rn = gen_int(g, 0, DIFF_SCRATCH - 1);
+				ins->num = gen_num(g);
+				break;
+			case FORM_RN_RM:
+				ins->rn = op == CMP ? gen_int(g, 0, NUMREGS - 1) : gen_int(g, 0, DIFF_SCRATCH - 1);
+				ins->rm = gen_int(g, 0, NUMREGS - 1);
+				break;
+			case FORM_LD:
+				ins->rn = gen_int(g, 0, DIFF_SCRATCH - 1);
+				ins->rm = gen_int(g, 0, NUMREGS - 1);
+				break;
+			case FORM_ST:
+				ins->rn = gen_int(g, 0, NUMREGS - 1);
+				ins->rm = gen_int(g, 0, NUMREGS - 1);
+				break;
+			case FORM_ADDR:
+				if(op == CALL){
+					call_sub[g->n - 1] = gen_int(g, first_sub, nsubs - 1);
+				}else{
+					size_t end = start + (size_t)len;
+					ins->addr = DIFF_FIRST_LINE + (int)(g->n + (size_t)gen_int(g, 0, (int)(end - g->n)));
+				}
+				break;
+			case FORM_NONE:
+				break;
+		}
+	}
+}
+
+//main is a row of straight blocks and counted loops (MOV R6, trips / body /
+//SUB R6, 1 / CMP R6, R5 / BNE body), then it halts one of the ways a program
+//can. The subroutines come after it, each can only call the ones after it
+static size_t gen_program(Instr *prog, uint64_t seed)
+{
+	DiffGen g;
+	g.ins = prog;
+	g.n = 0;
+	g.rng = seed * 0x9e3779b97f4a7c15ULL + 0x2545f4914f6cdd1dULL;
+	if(g.rng == 0)
+		g.rng = 1;
+
+	int call_sub[DIFF_MAX_INSTR];
+	for(int i = 0; i < DIFF_MAX_INSTR; i++)
+		call_sub[i] = -1;
+
+	int nsubs = gen_int(&g, 0, 4);
+	int segments = gen_int(&g, 1, 6);
+	for(int s = 0; s < segments; s++){
+		if(gen_int(&g, 0, 2) == 0){
+			gen_block(&g, gen_int(&g, 1, 20), 0, nsubs, call_sub);
+			continue;
+		}
+
+		gen_emit(&g, MOV)->rn = DIFF_TRIP_REG;
+		g.ins[g.n - 1].num = gen_int(&g, 1, 6);
+		int head = DIFF_FIRST_LINE + (int)g.n;
+		gen_block(&g, gen_int(&g, 1, 16), 0, nsubs, call_sub);
+
+		Instr *ins = gen_emit(&g, SUB_NUM);
+		ins->rn = DIFF_TRIP_REG;
+		ins->num = 1;
+		ins = gen_emit(&g, CMP);
+		ins->rn = DIFF_TRIP_REG;
+		ins->rm = DIFF_ZERO_REG;
+		gen_emit(&g, BNE)->addr = head;
+	}
+
+	//run off the end into the subroutines (the first RET halts), RET with an
+	//empty stack, or a jump to a line that isn't there
+	switch(gen_int(&g, 0, 2)){
+		case 0:
+			break;
+		case 1:
+			gen_emit(&g, RET);
+			break;
+		default:
+			gen_emit(&g, JMP)->addr = gen_int(&g, 0, 1) ? DIFF_FIRST_LINE - 1 : DIFF_FIRST_LINE + DIFF_MAX_INSTR;
+			break;
+	}
+
+	int sub_line[5];
+	for(int s = 0; s < nsubs; s++){
+		sub_line[s] = DIFF_FIRST_LINE + (int)g.n;
+		gen_block(&g, gen_int(&g, 1, 12), s + 1, nsubs, call_sub);
+		gen_emit(&g, RET);
+	}
+
+	for(size_t i = 0; i < g.n; i++){
+		if(call_sub[i] >= 0)
+			prog[i].addr = sub_line[call_sub[i]];
+	}
+	return g.n;
+}
+
+//--- running and comparing ---
+
+static int width_idx(int addr_bits)
+{
+	return addr_bits == 8 ? 0 : (addr_bits == 16 ? 1 : 2);
+}
+
+//zeroed cpu like cpu_init gives, keeping its page table
+static void cpu_reset(CPU *cpu, const LatencyModel *lat)
+{
+	SimMem mem = cpu->mem;
+	mem_reset(&mem);
+	memset(cpu, 0, sizeof(*cpu));
+	cpu->mem = mem;
+	cpu->watch_hit = -1;
+	cpu->lat = lat;
+}
+
+//the reference and engine CPUs for o's address width
+static bool diff_cpus(DiffWorker *w, const DiffOpts *o, CPU **ref, CPU **got)
+{
+	int k = width_idx(o->addr_bits);
+	if(!w->ready[k]){
+		if(!cpu_init(&w->ref[k], o->addr_bits))
+			return false;
+		if(!cpu_init(&w->got[k], o->addr_bits)){
+			cpu_free(&w->ref[k]);
+			return false;
+		}
+		w->ready[k] = true;
+	}
+	*ref = &w->ref[k];
+	*got = &w->got[k];
+	return true;
+}
+
+static bool diff_exec(DiffWorker *w, const Engine *e, CPU *cpu, size_t n, const DiffOpts *o)
+{
+	cpu_reset(cpu, o->lat);
+
+	memcpy(w->scratch, w->resolved, n * sizeof(*w->scratch));
+	FoldRegion *fold = NULL;
+	if(e->fold){
+		size_t regions, folded;
+		fold = fold_program(w->scratch, n, &regions, &folded);
+		if(!fold)
+			return false;
+		cpu->fold = fold;
+	}
+
+	e->run(cpu, w->scratch, n);
+	cpu->fold = NULL;
+	free(fold);
+	return true;
+}
+
+//every page a touched holds the same in b (a page b never touched is all zero)
+static bool mem_covered(const SimMem *a, const SimMem *b, uint32_t *addr)
+{
+	static const MemPage zero;
+
+	for(size_t i = 0; i < a->ntouched; i++){
+		uint32_t page = a->touched[i];
+		const MemPage *pa = a->pages[page];
+		const MemPage *pb = b->pages[page] ? b->pages[page] : &zero;
+		if(memcmp(pa, pb, sizeof(*pa)) == 0)
+			continue;
+
+		uint32_t off = 0;
+		while(pa->data[off] == pb->data[off] && pa->cached[off] == pb->cached[off])
+			off++;
+		*addr = (page << PAGE_BITS) | off;
+		return false;
+	}
+	return true;
+}
+
+//first difference between the reference and an engine, false if there is none
+static bool cpu_differs(const CPU *a, const CPU *b, char *what, size_t size)
+{
+	for(int i = 0; i < NUMREGS; i++){
+		if(a->R[i] != b->R[i]){
+			snprintf(what, size, "R%d %d vs %d", i + 1, a->R[i], b->R[i]);
+			return true;
+		}
+	}
+
+	const struct{const char *name; long long a, b;}fields[] = {
+		{"instructions", a->num_instr, b->num_instr},
+		{"cycles", a->num_cycles, b->num_cycles},
+		{"local hits", a->local_hits, b->local_hits},
+		{"LD/ST", a->num_ldst, b->num_ldst},
+		{"pc", a->pc, b->pc},
+		{"sp", a->sp, b->sp},
+		{"last_je", a->last_je, b->last_je},
+		{"last_lt", a->last_lt, b->last_lt},
+	};
+	for(size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++){
+		if(fields[i].a != fields[i].b){
+			snprintf(what, size, "%s %lld vs %lld", fields[i].name, fields[i].a, fields[i].b);
+			return true;
+		}
+	}
+
+	for(int i = 0; i < a->sp; i++){
+		if(a->stack[i] != b->stack[i]){
+			snprintf(what, size, "stack[%d] %d vs %d", i, a->stack[i], b->stack[i]);
+			return true;
+		}
+	}
+
+	uint32_t addr;
+	if(!mem_covered(&a->mem, &b->mem, &addr) || !mem_covered(&b->mem, &a->mem, &addr)){
+		const MemPage *pa = mem_peek(&a->mem, addr);
+		const MemPage *pb = mem_peek(&b->mem, addr);
+		uint32_t off = addr & PAGE_MASK;
+		snprintf(what, size, "mem[%u] %d%s vs %d%s", addr,
+			pa ? pa->data[off] : 0, (pa && pa->cached[off]) ? " (cached)" : "",
+			pb ? pb->data[off] : 0, (pb && pb->cached[off]) ? " (cached)" : "");
+		return true;
+	}
+	return false;
+}
+
+//runs prog on the reference and on engine only (or every engine if only is 0),
+//returns the first engine that ends up somewhere else, 0 if none, -1 if out of memory
+static int diff_check(DiffWorker *w, const Instr *prog, size_t n, const DiffOpts *o, size_t only, char *what, size_t size)
+{
+	const DiffConfig *cfg = w->d->cfg;
+
+	CPU *ref, *got;
+	if(!diff_cpus(w, o, &ref, &got))
+		return -1;
+
+	memcpy(w->resolved, prog, n * sizeof(*prog));
+	resolve_targets(w->resolved, n);
+
+	if(!diff_exec(w, &cfg->engines[0], ref, n, o))
+		return -1;
+
+	for(size_t e = only ? only : 1; e < cfg->nengines; e++){
+		if(!diff_exec(w, &cfg->engines[e], got, n, o))
+			return -1;
+		if(cpu_differs(ref, got, what, size))
+			return (int)e;
+		if(only)
+			break;
+	}
+	return 0;
+}
+
+//the reference halts on a shrink candidate within DIFF_STEP_BUDGET
+//instructions, dropping an instruction can turn a counted loop into an endless one
+static bool diff_halts(DiffWorker *w, const Instr *prog, size_t n, const DiffOpts *o)
+{
+	CPU *ref, *got;
+	if(!diff_cpus(w, o, &ref, &got))
+		return false;
+
+	memcpy(w->resolved, prog, n * sizeof(*prog));
+	resolve_targets(w->resolved, n);
+	cpu_reset(ref, o->lat);
+
+	for(int i = 0; i < DIFF_STEP_BUDGET; i++){
+		if(ref->pc < 0 || (size_t)ref->pc >= n)
+			return true;
+		execute_step(ref, w->resolved, n);
+	}
+	return false;
+}
+
+//drops chunks of instructions (halves, then quarters, ... then single ones)
+//as long as engine e still disagrees, returns the new length of prog
+static size_t diff_shrink(DiffWorker *w, Instr *prog, size_t n, const DiffOpts *o, size_t e)
+{
+	char what[160];
+
+	for(size_t chunk = n / 2 ? n / 2 : 1; ; chunk /= 2){
+		size_t start = 0;
+		while(start < n && n > 1){
+			size_t end = start + chunk < n ? start + chunk : n;
+			size_t cn = 0;
+			for(size_t i = 0; i < n; i++){
+				if(i < start || i >= end)
+					w->cand[cn++] = prog[i];
+			}
+
+			if(diff_halts(w, w->cand, cn, o) && diff_check(w, w->cand, cn, o, e, what, sizeof(what)) == (int)e){
+				memcpy(prog, w->cand, cn * sizeof(*prog));
+				n = cn;
+			}else{
+				start = end;
+			}
+		}
+		if(chunk == 1)
+			break;
+	}
+	return n;
+}
+
+//--- reports ---
+
+static void diff_print_ins(FILE *out, const Instr *ins)
+{
+	const IsaInfo *info = &isa_info[ins->op];
+
+	fprintf(out, "%d\t%s", ins->line_num, info->mnemonic);
+	switch(info->form){
+		case FORM_RN_NUM:
+			fprintf(out, " R%d, %d\n", ins->rn + 1, ins->num);
+			break;
+		case FORM_RN_RM:
+			fprintf(out, " R%d, R%d\n", ins->rn + 1, ins->rm + 1);
+			break;
+		case FORM_ADDR:
+			fprintf(out, " %d\n", ins->addr);
+			break;
+		case FORM_LD:
+			fprintf(out, " R%d, [R%d]\n", ins->rn + 1, ins->rm + 1);
+			break;
+		case FORM_ST:
+			fprintf(out, " [R%d], R%d\n", ins->rm + 1, ins->rn + 1);
+			break;
+		case FORM_NONE:
+			fprintf(out, "\n");
+			break;
+	}
+}
+
+static bool diff_write(const char *path, const Instr *prog, size_t n)
+{
+	FILE *out = fopen(path, "w");
+	if(!out)
+		return false;
+	for(size_t i = 0; i < n; i++)
+		diff_print_ins(out, &prog[i]);
+	return fclose(out) == 0;
+}
+
+static void diff_opts_str(const DiffOpts *o, char *buf, size_t size)
+{
+	snprintf(buf, size, "--addr-bits %d --latency %s", o->addr_bits, o->lat->name);
+}
+
+static void diff_report(DiffWorker *w, long long index, size_t n, const DiffOpts *o, size_t e, const char *what)
+{
+	Diff *d = w->d;
+	const DiffConfig *cfg = d->cfg;
+	size_t orig = n;
+
+	n = diff_shrink(w, w->prog, n, o, e);
+
+	char shrunk[160];
+	if(diff_check(w, w->prog, n, o, e, shrunk, sizeof(shrunk)) == (int)e)
+		what = shrunk;
+
+	pthread_mutex_lock(&d->lock);
+	if(d->reports < DIFF_MAX_REPORTS){
+		int r = ++d->reports;
+		char path[4096];
+		char opts[64];
+		snprintf(path, sizeof(path), "%s/diff-%llu-%lld.assembly", cfg->out_dir, (unsigned long long)cfg->seed, index);
+		diff_opts_str(o, opts, sizeof(opts));
+
+		fprintf(stderr, "engine %s disagrees with %s on program %lld (%s): %s\n", cfg->engines[e].name,
+			cfg->engines[0].name, index, opts, what);
+		if(diff_write(path, w->prog, n)){
+			fprintf(stderr, "  shrunk from %zu to %zu instructions: %s\n", orig, n, path);
+			fprintf(stderr, "  ./myISS --engine %s %s %s\n", cfg->engines[e].name, opts, path);
+		}else{
+			fprintf(stderr, "  could not write %s: %s\n", path, strerror(errno));
+		}
+		if(r == DIFF_MAX_REPORTS)
+			d->stop = true;
+	}
+	pthread_mutex_unlock(&d->lock);
+}
+
+//--- workers ---
+
+static uint64_t diff_seed(uint64_t seed, long long index)
+{
+	uint64_t z = seed + (uint64_t)index * 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static void *diff_worker(void *arg)
+{
+	DiffWorker *w = (DiffWorker*)arg;
+	Diff *d = w->d;
+	const DiffConfig *cfg = d->cfg;
+	char what[160];
+
+	while(!__atomic_load_n(&d->stop, __ATOMIC_RELAXED)){
+		long long index = __atomic_fetch_add(&d->next, 1, __ATOMIC_RELAXED);
+		if(index >= cfg->count)
+			break;
+
+		uint64_t seed = diff_seed(cfg->seed, index);
+		size_t n = gen_program(w->prog, seed);
+		DiffOpts o;
+		o.addr_bits = 8 << (seed >> 32) % 3;
+		o.lat = &lat_presets[(seed >> 40) % NUM_LAT_PRESETS];
+
+		w->opts = o;
+		w->n = n;
+		__atomic_store_n(&w->current, index, __ATOMIC_RELAXED);
+		__atomic_store_n(&w->start_ms, (long long)(diff_now() * 1000.0), __ATOMIC_RELEASE);
+
+		int bad = diff_check(w, w->prog, n, &o, 0, what, sizeof(what));
+		if(bad > 0)
+			diff_report(w, index, n, &o, (size_t)bad, what);
+
+		__atomic_store_n(&w->start_ms, 0, __ATOMIC_RELEASE);
+		if(bad < 0){
+			pthread_mutex_lock(&d->lock);
+			d->error = true;
+			d->stop = true;
+			pthread_mutex_unlock(&d->lock);
+			break;
+		}
+		__atomic_fetch_add(&d->done, 1, __ATOMIC_RELAXED);
+	}
+	__atomic_fetch_add(&d->finished, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+//a worker stuck on one program means some engine doesn't halt where the
+//reference does (generated programs always halt), there is no stopping a
+//thread in the middle of an engine, so write the program out and exit
+static void diff_hang(Diff *d, DiffWorker *w)
+{
+	char path[4096];
+	char opts[64];
+	snprintf(path, sizeof(path), "%s/diff-%llu-%lld.assembly", d->cfg->out_dir, (unsigned long long)d->cfg->seed, w->current);
+	diff_opts_str(&w->opts, opts, sizeof(opts));
+
+	fprintf(stderr, "program %lld (%s) still running after %d s, an engine doesn't halt on it\n", w->current, opts, DIFF_HANG_SEC);
+	if(diff_write(path, w->prog, w->n))
+		fprintf(stderr, "  %zu instructions: %s\n", w->n, path);
+	fflush(stderr);
+	_exit(1);
+}
+
+int diff_run(const DiffConfig *cfg)
+{
+	Diff d;
+	memset(&d, 0, sizeof(d));
+	d.cfg = cfg;
+	pthread_mutex_init(&d.lock, NULL);
+
+	int nthreads = cfg->threads > 0 ? cfg->threads : 1;
+	DiffWorker *workers = (DiffWorker*)calloc((size_t)nthreads, sizeof(*workers));
+	if(!workers){
+		fprintf(stderr, "Error: out of memory for --diff workers\n");
+		return 2;
+	}
+
+	int started = 0;
+	for(; started < nthreads; started++){
+		DiffWorker *w = &workers[started];
+		w->d = &d;
+		w->prog = (Instr*)malloc(DIFF_MAX_INSTR * sizeof(*w->prog));
+		w->resolved = (Instr*)malloc(DIFF_MAX_INSTR * sizeof(*w->resolved));
+		w->scratch = (Instr*)malloc(DIFF_MAX_INSTR * sizeof(*w->scratch));
+		w->cand = (Instr*)malloc(DIFF_MAX_INSTR * sizeof(*w->cand));
+		if(!w->prog || !w->resolved || !w->scratch || !w->cand || pthread_create(&w->thread, NULL, diff_worker, w) != 0){
+			free(w->prog);
+			free(w->resolved);
+			free(w->scratch);
+			free(w->cand);
+			break;
+		}
+	}
+	if(started < nthreads){
+		fprintf(stderr, "Error: could not start %d --diff workers\n", nthreads);
+		pthread_mutex_lock(&d.lock);
+		d.stop = true;
+		d.error = true;
+		pthread_mutex_unlock(&d.lock);
+	}
+
+	//progress on stderr, and the hang check
+	double begin = diff_now();
+	double last_print = begin;
+	for(;;){
+		usleep(100000);
+		long long done = __atomic_load_n(&d.done, __ATOMIC_RELAXED);
+		double now = diff_now();
+
+		for(int i = 0; i < started; i++){
+			long long start = __atomic_load_n(&workers[i].start_ms, __ATOMIC_ACQUIRE);
+			if(start > 0 && now * 1000.0 - (double)start > DIFF_HANG_SEC * 1000.0)
+				diff_hang(&d, &workers[i]);
+		}
+
+		if(now - last_print >= 5.0){
+			fprintf(stderr, "%lld programs, %.0f/s\n", done, (double)done / (now - begin));
+			last_print = now;
+		}
+		if(__atomic_load_n(&d.finished, __ATOMIC_ACQUIRE) == started)
+			break;
+	}
+
+	for(int i = 0; i < started; i++){
+		pthread_join(workers[i].thread, NULL);
+		free(workers[i].prog);
+		free(workers[i].resolved);
+		free(workers[i].scratch);
+		free(workers[i].cand);
+		for(int k = 0; k < 3; k++){
+			if(workers[i].ready[k]){
+				cpu_free(&workers[i].ref[k]);
+				cpu_free(&workers[i].got[k]);
+			}
+		}
+	}
+	free(workers);
+
+	double sec = diff_now() - begin;
+	long long done = d.done;
+	printf("engines:");
+	for(size_t e = 0; e < cfg->nengines; e++)
+		printf(" %s%s", cfg->engines[e].name, e == 0 ? " (reference)" : "");
+	printf("\nprograms: %lld (seed %llu)\n", done, (unsigned long long)cfg->seed);
+	printf("disagreements: %d%s\n", d.reports, d.reports == DIFF_MAX_REPORTS ? " (stopped early)" : "");
+	printf("rate: %.0f programs/s, %.1f M/hour on %d threads\n", sec > 0 ? (double)done / sec : 0.0,
+		sec > 0 ? (double)done / sec * 3600.0 / 1e6 : 0.0, started);
+
+	pthread_mutex_destroy(&d.lock);
+	if(d.error){
+		fprintf(stderr, "Error: out of memory while running --diff\n");
+		return 2;
+	}
+	return d.reports > 0 ? 1 : 0;
+}
@@ -0,0 +1,35 @@
+#ifndef ISSDIFF_H
+#define ISSDIFF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "myiss.h"
+
+//--diff: differential testing of every engine against the first one (the
+//switch interpreter). Worker threads generate random valid programs that use
+//the whole ISA (issisa.h) and always halt, run each one with a random
+//--addr-bits and latency preset through every engine, and compare the final
+//CPU: registers, flags, pc, call stack, counters, and every memory byte and
+//cached_local flag. A program an engine disagrees on is shrunk (instructions
+//are dropped while it still disagrees) and written to out_dir as an
+//assembly file together with the command that shows the difference
+
+#define DIFF_MAX_REPORTS 16 //the run stops after this many disagreeing programs
+#define DIFF_STEP_BUDGET 100000 //instructions a shrunk candidate may run before it counts as not halting
+#define DIFF_HANG_SEC 10 //a program still running after this long is reported as a hang
+
+typedef struct{
+	const Engine *engines; //engines[0] is the reference
+	size_t nengines;
+	long long count; //programs to run
+	int threads;
+	uint64_t seed; //program i only depends on seed and i, so a run can be repeated
+	const char *out_dir;
+}DiffConfig;
+
+//returns 0 if every engine agreed on every program, 1 if one didn't, 2 on errors
+int diff_run(const DiffConfig *cfg);
+
+#endif
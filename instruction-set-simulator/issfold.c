@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "issfold.h"
+
+static FoldVal fold_const(uint32_t c)
+{
+	FoldVal v = {-1, c};
+	return v;
+}
+
+static bool fold_same(FoldVal a, FoldVal b)
+{
+	return a.src == b.src && a.c == b.c;
+}
+
+//applies one instruction to the abstract registers, false (with nothing
+//changed) if it isn't register-only or its result can't be written as R[src] + c
+//SHL/SHR are left out, what they give depends on the register width
+static bool fold_step(const Instr *ins, FoldVal *val, bool *written, FoldRegion *r)
+{
+	FoldVal *d = &val[ins->rn];
+	FoldVal s;
+	uint32_t num = (uint32_t)ins->num;
+
+	switch(ins->op){
+		case MOV:
+			*d = fold_const(num);
+			r->nmov++;
+			break;
+
+		case ADD_NUM:
+			d->c += num;
+			r->nadd_num++;
+			break;
+
+		case SUB_NUM:
+			d->c -= num;
+			r->nalu++;
+			break;
+
+		case AND_NUM:
+		case OR_NUM:
+		case XOR_NUM:
+			if(d->src >= 0)
+				return false;
+			d->c = ins->op == AND_NUM ? d->c & num : (ins->op == OR_NUM ? d->c | num : d->c ^ num);
+			r->nalu++;
+			break;
+
+		case ADD_REG:
+			s = val[ins->rm];
+			if(d->src >= 0 && s.src >= 0)
+				return false;
+			if(s.src >= 0)
+				d->src = s.src;
+			d->c += s.c;
+			r->nadd_reg++;
+			break;
+
+		//R[a] - R[a] cancels out, anything else needs a constant on the right
+		case SUB_REG:
+			s = val[ins->rm];
+			if(s.src >= 0 && s.src != d->src)
+				return false;
+			if(s.src >= 0)
+				d->src = -1;
+			d->c -= s.c;
+			r->nalu++;
+			break;
+
+		case AND_REG:
+		case OR_REG:
+		case XOR_REG:
+			s = val[ins->rm];
+			if(fold_same(*d, s)){
+				if(ins->op == XOR_REG)
+					*d = fold_const(0);
+			}else if(d->src < 0 && s.src < 0){
+				d->c = ins->op == AND_REG ? d->c & s.c : (ins->op == OR_REG ? d->c | s.c : d->c ^ s.c);
+			}else{
+				return false;
+			}
+			r->nalu++;
+			break;
+
+		//only the last CMP's flags survive the region
+		case CMP:
+			r->cmp = true;
+			r->cmp_a = val[ins->rn];
+			r->cmp_b = val[ins->rm];
+			r->ncmp++;
+			return true;
+
+		default:
+			return false;
+	}
+
+	written[ins->rn] = true;
+	return true;
+}
+
+//walks forward from start as far as the values can be followed, returns the pc after the region
+static int fold_region(const Instr *prog, size_t n, size_t start, FoldRegion *r)
+{
+	FoldVal val[NUMREGS];
+	bool written[NUMREGS] = {false};
+
+	memset(r, 0, sizeof(*r));
+	for(int i = 0; i < NUMREGS; i++){
+		val[i].src = (int8_t)i;
+		val[i].c = 0;
+	}
+
+	size_t pc = start;
+	while(pc < n && pc - start < FOLD_MAX_LEN && fold_step(&prog[pc], val, written, r))
+		pc++;
+
+	r->end = (int)pc;
+	r->ninstr = (int)(pc - start);
+	for(int i = 0; i < NUMREGS; i++){
+		if(written[i]){
+			r->w[r->nwrites].rn = (uint8_t)i;
+			r->w[r->nwrites].v = val[i];
+			r->nwrites++;
+		}
+	}
+	return r->end;
+}
+
+FoldRegion *fold_program(Instr *prog, size_t n, size_t *count, size_t *folded)
+{
+	//a region can start wherever control can arrive other than by falling
+	//through a folded instruction: pc 0, jump targets, and wherever the
+	//region before it had to stop
+	bool *leader = (bool*)calloc(n + 1, sizeof(*leader));
+	size_t *start = (size_t*)malloc((n ? n : 1) * sizeof(*start));
+	FoldRegion *regions = (FoldRegion*)malloc((n ? n : 1) * sizeof(*regions));
+	if(!leader || !start || !regions){
+		free(leader);
+		free(start);
+		free(regions);
+		return NULL;
+	}
+
+	leader[0] = true;
+	for(size_t pc = 0; pc < n; pc++){
+		const Instr *ins = &prog[pc];
+		if((int)ins->op < NUM_ISA_OPS && isa_info[ins->op].form == FORM_ADDR && ins->addr >= 0 && (size_t)ins->addr < n)
+			leader[ins->addr] = true;
+	}
+
+	//every region is worked out on the program as loaded, a later region
+	//can start inside an earlier one (when something jumps there)
+	size_t k = 0;
+	*folded = 0;
+	for(size_t pc = 0; pc < n; pc++){
+		if(!leader[pc])
+			continue;
+
+		int end = fold_region(prog, n, pc, &regions[k]);
+		if((size_t)end > pc)
+			leader[end] = true;
+		else
+			leader[pc + 1] = true;
+
+		if(regions[k].ninstr >= FOLD_MIN_LEN){
+			*folded += (size_t)regions[k].ninstr;
+			start[k++] = pc;
+		}
+	}
+
+	for(size_t i = 0; i < k; i++){
+		prog[start[i]].op = FOLD;
+		prog[start[i]].addr = (int)i;
+	}
+
+	free(leader);
+	free(start);
+	*count = k;
+
+	FoldRegion *shrunk = (FoldRegion*)realloc(regions, (k ? k : 1) * sizeof(*regions));
+	return shrunk ? shrunk : regions;
+}
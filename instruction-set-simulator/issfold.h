@@ -0,0 +1,66 @@
+#ifndef ISSFOLD_H
+#define ISSFOLD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "myiss.h"
+
+//--engine fold: a pass over the decoded program, once at load, that finds
+//straight-line runs of register-only instructions (MOV, ADD/SUB/AND/OR/XOR
+//and CMP whenever the result is known in terms of the registers at the start
+//of the run) and replaces the first instruction of each with FOLD. The loop
+//then does the run's register writes and CMP flags in one step and adds its
+//instruction count and cycles, so every counter ends up exactly where the
+//switch interpreter would have left it. The instructions after the FOLD stay
+//as they were, a jump into the middle of a run just executes them one by one
+
+#define FOLD_MIN_LEN 4 //shorter runs are left alone, a FOLD costs about as much as a few plain instructions
+#define FOLD_MAX_LEN 1024 //instructions per region, a longer run becomes several
+
+//a value in terms of the registers at the start of the region:
+//R[src] + c, or just c when src is -1, masked to the register width
+typedef struct{
+	int8_t src;
+	uint32_t c;
+}FoldVal;
+
+typedef struct{
+	uint8_t rn;
+	FoldVal v;
+}FoldWrite;
+
+struct FoldRegion{
+	int end; //pc after the region
+	int ninstr;
+
+	//instructions per LatencyModel cost, the cycles are these times the model
+	int nmov;
+	int nadd_reg;
+	int nadd_num;
+	int nalu;
+	int ncmp;
+
+	//operands of the last CMP, the flags are worked out when the FOLD runs
+	bool cmp;
+	FoldVal cmp_a;
+	FoldVal cmp_b;
+
+	//every register the region writes, even with the value it already had,
+	//since writing sign-wraps a byte LD left unwrapped
+	int nwrites;
+	FoldWrite w[NUMREGS];
+};
+
+//rewrites prog in place, returns the table cpu->fold has to point at while
+//prog runs (free it with free), NULL if out of memory
+//count gets the number of regions and folded the sum of their lengths
+FoldRegion *fold_program(Instr *prog, size_t n, size_t *count, size_t *folded);
+
+static inline uint32_t fold_eval(const int *R, FoldVal v)
+{
+	return (v.src < 0 ? 0u : (uint32_t)R[v.src]) + v.c;
+}
+
+#endif
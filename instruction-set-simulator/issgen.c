@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "issgen.h"
+
+//registers the generator reserves (1-based like the assembly)
+#define GEN_ZERO_REG 6 //always 0, the loops count down to it
+#define GEN_ADDR_REG 1 //holds the address for LD/ST
+#define GEN_DATA_REG 2
+
+//one generated instruction before line numbers are assigned
+//jumps point at an index in the list and get turned into a line number at print time
+typedef struct{
+	const char *op;
+	int a, b; //registers (1-based) or immediate, meaning depends on kind
+	int kind;
+	size_t target;
+}GenIns;
+
+enum{
+	K_REG_IMM, // OP Ra, b
+	K_REG_REG, // OP Ra, Rb
+	K_JUMP, // OP target
+	K_LD, // LD Ra, [Rb]
+	K_ST // ST [Rb], Ra
+};
+
+typedef struct{
+	GenIns *ins;
+	size_t n;
+	size_t size;
+	uint64_t rng;
+	const GenParams *params;
+	int nscratch; //R1..R<nscratch> are free for the body
+	bool oom;
+}GenState;
+
+//xorshift64*, small and good enough for picking instructions
+//reference: https://en.wikipedia.org/wiki/Xorshift#xorshift*
+static uint64_t gen_next(GenState *g)
+{
+	g->rng ^= g->rng >> 12;
+	g->rng ^= g->rng << 25;
+	g->rng ^= g->rng >> 27;
+	return g->rng * 0x2545f4914f6cdd1dULL;
+}
+
+static int gen_range(GenState *g, int n) // [0, n)
+{
+	return (int)(gen_next(g) % (uint64_t)n);
+}
+
+static double gen_unit(GenState *g) // [0, 1)
+{
+	return (double)(gen_next(g) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static size_t gen_emit(GenState *g, const char *op, int kind, int a, int b)
+{
+	if(g->n == g->size){
+		size_t size = g->size ? g->size * 2 : 64;
+		GenIns *tmp = (GenIns*)realloc(g->ins, size * sizeof(*tmp));
+		if(!tmp){
+			g->oom = true;
+			return g->n;
+		}
+		g->ins = tmp;
+		g->size = size;
+	}
+
+	GenIns *ins = &g->ins[g->n];
+	ins->op = op;
+	ins->kind = kind;
+	ins->a = a;
+	ins->b = b;
+	ins->target = 0;
+	return g->n++;
+}
+
+//straight-line body of the innermost loop
+//mix: q_branch and q_mem are per-choice probabilities picked so that the share of
+//JE and LD/ST among *emitted* instructions comes out as params->branch and params->ldst
+static void gen_body(GenState *g, int budget)
+{
+	const GenParams *p = g->params;
+	double per_choice = 1.0 / (1.0 - p->branch - p->ldst); //expected instructions per choice
+	double q_branch = p->branch * per_choice;
+	double q_mem = p->ldst * per_choice;
+
+	size_t start = g->n;
+	size_t first_jump = g->n; //JE targets get clamped to the end of the body once it is known
+
+	while((int)(g->n - start) < budget && !g->oom){
+		double r = gen_unit(g);
+		int left = budget - (int)(g->n - start);
+
+		if(r < q_branch && left >= 3){
+			//data dependent forward branch, skips 1-4 instructions of the body
+			int ra = 1 + gen_range(g, g->nscratch);
+			int rb = 1 + gen_range(g, g->nscratch);
+			gen_emit(g, "CMP", K_REG_REG, ra, rb);
+			size_t je = gen_emit(g, "JE", K_JUMP, 0, 0);
+			if(je < g->n)
+				g->ins[je].target = je + 2 + (size_t)gen_range(g, 4);
+		}else if(r < q_branch + q_mem && left >= 2){
+			int addr = gen_range(g, p->footprint);
+			gen_emit(g, "MOV", K_REG_IMM, GEN_ADDR_REG, addr < 128 ? addr : addr - 256);
+			if(gen_range(g, 2))
+				gen_emit(g, "LD", K_LD, GEN_DATA_REG, GEN_ADDR_REG);
+			else
+				gen_emit(g, "ST", K_ST, GEN_DATA_REG, GEN_ADDR_REG);
+		}else{
+			int ra = 1 + gen_range(g, g->nscratch);
+			int rb = 1 + gen_range(g, g->nscratch);
+			switch(gen_range(g, 3)){
+				case 0:
+					gen_emit(g, "MOV", K_REG_IMM, ra, gen_range(g, 256) - 128);
+					break;
+				case 1:
+					gen_emit(g, "ADD", K_REG_IMM, ra, gen_range(g, 256) - 128);
+					break;
+				default:
+					gen_emit(g, "ADD", K_REG_REG, ra, rb);
+					break;
+			}
+		}
+	}
+
+	for(size_t i = first_jump; i < g->n; i++){
+		if(g->ins[i].kind == K_JUMP && g->ins[i].target > g->n)
+			g->ins[i].target = g->n;
+	}
+}
+
+//loop at nest level `level` counting R(5-level) down from trips to 0
+static void gen_level(GenState *g, int level, int budget)
+{
+	if(level == g->params->depth){
+		gen_body(g, budget);
+		return;
+	}
+
+	int rc = 5 - level;
+	gen_emit(g, "MOV", K_REG_IMM, rc, g->params->trips);
+	size_t top = g->n;
+
+	gen_level(g, level + 1, budget);
+
+	gen_emit(g, "ADD", K_REG_IMM, rc, -1);
+	gen_emit(g, "CMP", K_REG_REG, rc, GEN_ZERO_REG);
+	size_t je = gen_emit(g, "JE", K_JUMP, 0, 0);
+	size_t jmp = gen_emit(g, "JMP", K_JUMP, 0, 0);
+	if(!g->oom){
+		g->ins[je].target = jmp + 1;
+		g->ins[jmp].target = top;
+	}
+}
+
+void gen_defaults(GenParams *params)
+{
+	params->size = 64;
+	params->depth = 1;
+	params->trips = 10;
+	params->ldst = 0.25;
+	params->footprint = 64;
+	params->branch = 0.1;
+	params->first_line = 10;
+}
+
+int gen_program(FILE *out, const GenParams *params, uint64_t seed)
+{
+	if(params->size < 1 || params->depth < 0 || params->depth > GEN_MAX_DEPTH
+		|| params->trips < 1 || params->trips > 127
+		|| params->ldst < 0.0 || params->branch < 0.0 || params->ldst + params->branch > 0.5
+		|| params->footprint < 1 || params->footprint > 256 || params->first_line < 0)
+		return -1;
+
+	GenState g;
+	memset(&g, 0, sizeof(g));
+	g.params = params;
+	g.rng = seed * 0x9e3779b97f4a7c15ULL + 0x2545f4914f6cdd1dULL;
+	if(g.rng == 0)
+		g.rng = 1;
+	g.nscratch = params->depth < 3 ? 3 : 2; //R3 is free unless it is the third loop counter
+
+	//prologue + 5 instructions of loop control per level, the rest is body
+	int budget = params->size - 1 - 5 * params->depth;
+	if(budget < 1)
+		budget = 1;
+
+	gen_emit(&g, "MOV", K_REG_IMM, GEN_ZERO_REG, 0);
+	gen_level(&g, 0, budget);
+
+	if(g.oom){
+		free(g.ins);
+		return -1;
+	}
+
+	for(size_t i = 0; i < g.n; i++){
+		const GenIns *ins = &g.ins[i];
+		fprintf(out, "%d\t%s ", params->first_line + (int)i, ins->op);
+
+		switch(ins->kind){
+			case K_REG_IMM:
+				fprintf(out, "R%d, %d\n", ins->a, ins->b);
+				break;
+			case K_REG_REG:
+				fprintf(out, "R%d, R%d\n", ins->a, ins->b);
+				break;
+			case K_JUMP:
+				fprintf(out, "%d\n", params->first_line + (int)ins->target);
+				break;
+			case K_LD:
+				fprintf(out, "R%d, [R%d]\n", ins->a, ins->b);
+				break;
+			case K_ST:
+				fprintf(out, "[R%d], R%d\n", ins->b, ins->a);
+				break;
+		}
+	}
+
+	free(g.ins);
+	return (int)g.n;
+}
@@ -0,0 +1,28 @@
+#ifndef ISSGEN_H
+#define ISSGEN_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+//deepest loop nest the generator can build: R6 holds 0 for the loop compares
+//and R5, R4, R3 are the loop counters, which leaves R1/R2 as scratch
+#define GEN_MAX_DEPTH 3
+
+//knobs for one synthetic program
+typedef struct{
+	int size; //static instruction count to aim for
+	int depth; //loop nest depth, 0 = straight line
+	int trips; //iterations of every loop, 1..127
+	double ldst; //fraction of body instructions that are LD/ST (at most 0.5, each needs a MOV for its address)
+	int footprint; //distinct addresses touched, 1..256
+	double branch; //fraction of body instructions that are a JE (each paired with a CMP)
+	int first_line; //line number of the first instruction
+}GenParams;
+
+void gen_defaults(GenParams *params);
+
+//writes a valid, terminating program in the sample.assembly format
+//returns the number of instructions written, -1 if params are out of range
+int gen_program(FILE *out, const GenParams *params, uint64_t seed);
+
+#endif
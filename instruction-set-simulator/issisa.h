@@ -0,0 +1,177 @@
+#ifndef ISSISA_H
+#define ISSISA_H
+
+//the instruction set, described once. The Opcode enum, the mnemonic lookup in
+//parse_line and the cases of every execute loop are generated from this list
+//
+//X(op, mnemonic, form, kind, arg, cost)
+//	op		Opcode name, the list order is the enum order (so the old
+//			eight keep their numbers and the result cache keys)
+//	mnemonic	what parse_line matches
+//	form		operands, see IsaForm. When two ops share a mnemonic the first
+//			one whose form fits wins (ADD Rn, Rm before ADD Rn, num)
+//	kind		ISA_EXEC_<kind> executes it
+//	arg		ALU ops: ISA_<op>(a, b, bits), branches: ISA_<cond>(cpu), else ISA_NONE
+//	cost		LatencyModel field, branches use cost_taken / cost_not_taken and
+//			LD/ST cost_hit / cost_miss
+#define ISA_OPS(X) \
+	X(MOV,     "MOV",  FORM_RN_NUM, MOV,    ISA_NONE, mov) \
+	X(ADD_REG, "ADD",  FORM_RN_RM,  ALU_RR, ISA_ADD,  add_reg) \
+	X(ADD_NUM, "ADD",  FORM_RN_NUM, ALU_RI, ISA_ADD,  add_num) \
+	X(CMP,     "CMP",  FORM_RN_RM,  CMP,    ISA_NONE, cmp) \
+	X(JE,      "JE",   FORM_ADDR,   BRANCH, ISA_EQ,   je) \
+	X(JMP,     "JMP",  FORM_ADDR,   JUMP,   ISA_NONE, jmp) \
+	X(LD,      "LD",   FORM_LD,     LD,     ISA_NONE, ld) \
+	X(ST,      "ST",   FORM_ST,     ST,     ISA_NONE, st) \
+	X(SUB_REG, "SUB",  FORM_RN_RM,  ALU_RR, ISA_SUB,  alu) \
+	X(SUB_NUM, "SUB",  FORM_RN_NUM, ALU_RI, ISA_SUB,  alu) \
+	X(AND_REG, "AND",  FORM_RN_RM,  ALU_RR, ISA_AND,  alu) \
+	X(AND_NUM, "AND",  FORM_RN_NUM, ALU_RI, ISA_AND,  alu) \
+	X(OR_REG,  "OR",   FORM_RN_RM,  ALU_RR, ISA_OR,   alu) \
+	X(OR_NUM,  "OR",   FORM_RN_NUM, ALU_RI, ISA_OR,   alu) \
+	X(XOR_REG, "XOR",  FORM_RN_RM,  ALU_RR, ISA_XOR,  alu) \
+	X(XOR_NUM, "XOR",  FORM_RN_NUM, ALU_RI, ISA_XOR,  alu) \
+	X(SHL_REG, "SHL",  FORM_RN_RM,  ALU_RR, ISA_SHL,  alu) \
+	X(SHL_NUM, "SHL",  FORM_RN_NUM, ALU_RI, ISA_SHL,  alu) \
+	X(SHR_REG, "SHR",  FORM_RN_RM,  ALU_RR, ISA_SHR,  alu) \
+	X(SHR_NUM, "SHR",  FORM_RN_NUM, ALU_RI, ISA_SHR,  alu) \
+	X(BNE,     "BNE",  FORM_ADDR,   BRANCH, ISA_NE,   bne) \
+	X(BLT,     "BLT",  FORM_ADDR,   BRANCH, ISA_LT,   blt) \
+	X(CALL,    "CALL", FORM_ADDR,   CALL,   ISA_NONE, call) \
+	X(RET,     "RET",  FORM_NONE,   RET,    ISA_NONE, ret)
+
+typedef enum{
+	FORM_RN_NUM, // Rn, <num>
+	FORM_RN_RM, // Rn, Rm
+	FORM_ADDR, // <line number>, resolved to an index by resolve_targets
+	FORM_LD, // Rn, [Rm]
+	FORM_ST, // [Rm], Rn
+	FORM_NONE
+}IsaForm;
+
+//return addresses CALL can push, a CALL with a full stack or a RET with an
+//empty one halts the program like running off the end does
+#define CALL_STACK_DEPTH 16
+
+//ALU operations on operands already masked to the register width, the result
+//gets masked and sign-wrapped by the handler. Shifting by the width or more gives 0
+#define ISA_ADD(a, b, bits) ((a) + (b))
+#define ISA_SUB(a, b, bits) ((a) - (b))
+#define ISA_AND(a, b, bits) ((a) & (b))
+#define ISA_OR(a, b, bits) ((a) | (b))
+#define ISA_XOR(a, b, bits) ((a) ^ (b))
+#define ISA_SHL(a, b, bits) ((b) >= (uint32_t)(bits) ? 0u : (a) << (b))
+#define ISA_SHR(a, b, bits) ((b) >= (uint32_t)(bits) ? 0u : (a) >> (b))
+
+//placeholder for ops that don't need an arg
+#define ISA_NONE(...) 0
+
+//branch conditions, CMP sets both flags (BLT is a signed compare)
+#define ISA_EQ(cpu) ((cpu)->last_je)
+#define ISA_NE(cpu) (!(cpu)->last_je)
+#define ISA_LT(cpu) ((cpu)->last_lt)
+
+//1 for the kinds that can go two ways (coverage records both)
+#define ISA_IS_COND_MOV 0
+#define ISA_IS_COND_ALU_RR 0
+#define ISA_IS_COND_ALU_RI 0
+#define ISA_IS_COND_CMP 0
+#define ISA_IS_COND_BRANCH 1
+#define ISA_IS_COND_JUMP 0
+#define ISA_IS_COND_LD 0
+#define ISA_IS_COND_ST 0
+#define ISA_IS_COND_CALL 0
+#define ISA_IS_COND_RET 0
+
+//jump target, anything outside the program exits cleanly
+#define ISA_TARGET(ins, n) (((ins)->addr < 0 || (size_t)(ins)->addr >= (n)) ? (int)(n) : (ins)->addr)
+
+//case handlers, one per kind. They expect cpu, ins, n, bits, mask and lat in
+//scope, and pc / cycles as locals the loop copies back into cpu when it stops
+//(kept out of the CPU struct so they can live in registers); LD and ST touch
+//memory differently in every loop, so each loop defines ISA_EXEC_LD / ISA_EXEC_ST itself,
+//and ISA_COV_BRANCH(taken) (taken is 0 or 1, pc still the branch's) for coverage
+#define ISA_EXEC_MOV(op, arg, cost) \
+	case op: \
+		cpu->R[ins->rn] = wrap_reg((uint32_t)ins->num, bits); \
+		cycles += lat->cost; \
+		pc += 1; \
+		break;
+
+#define ISA_EXEC_ALU_RR(op, arg, cost) \
+	case op:{ \
+		uint32_t a = (uint32_t)cpu->R[ins->rn] & mask; \
+		uint32_t b = (uint32_t)cpu->R[ins->rm] & mask; \
+		cpu->R[ins->rn] = wrap_reg(arg(a, b, bits) & mask, bits); \
+		cycles += lat->cost; \
+		pc += 1; \
+		}break;
+
+#define ISA_EXEC_ALU_RI(op, arg, cost) \
+	case op:{ \
+		uint32_t a = (uint32_t)cpu->R[ins->rn] & mask; \
+		uint32_t b = (uint32_t)ins->num & mask; \
+		cpu->R[ins->rn] = wrap_reg(arg(a, b, bits) & mask, bits); \
+		cycles += lat->cost; \
+		pc += 1; \
+		}break;
+
+#define ISA_EXEC_CMP(op, arg, cost) \
+	case op:{ \
+		uint32_t a = (uint32_t)cpu->R[ins->rn] & mask; \
+		uint32_t b = (uint32_t)cpu->R[ins->rm] & mask; \
+		cpu->last_je = a == b; \
+		cpu->last_lt = wrap_reg(a, bits) < wrap_reg(b, bits); \
+		cycles += lat->cost; \
+		pc += 1; \
+		}break;
+
+#define ISA_EXEC_BRANCH(op, arg, cost) \
+	case op:{ \
+		int taken = arg(cpu) ? 1 : 0; \
+		ISA_COV_BRANCH(taken); \
+		if(taken){ \
+			cycles += lat->cost##_taken; \
+			pc = ISA_TARGET(ins, n); \
+		}else{ \
+			cycles += lat->cost##_not_taken; \
+			pc += 1; \
+		} \
+		}break;
+
+#define ISA_EXEC_JUMP(op, arg, cost) \
+	case op: \
+		cycles += lat->cost; \
+		pc = ISA_TARGET(ins, n); \
+		break;
+
+#define ISA_EXEC_CALL(op, arg, cost) \
+	case op: \
+		cycles += lat->cost; \
+		if(cpu->sp == CALL_STACK_DEPTH){ \
+			pc = (int)(n); \
+		}else{ \
+			cpu->stack[cpu->sp++] = pc + 1; \
+			pc = ISA_TARGET(ins, n); \
+		} \
+		break;
+
+#define ISA_EXEC_RET(op, arg, cost) \
+	case op: \
+		cycles += lat->cost; \
+		pc = cpu->sp == 0 ? (int)(n) : cpu->stack[--cpu->sp]; \
+		break;
+
+//case generators for isa_cond: only branches have a direction
+#define ISA_COND_MOV(op, arg)
+#define ISA_COND_ALU_RR(op, arg)
+#define ISA_COND_ALU_RI(op, arg)
+#define ISA_COND_CMP(op, arg)
+#define ISA_COND_BRANCH(op, arg) case op: return arg(cpu) ? 1 : 0;
+#define ISA_COND_JUMP(op, arg)
+#define ISA_COND_LD(op, arg)
+#define ISA_COND_ST(op, arg)
+#define ISA_COND_CALL(op, arg)
+#define ISA_COND_RET(op, arg)
+
+#endif
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "isslat.h"
+
+//config file keys, in the order lat_format prints them
+typedef struct{
+	const char *key;
+	size_t offset;
+}LatField;
+
+static const LatField fields[] = {
+	{"mov", offsetof(LatencyModel, mov)},
+	{"add_reg", offsetof(LatencyModel, add_reg)},
+	{"add_num", offsetof(LatencyModel, add_num)},
+	{"cmp", offsetof(LatencyModel, cmp)},
+	{"je_taken", offsetof(LatencyModel, je_taken)},
+	{"je_not_taken", offsetof(LatencyModel, je_not_taken)},
+	{"jmp", offsetof(LatencyModel, jmp)},
+	{"ld_hit", offsetof(LatencyModel, ld_hit)},
+	{"ld_miss", offsetof(LatencyModel, ld_miss)},
+	{"st_hit", offsetof(LatencyModel, st_hit)},
+	{"st_miss", offsetof(LatencyModel, st_miss)},
+	{"inval", offsetof(LatencyModel, inval)},
+	{"alu", offsetof(LatencyModel, alu)},
+	{"bne_taken", offsetof(LatencyModel, bne_taken)},
+	{"bne_not_taken", offsetof(LatencyModel, bne_not_taken)},
+	{"blt_taken", offsetof(LatencyModel, blt_taken)},
+	{"blt_not_taken", offsetof(LatencyModel, blt_not_taken)},
+	{"call", offsetof(LatencyModel, call)},
+	{"ret", offsetof(LatencyModel, ret)},
+};
+#define NUM_FIELDS (sizeof(fields) / sizeof(fields[0]))
+
+static int *field_ptr(LatencyModel *lat, const LatField *f)
+{
+	return (int*)((char*)lat + f->offset);
+}
+
+const LatencyModel *lat_find(const char *name)
+{
+	for(size_t i = 0; i < NUM_LAT_PRESETS; i++){
+		if(strcmp(lat_presets[i].name, name) == 0)
+			return &lat_presets[i];
+	}
+	return NULL;
+}
+
+bool lat_load(const char *path, LatencyModel *lat, char *err, size_t errlen)
+{
+	FILE *pFile = fopen(path, "r");
+	if(pFile == NULL){
+		snprintf(err, errlen, "%s: %s", path, strerror(errno));
+		return false;
+	}
+
+	*lat = *LAT_DEFAULT;
+	lat->name = path;
+	lat->preset = -1;
+
+	char line[256];
+	int line_num = 0;
+	bool ok = true;
+	const char *delimiters = " \t\r\n";
+
+	while(ok && fgets(line, sizeof(line), pFile)){
+		line_num++;
+
+		char *hash = strchr(line, '#');
+		if(hash)
+			*hash = '\0';
+
+		char *save = NULL;
+		char *key = strtok_r(line, delimiters, &save);
+		char *val = strtok_r(NULL, delimiters, &save);
+		if(!key)
+			continue;
+
+		if(!val || strtok_r(NULL, delimiters, &save)){
+			snprintf(err, errlen, "%s:%d: expected \"<key> <value>\"", path, line_num);
+			ok = false;
+			break;
+		}
+
+		//a preset resets every field, so it has to come before the overrides to mean anything
+		if(strcmp(key, "preset") == 0){
+			const LatencyModel *base = lat_find(val);
+			if(!base){
+				snprintf(err, errlen, "%s:%d: unknown preset %s", path, line_num, val);
+				ok = false;
+				break;
+			}
+			*lat = *base;
+			lat->name = path;
+			lat->preset = -1;
+			continue;
+		}
+
+		const LatField *f = NULL;
+		for(size_t i = 0; i < NUM_FIELDS && f == NULL; i++){
+			if(strcmp(fields[i].key, key) == 0)
+				f = &fields[i];
+		}
+
+		char *end = NULL;
+		long v = strtol(val, &end, 10);
+		if(f == NULL){
+			snprintf(err, errlen, "%s:%d: unknown key %s", path, line_num, key);
+			ok = false;
+		}else if(*end != '\0' || v < 0 || v > 1000000){
+			snprintf(err, errlen, "%s:%d: %s must be a cycle count from 0 to 1000000", path, line_num, key);
+			ok = false;
+		}else{
+			*field_ptr(lat, f) = (int)v;
+		}
+	}
+
+	fclose(pFile);
+	return ok;
+}
+
+void lat_format(const LatencyModel *lat, char *buf, size_t size)
+{
+	size_t len = 0;
+	buf[0] = '\0';
+
+	for(size_t i = 0; i < NUM_FIELDS && len < size; i++){
+		int v = *field_ptr((LatencyModel*)lat, &fields[i]);
+		int w = snprintf(buf + len, size - len, "%s%s=%d", i ? " " : "", fields[i].key, v);
+		if(w < 0)
+			break;
+		len += (size_t)w;
+	}
+}
@@ -0,0 +1,62 @@
+#ifndef ISSLAT_H
+#define ISSLAT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+//cycle costs of every instruction (--latency)
+//LD/ST cost the hit or the miss number depending on cached_local, and inval
+//is what a store pays per other core it invalidates in --cores mode
+typedef struct{
+	const char *name;
+	int preset; //index into lat_presets, -1 for a model loaded from a file
+
+	int mov;
+	int add_reg;
+	int add_num;
+	int cmp;
+	int je_taken;
+	int je_not_taken;
+	int jmp;
+	int ld_hit;
+	int ld_miss;
+	int st_hit;
+	int st_miss;
+	int inval;
+
+	//extended ISA (issisa.h): alu is SUB/AND/OR/XOR/SHL/SHR in both forms
+	int alu;
+	int bne_taken;
+	int bne_not_taken;
+	int blt_taken;
+	int blt_not_taken;
+	int call;
+	int ret;
+}LatencyModel;
+
+//built-in models, the first one is the timing the assignment asked for
+//these are static so every file that includes this sees the numbers as
+//constants, execute_program has one copy of its loop per preset with the
+//costs folded in (so the default costs exactly what the old literals did)
+//and a generic copy that reads a loaded model at run time
+static const LatencyModel lat_presets[] __attribute__((unused)) = {
+	//name       preset mov add_reg add_num cmp je_t je_nt jmp ld_h ld_m st_h st_m inval alu bne_t bne_nt blt_t blt_nt call ret
+	{"default",  0,     1,  1,      1,      1,  1,   1,    1,  2,   50,  2,   50,  10,   1,  1,    1,     1,    1,     1,   1},
+	{"flat",     1,     1,  1,      1,      1,  1,   1,    1,  1,   1,   1,   1,   0,    1,  1,    1,     1,    1,     1,   1}, //ideal memory, counts instructions
+	{"slowmem",  2,     1,  1,      1,      1,  2,   1,    2,  3,   120, 3,   120, 20,   1,  2,    1,     2,    1,     2,   2}, //far DRAM + taken-branch bubble
+};
+#define NUM_LAT_PRESETS (sizeof(lat_presets) / sizeof(lat_presets[0]))
+#define LAT_DEFAULT (&lat_presets[0])
+
+//preset by name, NULL if there is none
+const LatencyModel *lat_find(const char *name);
+
+//reads "key value" lines (# comments), keys are the field names above, plus an
+//optional "preset <name>" to start from instead of default
+//returns false with a message in err if the file can't be read or is malformed
+bool lat_load(const char *path, LatencyModel *lat, char *err, size_t errlen);
+
+//one-line "key=value ..." form, goes into the result cache key
+void lat_format(const LatencyModel *lat, char *buf, size_t size);
+
+#endif
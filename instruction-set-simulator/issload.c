@@ -0,0 +1,255 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/***********************************************************
+ * Load generator for myISS --serve
+ *
+ * Usage:
+ * 	./issload -s [SOCKET] -f [FILE] [options]
+ *
+ * 		-s [SOCKET]	socket the server listens on
+ * 		-f [FILE]	assembly program to LOAD once per connection
+ * 		-c [CONNS]	concurrent connections, one thread each (default 4)
+ * 		-n [REQS]	RUN requests per connection (default 10000)
+ * 		-v		vary R1 on every request instead of sending the same state
+ *
+ * 	prints requests/sec over the whole run and the latency
+ * 	percentiles of single RUN requests
+ *
+ ***********************************************************/
+
+typedef struct{
+	const char *sock_path;
+	const char *text;
+	size_t len;
+	int nreq;
+	bool vary;
+
+	double *lat_us; //nreq latencies of this connection
+	int done;
+	int errors;
+	char first_error[128];
+}Conn;
+
+static void print_usage(void)
+{
+	fprintf(stderr, "Usage: ./issload -s socket -f assembly_file [-c connections] [-n requests] [-v]\n");
+}
+
+static double now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+static void set_error(Conn *c, const char *msg)
+{
+	if(c->errors++ == 0)
+		snprintf(c->first_error, sizeof(c->first_error), "%s", msg);
+}
+
+static void *run_conn(void *arg)
+{
+	Conn *c = (Conn*)arg;
+
+	struct sockaddr_un sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	snprintf(sa.sun_path, sizeof(sa.sun_path), "%s", c->sock_path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0 || connect(fd, (struct sockaddr*)&sa, sizeof(sa)) != 0){
+		set_error(c, "could not connect");
+		if(fd >= 0)
+			close(fd);
+		return NULL;
+	}
+
+	FILE *in = fdopen(dup(fd), "r");
+	FILE *out = fdopen(fd, "w");
+	char line[256];
+	char hash[64];
+
+	if(!in || !out){
+		set_error(c, "out of memory");
+		goto out;
+	}
+
+	fprintf(out, "LOAD %zu\n", c->len);
+	fwrite(c->text, 1, c->len, out);
+	fflush(out);
+	if(!fgets(line, sizeof(line), in) || sscanf(line, "OK %63s", hash) != 1){
+		set_error(c, "LOAD failed");
+		goto out;
+	}
+
+	for(int i = 0; i < c->nreq; i++){
+		double t0 = now_us();
+		if(c->vary)
+			fprintf(out, "RUN %s R1=%d\n", hash, i & 0x7F);
+		else
+			fprintf(out, "RUN %s\n", hash);
+		fflush(out);
+
+		if(!fgets(line, sizeof(line), in)){
+			set_error(c, "connection closed");
+			break;
+		}
+		c->lat_us[c->done++] = now_us() - t0;
+
+		if(strncmp(line, "OK ", 3) != 0){
+			line[strcspn(line, "\n")] = '\0';
+			set_error(c, line);
+		}
+	}
+
+out:
+	if(in)
+		fclose(in);
+	if(out)
+		fclose(out);
+	else
+		close(fd);
+	return NULL;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return x < y ? -1 : (x > y);
+}
+
+static char *read_all(const char *path, size_t *len)
+{
+	FILE *pFile = fopen(path, "rb");
+	if(pFile == NULL)
+		return NULL;
+
+	size_t size = 4096, n = 0;
+	char *buf = (char*)malloc(size);
+	size_t got;
+	while(buf && (got = fread(buf + n, 1, size - n, pFile)) > 0){
+		n += got;
+		if(n == size){
+			size *= 2;
+			char *tmp = (char*)realloc(buf, size);
+			if(!tmp){
+				free(buf);
+				buf = NULL;
+			}else{
+				buf = tmp;
+			}
+		}
+	}
+	fclose(pFile);
+
+	*len = n;
+	return buf;
+}
+
+int main(int argc, char **argv){
+	const char *sock_path = NULL;
+	const char *file = NULL;
+	int nconn = 4;
+	int nreq = 10000;
+	bool vary = false;
+
+	for(int i = 1; i < argc; i++){
+		if(strcmp(argv[i], "-v") == 0){
+			vary = true;
+			continue;
+		}
+		if(argv[i][0] != '-' || argv[i][1] == '\0' || argv[i][2] != '\0' || i + 1 >= argc){
+			print_usage();
+			return 1;
+		}
+
+		const char *val = argv[++i];
+		switch(argv[i - 1][1]){
+			case 's': sock_path = val; break;
+			case 'f': file = val; break;
+			case 'c': nconn = atoi(val); break;
+			case 'n': nreq = atoi(val); break;
+			default:
+				print_usage();
+				return 1;
+		}
+	}
+
+	if(!sock_path || !file || nconn < 1 || nreq < 1){
+		print_usage();
+		return 1;
+	}
+
+	size_t len = 0;
+	char *text = read_all(file, &len);
+	if(text == NULL){
+		perror("Error opening file");
+		return 1;
+	}
+
+	Conn *conns = (Conn*)calloc((size_t)nconn, sizeof(*conns));
+	pthread_t *threads = (pthread_t*)calloc((size_t)nconn, sizeof(*threads));
+	double *all = (double*)malloc((size_t)nconn * (size_t)nreq * sizeof(*all));
+	if(!conns || !threads || !all){
+		fprintf(stderr, "issload: out of memory\n");
+		return 1;
+	}
+
+	double t0 = now_us();
+	int started = 0;
+	for(; started < nconn; started++){
+		Conn *c = &conns[started];
+		c->sock_path = sock_path;
+		c->text = text;
+		c->len = len;
+		c->nreq = nreq;
+		c->vary = vary;
+		c->lat_us = all + (size_t)started * (size_t)nreq;
+		if(pthread_create(&threads[started], NULL, run_conn, c) != 0)
+			break;
+	}
+	for(int i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	double wall = now_us() - t0;
+
+	//latencies of every connection packed together, then sorted for the percentiles
+	size_t total = 0;
+	int errors = 0;
+	for(int i = 0; i < started; i++){
+		memmove(all + total, conns[i].lat_us, (size_t)conns[i].done * sizeof(*all));
+		total += (size_t)conns[i].done;
+		errors += conns[i].errors;
+		if(conns[i].errors)
+			fprintf(stderr, "connection %d: %d errors, first: %s\n", i, conns[i].errors, conns[i].first_error);
+	}
+	qsort(all, total, sizeof(*all), cmp_double);
+
+	printf("connections   %d\n", started);
+	printf("requests      %zu\n", total);
+	printf("errors        %d\n", errors);
+	printf("req/s         %.0f\n", wall > 0 ? (double)total / (wall / 1e6) : 0.0);
+	if(total){
+		printf("p50 (us)      %.1f\n", all[(total - 1) / 2]);
+		printf("p99 (us)      %.1f\n", all[(size_t)((double)(total - 1) * 0.99)]);
+		printf("max (us)      %.1f\n", all[total - 1]);
+	}
+
+	free(all);
+	free(threads);
+	free(conns);
+	free(text);
+	return errors || started < nconn ? 1 : 0;
+}
@@ -0,0 +1,366 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "issmc.h"
+
+//stores a core made during the current quantum, not visible to other cores yet
+//small open-addressing table keyed by address (memory can be 4 GB now), plus
+//the addresses in first-write order so the merge is deterministic
+typedef struct{
+	uint32_t addr;
+	uint8_t val;
+	bool used;
+}SbSlot;
+
+typedef struct{
+	SbSlot *slots;
+	uint32_t cap; //power of two
+	uint32_t *list;
+	uint32_t nlist;
+	bool failed; //couldn't grow, the core stopped at that store
+}StoreBuf;
+
+typedef struct{
+	CPU *cpus;
+	const McProgram *progs;
+	int ncores;
+	int quantum;
+
+	SimMem shmem; //shared memory as of the last barrier, cpus[i].mem only keeps core i's cached_local
+	StoreBuf *bufs;
+
+	pthread_barrier_t barrier;
+	bool done;
+	bool failed; //a core's store buffer couldn't grow, everyone stopped
+
+	//start gate, workers only enter the quantum loop once every thread exists
+	pthread_mutex_t gate_lock;
+	pthread_cond_t gate_cond;
+	int gate; //0 = wait, 1 = run, -1 = abort (a thread couldn't be created)
+
+	McStats *stats;
+}McSystem;
+
+typedef struct{
+	McSystem *sys;
+	int id;
+}McWorker;
+
+static uint32_t sb_hash(uint32_t addr)
+{
+	return addr * 2654435761u; //Knuth multiplicative hash
+}
+
+//slot holding addr, or the empty slot where it would go
+static SbSlot *sb_find(StoreBuf *sb, uint32_t addr)
+{
+	uint32_t i = sb_hash(addr) & (sb->cap - 1);
+	while(sb->slots[i].used && sb->slots[i].addr != addr)
+		i = (i + 1) & (sb->cap - 1);
+	return &sb->slots[i];
+}
+
+static bool sb_init(StoreBuf *sb)
+{
+	sb->cap = 64;
+	sb->nlist = 0;
+	sb->failed = false;
+	sb->slots = (SbSlot*)calloc(sb->cap, sizeof(*sb->slots));
+	sb->list = (uint32_t*)malloc(sb->cap * sizeof(*sb->list));
+	return sb->slots && sb->list;
+}
+
+static void sb_free(StoreBuf *sb)
+{
+	free(sb->slots);
+	free(sb->list);
+}
+
+//keeps the table at most half full, entries are re-inserted in list order
+//false if out of memory, the table is left as it was
+static bool sb_grow(StoreBuf *sb)
+{
+	uint32_t cap = sb->cap * 2;
+	SbSlot *slots = (SbSlot*)calloc(cap, sizeof(*slots));
+	uint32_t *list = slots ? (uint32_t*)realloc(sb->list, cap * sizeof(*list)) : NULL;
+	if(!list){
+		free(slots);
+		return false;
+	}
+
+	StoreBuf old = *sb;
+	sb->cap = cap;
+	sb->slots = slots;
+	sb->list = list;
+	for(uint32_t k = 0; k < sb->nlist; k++)
+		*sb_find(sb, list[k]) = *sb_find(&old, list[k]);
+	free(old.slots);
+	return true;
+}
+
+//false if the table couldn't grow (the store isn't buffered)
+static bool sb_put(StoreBuf *sb, uint32_t addr, uint8_t val)
+{
+	SbSlot *slot = sb_find(sb, addr);
+	if(!slot->used){
+		if((sb->nlist + 1) * 2 > sb->cap){
+			if(!sb_grow(sb))
+				return false;
+			slot = sb_find(sb, addr);
+		}
+		slot->used = true;
+		slot->addr = addr;
+		sb->list[sb->nlist++] = addr;
+	}
+	slot->val = val;
+	return true;
+}
+
+//LD/ST cycles for a core: its own cached_local decides hit or miss
+static inline int mc_access(CPU *cpu, uint32_t addr, int hit, int miss)
+{
+	MemPage *mine = mem_page(&cpu->mem, addr);
+	uint32_t off = addr & PAGE_MASK;
+
+	cpu->num_ldst += 1;
+	if(mine->cached[off]){
+		cpu->local_hits += 1;
+		return hit;
+	}
+	mine->cached[off] = true;
+	return miss;
+}
+
+//a core always sees its own stores, everyone else's only after the barrier
+#define ISA_EXEC_LD(op, arg, cost) \
+	case op:{ \
+		uint32_t addr = ((uint32_t)cpu->R[ins->rm] & mask); \
+		cycles += mc_access(cpu, addr, lat->cost##_hit, lat->cost##_miss); \
+		SbSlot *slot = sb_find(sb, addr); \
+		const MemPage *shared = mem_peek(shmem, addr); \
+		if(slot->used) \
+			cpu->R[ins->rn] = slot->val; \
+		else \
+			cpu->R[ins->rn] = shared ? shared->data[addr & PAGE_MASK] : 0; \
+		pc += 1; \
+		}break;
+
+#define ISA_EXEC_ST(op, arg, cost) \
+	case op:{ \
+		uint32_t addr = ((uint32_t)cpu->R[ins->rm] & mask); \
+		cycles += mc_access(cpu, addr, lat->cost##_hit, lat->cost##_miss); \
+		if(!sb_put(sb, addr, (uint8_t)(cpu->R[ins->rn] & 0xFF))){ \
+			sb->failed = true; /* stop before this store, the merge ends the run */ \
+			budget = 0; \
+			break; \
+		} \
+		pc += 1; \
+		}break;
+
+//--coverage doesn't run with --cores
+#define ISA_COV_BRANCH(taken) do{}while(0)
+
+//same instruction semantics and cycle costs (cpu->lat) as execute_program in myiss.c,
+//only LD/ST go through the shared memory + store buffer
+//runs until the core halts or `quantum` instructions were executed
+static void run_quantum(McSystem *sys, int id)
+{
+	CPU *cpu = &sys->cpus[id];
+	const Instr *prog = sys->progs[id].prog;
+	size_t n = sys->progs[id].n;
+	StoreBuf *sb = &sys->bufs[id];
+	const SimMem *shmem = &sys->shmem;
+	const int bits = cpu->mem.addr_bits;
+	const uint32_t mask = reg_mask(bits);
+	const LatencyModel *lat = cpu->lat;
+	int budget = sys->quantum;
+	int pc = cpu->pc;
+	int cycles = cpu->num_cycles;
+
+	while(budget > 0 && pc >= 0 && (size_t)pc < n){
+		const Instr *ins = &prog[pc];
+		cpu->num_instr++;
+		budget--;
+
+		switch(ins->op){
+#define X(op, mnemonic, form, kind, arg, cost) ISA_EXEC_##kind(op, arg, cost)
+			ISA_OPS(X)
+#undef X
+
+			default:
+				pc = (int)n; //treat anything unknown as halt, same as execute_program
+				break;
+		}
+	}
+
+	cpu->pc = pc;
+	cpu->num_cycles = cycles;
+}
+
+//runs on exactly one thread between the two barriers: publish every core's
+//stores in core order and invalidate the other cores' copies
+static void merge_quantum(McSystem *sys)
+{
+	bool done = true;
+
+	for(int c = 0; c < sys->ncores; c++){
+		StoreBuf *sb = &sys->bufs[c];
+		if(sb->failed)
+			sys->failed = true;
+
+		for(uint32_t k = 0; k < sb->nlist; k++){
+			uint32_t addr = sb->list[k];
+			uint32_t off = addr & PAGE_MASK;
+			SbSlot *slot = sb_find(sb, addr);
+
+			mem_page(&sys->shmem, addr)->data[off] = slot->val;
+
+			for(int d = 0; d < sys->ncores; d++){
+				MemPage *theirs = sys->cpus[d].mem.pages[addr >> PAGE_BITS];
+				if(d != c && theirs && theirs->cached[off]){
+					theirs->cached[off] = false;
+					sys->cpus[c].num_cycles += sys->cpus[c].lat->inval;
+					sys->stats->invalidations++;
+				}
+			}
+		}
+
+		//empty the table: an entry's probe chain only runs through entries inserted
+		//before it, so clearing newest-first never loses one
+		for(uint32_t k = sb->nlist; k-- > 0; )
+			sb_find(sb, sb->list[k])->used = false;
+		sb->nlist = 0;
+
+		const CPU *cpu = &sys->cpus[c];
+		if(cpu->pc >= 0 && (size_t)cpu->pc < sys->progs[c].n)
+			done = false;
+	}
+
+	sys->stats->quanta++;
+	sys->done = done || sys->failed;
+}
+
+static void *mc_worker(void *arg)
+{
+	McWorker *w = (McWorker*)arg;
+	McSystem *sys = w->sys;
+
+	pthread_mutex_lock(&sys->gate_lock);
+	while(sys->gate == 0)
+		pthread_cond_wait(&sys->gate_cond, &sys->gate_lock);
+	int gate = sys->gate;
+	pthread_mutex_unlock(&sys->gate_lock);
+
+	if(gate < 0)
+		return NULL;
+
+	for(;;){
+		run_quantum(sys, w->id);
+
+		if(pthread_barrier_wait(&sys->barrier) == PTHREAD_BARRIER_SERIAL_THREAD)
+			merge_quantum(sys);
+		pthread_barrier_wait(&sys->barrier);
+
+		if(sys->done)
+			break;
+	}
+
+	return NULL;
+}
+
+int mc_run(CPU *cpus, const McProgram *progs, int ncores, int quantum, McStats *stats)
+{
+	if(ncores < 1 || ncores > MC_MAX_CORES || quantum < 1)
+		return -1;
+
+	McSystem *sys = (McSystem*)calloc(1, sizeof(*sys));
+	McWorker *workers = (McWorker*)calloc((size_t)ncores, sizeof(*workers));
+	pthread_t *threads = (pthread_t*)calloc((size_t)ncores, sizeof(*threads));
+	StoreBuf *bufs = (StoreBuf*)calloc((size_t)ncores, sizeof(*bufs));
+
+	bool ok = sys && workers && threads && bufs && mem_init(&sys->shmem, cpus[0].mem.addr_bits);
+	for(int i = 0; ok && i < ncores; i++)
+		ok = sb_init(&bufs[i]);
+
+	if(!ok){
+		for(int i = 0; bufs && i < ncores; i++)
+			sb_free(&bufs[i]);
+		if(sys)
+			mem_free(&sys->shmem);
+		free(bufs);
+		free(sys);
+		free(workers);
+		free(threads);
+		return -1;
+	}
+
+	memset(stats, 0, sizeof(*stats));
+	sys->cpus = cpus;
+	sys->progs = progs;
+	sys->ncores = ncores;
+	sys->quantum = quantum;
+	sys->stats = stats;
+	sys->bufs = bufs;
+
+	//core 0's memory contents are the initial shared image
+	for(size_t i = 0; i < cpus[0].mem.ntouched; i++){
+		uint32_t idx = cpus[0].mem.touched[i];
+		memcpy(mem_page(&sys->shmem, idx << PAGE_BITS)->data, cpus[0].mem.pages[idx]->data, PAGE_SIZE);
+	}
+
+	pthread_barrier_init(&sys->barrier, NULL, (unsigned)ncores);
+	pthread_mutex_init(&sys->gate_lock, NULL);
+	pthread_cond_init(&sys->gate_cond, NULL);
+
+	//one host thread per simulated core, the calling thread is core 0
+	int started = 1;
+	for(int i = 0; i < ncores; i++){
+		workers[i].sys = sys;
+		workers[i].id = i;
+	}
+	for(int i = 1; i < ncores; i++){
+		if(pthread_create(&threads[i], NULL, mc_worker, &workers[i]) != 0)
+			break;
+		started++;
+	}
+
+	int ret = started == ncores ? 0 : -1;
+
+	pthread_mutex_lock(&sys->gate_lock);
+	sys->gate = ret == 0 ? 1 : -1;
+	pthread_cond_broadcast(&sys->gate_cond);
+	pthread_mutex_unlock(&sys->gate_lock);
+
+	if(ret == 0)
+		mc_worker(&workers[0]);
+
+	for(int i = 1; i < started; i++)
+		pthread_join(threads[i], NULL);
+	if(ret == 0 && sys->failed)
+		ret = -2;
+
+	//every core ends up with the final shared image in its own mem
+	if(ret == 0){
+		for(size_t i = 0; i < sys->shmem.ntouched; i++){
+			uint32_t idx = sys->shmem.touched[i];
+			for(int c = 0; c < ncores; c++)
+				memcpy(mem_page(&cpus[c].mem, idx << PAGE_BITS)->data, sys->shmem.pages[idx]->data, PAGE_SIZE);
+		}
+	}
+
+	pthread_barrier_destroy(&sys->barrier);
+	pthread_mutex_destroy(&sys->gate_lock);
+	pthread_cond_destroy(&sys->gate_cond);
+	for(int i = 0; i < ncores; i++)
+		sb_free(&bufs[i]);
+	mem_free(&sys->shmem);
+	free(bufs);
+	free(sys);
+	free(workers);
+	free(threads);
+	return ret;
+}
@@ -0,0 +1,32 @@
+#ifndef ISSMC_H
+#define ISSMC_H
+
+#include <stddef.h>
+
+#include "myiss.h"
+
+#define MC_MAX_CORES 64
+#define MC_DEFAULT_QUANTUM 10000
+
+//program of one simulated core (already resolved)
+typedef struct{
+	const Instr *prog;
+	size_t n;
+}McProgram;
+
+//run-wide counters that don't belong to a single core
+typedef struct{
+	long long invalidations; //remote cached_local entries cleared by stores
+	long long quanta; //barrier rounds until every core halted
+}McStats;
+
+//runs ncores cores, core i executes progs[i] and starts from cpus[i]
+//memory is shared: a store becomes visible to the other cores at the end of the
+//quantum it was made in, merged in core order, so the result doesn't depend on
+//thread scheduling. cached_local stays per core and a store clears the other
+//cores' entry for that address (charged to the storing core, lat->inval cycles each).
+//returns 0, -1 if the worker threads could not be started, or -2 if a core's
+//store buffer ran out of memory (every core stops at the end of that quantum)
+int mc_run(CPU *cpus, const McProgram *progs, int ncores, int quantum, McStats *stats);
+
+#endif
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "issmem.h"
+
+bool mem_init(SimMem *m, int addr_bits)
+{
+	memset(m, 0, sizeof(*m));
+	if(addr_bits != 8 && addr_bits != 16 && addr_bits != 32)
+		return false;
+
+	m->addr_bits = addr_bits;
+	m->mask = addr_bits == 32 ? 0xFFFFFFFFu : ((1u << addr_bits) - 1);
+
+	size_t npages = ((size_t)m->mask >> PAGE_BITS) + 1;
+	m->pages = (MemPage**)calloc(npages, sizeof(*m->pages));
+	if(!m->pages)
+		return false;
+
+	//8-bit mode fits in page 0, allocate it up front so the default
+	//configuration never takes the slow path
+	if(addr_bits == 8)
+		mem_alloc_page(m, 0);
+
+	return true;
+}
+
+void mem_free(SimMem *m)
+{
+	if(m->pages){
+		for(size_t i = 0; i < m->ntouched; i++)
+			free(m->pages[m->touched[i]]);
+	}
+	free(m->pages);
+	free(m->touched);
+	memset(m, 0, sizeof(*m));
+}
+
+void mem_reset(SimMem *m)
+{
+	for(size_t i = 0; i < m->ntouched; i++){
+		free(m->pages[m->touched[i]]);
+		m->pages[m->touched[i]] = NULL;
+	}
+	m->ntouched = 0;
+
+	if(m->addr_bits == 8)
+		mem_alloc_page(m, 0);
+}
+
+MemPage *mem_alloc_page(SimMem *m, uint32_t addr)
+{
+	uint32_t idx = addr >> PAGE_BITS;
+
+	if(m->ntouched == m->touched_size){
+		size_t size = m->touched_size ? m->touched_size * 2 : 16;
+		uint32_t *tmp = (uint32_t*)realloc(m->touched, size * sizeof(*tmp));
+		if(!tmp){
+			fprintf(stderr, "Error: out of memory for simulated memory pages\n");
+			exit(1);
+		}
+		m->touched = tmp;
+		m->touched_size = size;
+	}
+
+	MemPage *p = (MemPage*)calloc(1, sizeof(*p));
+	if(!p){
+		fprintf(stderr, "Error: out of memory for simulated memory pages\n");
+		exit(1);
+	}
+
+	m->pages[idx] = p;
+	m->touched[m->ntouched++] = idx;
+	return p;
+}
+
+bool watch_init(WatchMap *w, int addr_bits)
+{
+	memset(w, 0, sizeof(*w));
+	w->mask = addr_bits == 32 ? 0xFFFFFFFFu : ((1u << addr_bits) - 1);
+
+	size_t npages = ((size_t)w->mask >> PAGE_BITS) + 1;
+	w->pages = (uint64_t**)calloc(npages, sizeof(*w->pages));
+	return w->pages != NULL;
+}
+
+void watch_free(WatchMap *w)
+{
+	if(w->pages){
+		size_t npages = ((size_t)w->mask >> PAGE_BITS) + 1;
+		for(size_t i = 0; i < npages; i++){
+			if(w->pages[i])
+				free(w->pages[i]);
+		}
+	}
+	free(w->pages);
+	memset(w, 0, sizeof(*w));
+}
+
+bool watch_set(WatchMap *w, uint32_t addr, bool on)
+{
+	addr &= w->mask;
+	uint64_t **slot = &w->pages[addr >> PAGE_BITS];
+
+	if(*slot == NULL){
+		if(!on)
+			return true;
+		*slot = (uint64_t*)calloc(PAGE_SIZE / 64, sizeof(uint64_t));
+		if(*slot == NULL)
+			return false;
+	}
+
+	uint32_t off = addr & PAGE_MASK;
+	uint64_t bit = 1ULL << (off & 63);
+	bool was = ((*slot)[off >> 6] & bit) != 0;
+
+	if(on && !was){
+		(*slot)[off >> 6] |= bit;
+		w->count++;
+	}else if(!on && was){
+		(*slot)[off >> 6] &= ~bit;
+		w->count--;
+	}
+	return true;
+}
@@ -0,0 +1,77 @@
+#ifndef ISSMEM_H
+#define ISSMEM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+//simulated memory is split into pages that are only allocated when touched,
+//so a 32-bit address space costs the pointer table + the pages actually used.
+//the pointer table itself comes from calloc, which for big sizes is mmap'd
+//zero pages, so untouched parts of it don't take real memory either
+#define PAGE_BITS 12
+#define PAGE_SIZE (1u << PAGE_BITS)
+#define PAGE_MASK (PAGE_SIZE - 1)
+
+//one page of memory + the matching cached_local flags
+typedef struct{
+	uint8_t data[PAGE_SIZE];
+	bool cached[PAGE_SIZE];
+}MemPage;
+
+typedef struct{
+	MemPage **pages; //one-level table indexed by addr >> PAGE_BITS
+	uint32_t mask; //addresses are masked with this, (1 << addr_bits) - 1
+	int addr_bits;
+
+	uint32_t *touched; //indices of allocated pages, in allocation order
+	size_t ntouched;
+	size_t touched_size;
+}SimMem;
+
+//8/16/32 address bits, returns false if the table can't be allocated
+bool mem_init(SimMem *m, int addr_bits);
+void mem_free(SimMem *m);
+//back to all zero, only frees the touched pages (the table stays), so it's
+//much cheaper than mem_free + mem_init for a big address space
+void mem_reset(SimMem *m);
+
+//slow path of mem_page, allocates (zeroed) page for addr
+//exits with an error message if the host is out of memory
+MemPage *mem_alloc_page(SimMem *m, uint32_t addr);
+
+//page holding addr, allocating it on first touch
+static inline MemPage *mem_page(SimMem *m, uint32_t addr)
+{
+	MemPage *p = m->pages[addr >> PAGE_BITS];
+	if(__builtin_expect(p == NULL, 0))
+		p = mem_alloc_page(m, addr);
+	return p;
+}
+
+//page holding addr or NULL, never allocates
+static inline const MemPage *mem_peek(const SimMem *m, uint32_t addr)
+{
+	return m->pages[addr >> PAGE_BITS];
+}
+
+//one bit per address, paged the same way, for debugger watchpoints
+//an address space with no watchpoints is just the (zeroed) pointer table
+typedef struct{
+	uint64_t **pages; //PAGE_SIZE bits each, NULL if nothing on the page is watched
+	uint32_t mask;
+	size_t count; //watched addresses
+}WatchMap;
+
+bool watch_init(WatchMap *w, int addr_bits);
+void watch_free(WatchMap *w);
+bool watch_set(WatchMap *w, uint32_t addr, bool on); //false if out of memory
+
+static inline bool watch_test(const WatchMap *w, uint32_t addr)
+{
+	const uint64_t *p = w->pages[addr >> PAGE_BITS];
+	uint32_t off = addr & PAGE_MASK;
+	return p && ((p[off >> 6] >> (off & 63)) & 1);
+}
+
+#endif
@@ -0,0 +1,692 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <limits.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "issserve.h"
+#include "isscache.h"
+#include "issfold.h"
+
+#define SERVE_BUCKETS 1024
+#define SERVE_MAX_VALUES 256 //R<i>= / M<addr>= per RUN
+#define SERVE_LINE 4096 //longest request line
+#define SERVE_READ_TIMEOUT 10 //seconds a worker waits for the rest of a request it started
+
+//one decoded program, shared by every RUN of its hash
+//refs counts the requests using it, an evicted entry is freed when it drops to 0
+typedef struct ProgEntry{
+	CacheKey key;
+	Instr *prog;
+	size_t n;
+	FoldRegion *fold; //NULL unless the server folds
+	int refs;
+	bool evicted;
+	unsigned long long last_used;
+	struct ProgEntry *next; //bucket chain
+}ProgEntry;
+
+//a client connection, always in exactly one place: the dispatcher's idle set
+//(waiting for its next request), the ready queue, or with the worker serving it
+typedef struct Conn{
+	int fd;
+	FILE *out;
+	char buf[SERVE_LINE]; //read ahead, buf[head, tail) not used yet
+	size_t head;
+	size_t tail;
+	struct Conn *next; //ready queue / returned list
+}Conn;
+
+typedef struct{
+	ServeConfig cfg;
+
+	pthread_mutex_t lock; //guards the program table
+	ProgEntry *buckets[SERVE_BUCKETS];
+	size_t cached_instr;
+	unsigned long long clock; //bumped on every use, for LRU
+
+	pthread_mutex_t qlock; //guards the ready queue and the returned list
+	pthread_cond_t qcond;
+	Conn *qfirst; //connections with a request waiting, oldest first
+	Conn *qlast;
+	Conn *returned; //served and idle again, for the dispatcher to poll
+	int wake[2]; //a byte on wake[1] tells the dispatcher there are returned connections
+}Server;
+
+//the signal handler only needs the path, so it lives outside Server
+static char sock_file[sizeof(((struct sockaddr_un*)0)->sun_path)];
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	unlink(sock_file);
+	_exit(0);
+}
+
+static ProgEntry **bucket(Server *srv, const CacheKey *key)
+{
+	return &srv->buckets[key->h1 % SERVE_BUCKETS];
+}
+
+static void entry_free(ProgEntry *e)
+{
+	free(e->fold);
+	free(e->prog);
+	free(e);
+}
+
+//takes a reference, NULL if the hash isn't cached
+static ProgEntry *prog_get(Server *srv, const CacheKey *key)
+{
+	pthread_mutex_lock(&srv->lock);
+	ProgEntry *e = *bucket(srv, key);
+	while(e && (e->key.h1 != key->h1 || e->key.h2 != key->h2))
+		e = e->next;
+	if(e){
+		e->refs++;
+		e->last_used = ++srv->clock;
+	}
+	pthread_mutex_unlock(&srv->lock);
+	return e;
+}
+
+static void prog_put(Server *srv, ProgEntry *e)
+{
+	pthread_mutex_lock(&srv->lock);
+	bool dead = --e->refs == 0 && e->evicted;
+	pthread_mutex_unlock(&srv->lock);
+	if(dead)
+		entry_free(e);
+}
+
+//drops least recently used entries until the new one fits, called with lock held
+//entries in use are unlinked right away and freed by the last prog_put
+static void evict(Server *srv, size_t want)
+{
+	while(srv->cached_instr + want > SERVE_CACHE_MAX_INSTR){
+		ProgEntry **victim = NULL;
+		for(int b = 0; b < SERVE_BUCKETS; b++){
+			for(ProgEntry **pe = &srv->buckets[b]; *pe; pe = &(*pe)->next){
+				if(!victim || (*pe)->last_used < (*victim)->last_used)
+					victim = pe;
+			}
+		}
+		if(!victim)
+			return; //empty, a single big program is allowed to go over
+
+		ProgEntry *e = *victim;
+		*victim = e->next;
+		srv->cached_instr -= e->n;
+		e->evicted = true;
+		if(e->refs == 0)
+			entry_free(e);
+	}
+}
+
+//decodes text unless the same text is already cached, returns a reference
+static ProgEntry *prog_load(Server *srv, const char *text, size_t len, CacheKey *key)
+{
+	cache_key_init(key);
+	cache_key_update(key, text, len);
+
+	ProgEntry *e = prog_get(srv, key);
+	if(e)
+		return e;
+
+	//parsing happens outside the lock, two clients loading the same new
+	//program at once both parse it and the second one just uses the first
+	size_t n = 0, lines = 0;
+	Instr *prog = parse_program(text, len, &n, &lines);
+	if(prog == NULL)
+		return NULL;
+	resolve_targets(prog, n);
+
+	e = (ProgEntry*)calloc(1, sizeof(*e));
+	if(!e){
+		free(prog);
+		return NULL;
+	}
+	e->key = *key;
+	e->prog = prog;
+	e->n = n;
+
+	size_t regions, folded;
+	if(srv->cfg.fold && (e->fold = fold_program(prog, n, &regions, &folded)) == NULL){
+		entry_free(e);
+		return NULL;
+	}
+	e->refs = 1;
+
+	pthread_mutex_lock(&srv->lock);
+	ProgEntry *have = *bucket(srv, key);
+	while(have && (have->key.h1 != key->h1 || have->key.h2 != key->h2))
+		have = have->next;
+
+	if(have){
+		have->refs++;
+		have->last_used = ++srv->clock;
+		pthread_mutex_unlock(&srv->lock);
+		entry_free(e);
+		return have;
+	}
+
+	evict(srv, n);
+	e->last_used = ++srv->clock;
+	e->next = *bucket(srv, key);
+	*bucket(srv, key) = e;
+	srv->cached_instr += n;
+	pthread_mutex_unlock(&srv->lock);
+	return e;
+}
+
+static bool parse_key(const char *hex, CacheKey *key)
+{
+	unsigned long long h1, h2;
+	int used = 0;
+	if(strlen(hex) != 32 || sscanf(hex, "%16llx%16llx%n", &h1, &h2, &used) != 2 || used != 32)
+		return false;
+	key->h1 = h1;
+	key->h2 = h2;
+	return true;
+}
+
+static bool conn_read(Conn *c, char *dst, size_t len);
+
+static void do_load(Server *srv, Conn *c, FILE *out, char *args)
+{
+	char *end = NULL;
+	long long len = strtoll(args, &end, 10);
+	if(end == args || len < 0 || len > SERVE_MAX_PROGRAM){
+		fprintf(out, "ERR LOAD needs a size up to %d bytes\n", SERVE_MAX_PROGRAM);
+		return;
+	}
+
+	char *text = (char*)malloc((size_t)len + 1);
+	if(!text){
+		fprintf(out, "ERR out of memory\n");
+		return;
+	}
+	if(!conn_read(c, text, (size_t)len)){
+		free(text);
+		return; //client went away mid-program, nothing to answer
+	}
+
+	CacheKey key;
+	ProgEntry *e = prog_load(srv, text, (size_t)len, &key);
+	free(text);
+	if(!e){
+		fprintf(out, "ERR bad program\n");
+		return;
+	}
+	prog_put(srv, e);
+
+	fprintf(out, "OK %016llx%016llx\n", (unsigned long long)key.h1, (unsigned long long)key.h2);
+}
+
+static void do_run(Server *srv, FILE *out, char *args)
+{
+	const char *delimiters = " \t\r\n";
+	char *save = NULL;
+	char *hex = strtok_r(args, delimiters, &save);
+
+	CacheKey key;
+	if(!hex || !parse_key(hex, &key)){
+		fprintf(out, "ERR RUN needs a program hash\n");
+		return;
+	}
+
+	//options first, the cpu can only be set up once addr-bits is known
+	int addr_bits = srv->cfg.addr_bits;
+	const LatencyModel *lat = srv->cfg.lat;
+	int max_instr = srv->cfg.max_instr;
+	char *opts[SERVE_MAX_VALUES];
+	int nopts = 0;
+	char *tok;
+
+	while((tok = strtok_r(NULL, delimiters, &save)) != NULL){
+		if(strncmp(tok, "addr-bits=", 10) == 0){
+			addr_bits = atoi(tok + 10);
+			if(addr_bits != 8 && addr_bits != 16 && addr_bits != 32){
+				fprintf(out, "ERR addr-bits must be 8, 16 or 32\n");
+				return;
+			}
+		}else if(strncmp(tok, "max-instr=", 10) == 0){
+			char *end = NULL;
+			long long v = strtoll(tok + 10, &end, 10);
+			if(end == tok + 10 || *end != '\0' || v < 1 || v > INT_MAX){
+				fprintf(out, "ERR max-instr must be between 1 and %d\n", INT_MAX);
+				return;
+			}
+			max_instr = (int)v;
+		}else if(strncmp(tok, "latency=", 8) == 0){
+			lat = lat_find(tok + 8);
+			if(!lat){
+				fprintf(out, "ERR unknown latency preset %s\n", tok + 8);
+				return;
+			}
+		}else if((tok[0] == 'R' || tok[0] == 'M') && strchr(tok, '=')){
+			if(nopts == SERVE_MAX_VALUES){
+				fprintf(out, "ERR too many initial values\n");
+				return;
+			}
+			opts[nopts++] = tok;
+		}else{
+			fprintf(out, "ERR unknown option %s\n", tok);
+			return;
+		}
+	}
+
+	ProgEntry *e = prog_get(srv, &key);
+	if(!e){
+		fprintf(out, "ERR unknown program\n");
+		return;
+	}
+
+	CPU cpu;
+	if(!cpu_init(&cpu, addr_bits)){
+		prog_put(srv, e);
+		fprintf(out, "ERR out of memory\n");
+		return;
+	}
+	cpu.lat = lat;
+
+	bool ok = true;
+	for(int i = 0; i < nopts && ok; i++){
+		char *eq = strchr(opts[i], '=');
+		char *end = NULL;
+		unsigned long where = strtoul(opts[i] + 1, &end, 10);
+		long v = strtol(eq + 1, NULL, 0);
+		ok = end == eq;
+
+		if(ok && opts[i][0] == 'R'){
+			ok = where >= 1 && where <= NUMREGS;
+			if(ok)
+				cpu.R[where - 1] = wrap_reg((uint32_t)v, addr_bits);
+		}else if(ok){
+			uint32_t addr = (uint32_t)where & cpu.mem.mask;
+			mem_page(&cpu.mem, addr)->data[addr & PAGE_MASK] = (uint8_t)v;
+		}
+	}
+
+	if(!ok){
+		fprintf(out, "ERR bad initial value\n");
+	}else{
+		cpu.fold = e->fold;
+		cpu.max_instr = max_instr;
+		if(max_instr > 0)
+			execute_limited(&cpu, e->prog, e->n);
+		else
+			execute_program(&cpu, e->prog, e->n);
+		if(cpu.limit_hit)
+			fprintf(out, "ERR instruction limit\n");
+		else
+			fprintf(out, "OK instr=%d cycles=%d hits=%d ldst=%d\n",
+				cpu.num_instr, cpu.num_cycles, cpu.local_hits, cpu.num_ldst);
+	}
+
+	cpu_free(&cpu);
+	prog_put(srv, e);
+}
+
+//reads more into c->buf, what's there is moved to the front first
+//returns false on EOF, an error or SERVE_READ_TIMEOUT without data
+static bool conn_fill(Conn *c)
+{
+	if(c->head > 0){
+		memmove(c->buf, c->buf + c->head, c->tail - c->head);
+		c->tail -= c->head;
+		c->head = 0;
+	}
+
+	ssize_t got;
+	do{
+		got = read(c->fd, c->buf + c->tail, sizeof(c->buf) - c->tail);
+	}while(got < 0 && errno == EINTR);
+	if(got <= 0)
+		return false;
+	c->tail += (size_t)got;
+	return true;
+}
+
+//one line with its '\n' into line (SERVE_LINE bytes), 0 if the connection is
+//done, -1 if the line doesn't fit
+static int conn_getline(Conn *c, char *line)
+{
+	for(;;){
+		char *nl = memchr(c->buf + c->head, '\n', c->tail - c->head);
+		if(nl){
+			size_t len = (size_t)(nl - (c->buf + c->head)) + 1;
+			memcpy(line, c->buf + c->head, len);
+			line[len] = '\0';
+			c->head += len;
+			return 1;
+		}
+		if(c->tail - c->head >= sizeof(c->buf) - 1)
+			return -1;
+		if(!conn_fill(c))
+			return 0;
+	}
+}
+
+//exactly len bytes, what's buffered first
+static bool conn_read(Conn *c, char *dst, size_t len)
+{
+	size_t have = c->tail - c->head;
+	if(have > len)
+		have = len;
+	memcpy(dst, c->buf + c->head, have);
+	c->head += have;
+
+	for(size_t done = have; done < len; ){
+		ssize_t got = read(c->fd, dst + done, len - done);
+		if(got < 0 && errno == EINTR)
+			continue;
+		if(got <= 0)
+			return false;
+		done += (size_t)got;
+	}
+	return true;
+}
+
+static Conn *conn_open(int fd)
+{
+	//a worker only waits so long for a client that stopped halfway through a request
+	struct timeval tv = {SERVE_READ_TIMEOUT, 0};
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	Conn *c = (Conn*)calloc(1, sizeof(*c));
+	int fd2 = dup(fd);
+	FILE *out = fd2 >= 0 ? fdopen(fd2, "w") : NULL;
+	if(!c || !out){
+		if(out)
+			fclose(out);
+		else if(fd2 >= 0)
+			close(fd2);
+		free(c);
+		close(fd);
+		return NULL;
+	}
+	c->fd = fd;
+	c->out = out;
+	return c;
+}
+
+static void conn_close(Conn *c)
+{
+	fclose(c->out);
+	close(c->fd);
+	free(c);
+}
+
+//one request, false if the connection should be closed
+static bool serve_request(Server *srv, Conn *c)
+{
+	char line[SERVE_LINE];
+	FILE *out = c->out;
+
+	int got = conn_getline(c, line);
+	if(got == 0)
+		return false;
+	if(got < 0){
+		fprintf(out, "ERR request line too long\n");
+		fflush(out);
+		return false;
+	}
+
+	if(strncmp(line, "LOAD ", 5) == 0)
+		do_load(srv, c, out, line + 5);
+	else if(strncmp(line, "RUN ", 4) == 0)
+		do_run(srv, out, line + 4);
+	else
+		fprintf(out, "ERR unknown request\n");
+
+	return fflush(out) == 0;
+}
+
+static void queue_push(Server *srv, Conn *c)
+{
+	pthread_mutex_lock(&srv->qlock);
+	c->next = NULL;
+	if(srv->qlast)
+		srv->qlast->next = c;
+	else
+		srv->qfirst = c;
+	srv->qlast = c;
+	pthread_cond_signal(&srv->qcond);
+	pthread_mutex_unlock(&srv->qlock);
+}
+
+//a worker serves one request and lets go of the connection, so idle
+//keep-alive clients don't hold a thread while other clients wait
+static void *worker(void *arg)
+{
+	Server *srv = (Server*)arg;
+
+	for(;;){
+		pthread_mutex_lock(&srv->qlock);
+		while(srv->qfirst == NULL)
+			pthread_cond_wait(&srv->qcond, &srv->qlock);
+		Conn *c = srv->qfirst;
+		srv->qfirst = c->next;
+		if(srv->qfirst == NULL)
+			srv->qlast = NULL;
+		pthread_mutex_unlock(&srv->qlock);
+
+		if(!serve_request(srv, c)){
+			conn_close(c);
+		}else if(c->head < c->tail){
+			queue_push(srv, c); //the next request is already here, back of the line
+		}else{
+			pthread_mutex_lock(&srv->qlock);
+			c->next = srv->returned;
+			srv->returned = c;
+			pthread_mutex_unlock(&srv->qlock);
+			char b = 0;
+			if(write(srv->wake[1], &b, 1) < 0){
+				//pipe full: the dispatcher has wake-ups pending anyway
+			}
+		}
+	}
+	return NULL;
+}
+
+//connections waiting for their next request, pfd has 2 more slots in front
+//for the listening socket and the wake pipe
+typedef struct{
+	Conn **conns;
+	struct pollfd *pfd;
+	size_t n;
+	size_t cap;
+}IdleSet;
+
+static bool idle_add(IdleSet *set, Conn *c)
+{
+	if(set->n == set->cap){
+		size_t cap = set->cap ? set->cap * 2 : 64;
+		Conn **conns = (Conn**)realloc(set->conns, cap * sizeof(*conns));
+		if(conns)
+			set->conns = conns;
+		struct pollfd *pfd = (struct pollfd*)realloc(set->pfd, (cap + 2) * sizeof(*pfd));
+		if(pfd)
+			set->pfd = pfd;
+		if(!conns || !pfd)
+			return false;
+		set->cap = cap;
+	}
+	set->conns[set->n++] = c;
+	return true;
+}
+
+//the main thread: accepts connections and polls the idle ones, a connection
+//with data goes to the ready queue for the workers
+static void dispatch(Server *srv, int lfd)
+{
+	IdleSet idle;
+	memset(&idle, 0, sizeof(idle));
+	idle.pfd = (struct pollfd*)malloc(2 * sizeof(*idle.pfd));
+	if(!idle.pfd)
+		return;
+
+	for(;;){
+		struct pollfd *pfd = idle.pfd;
+		pfd[0].fd = lfd;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = srv->wake[0];
+		pfd[1].events = POLLIN;
+		for(size_t i = 0; i < idle.n; i++){
+			pfd[i + 2].fd = idle.conns[i]->fd;
+			pfd[i + 2].events = POLLIN;
+		}
+
+		if(poll(pfd, idle.n + 2, -1) < 0){
+			if(errno == EINTR)
+				continue;
+			perror("Error polling connections");
+			return;
+		}
+		bool accepting = pfd[0].revents != 0;
+		bool woken = pfd[1].revents != 0;
+
+		//readable (or hung up, the worker finds out) idle connections go to the workers
+		size_t keep = 0;
+		for(size_t i = 0; i < idle.n; i++){
+			if(pfd[i + 2].revents)
+				queue_push(srv, idle.conns[i]);
+			else
+				idle.conns[keep++] = idle.conns[i];
+		}
+		idle.n = keep;
+
+		if(woken){
+			char drain[256];
+			while(read(srv->wake[0], drain, sizeof(drain)) > 0)
+				;
+
+			pthread_mutex_lock(&srv->qlock);
+			Conn *c = srv->returned;
+			srv->returned = NULL;
+			pthread_mutex_unlock(&srv->qlock);
+
+			while(c){
+				Conn *next = c->next;
+				if(!idle_add(&idle, c))
+					conn_close(c);
+				c = next;
+			}
+		}
+
+		if(accepting){
+			int fd = accept(lfd, NULL, NULL);
+			if(fd < 0){
+				if(errno == EINTR || errno == ECONNABORTED || errno == EAGAIN)
+					continue;
+				if(errno == EMFILE || errno == ENFILE){
+					usleep(1000); //out of fds, wait for some clients to finish
+					continue;
+				}
+				perror("Error accepting connection");
+				return;
+			}
+
+			Conn *c = conn_open(fd);
+			if(c && !idle_add(&idle, c))
+				conn_close(c);
+		}
+	}
+}
+
+int serve(const char *sock_path, const ServeConfig *cfg)
+{
+	struct sockaddr_un sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	if(strlen(sock_path) >= sizeof(sa.sun_path)){
+		fprintf(stderr, "Error: socket path too long: %s\n", sock_path);
+		return 1;
+	}
+	strcpy(sa.sun_path, sock_path);
+
+	int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(lfd < 0){
+		perror("Error creating socket");
+		return 1;
+	}
+
+	//a socket file nobody answers on is left over from a server that died
+	if(connect(lfd, (struct sockaddr*)&sa, sizeof(sa)) == 0){
+		fprintf(stderr, "Error: a server is already listening on %s\n", sock_path);
+		close(lfd);
+		return 1;
+	}
+	struct stat st;
+	if(stat(sock_path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(sock_path);
+	close(lfd);
+
+	lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(lfd < 0 || bind(lfd, (struct sockaddr*)&sa, sizeof(sa)) != 0 || listen(lfd, 128) != 0){
+		perror("Error listening on socket");
+		if(lfd >= 0)
+			close(lfd);
+		return 1;
+	}
+
+	strcpy(sock_file, sock_path);
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	signal(SIGPIPE, SIG_IGN); //a client hanging up mid-reply is just a failed write
+
+	Server *srv = (Server*)calloc(1, sizeof(*srv));
+	if(!srv){
+		unlink(sock_path);
+		close(lfd);
+		return 1;
+	}
+	srv->cfg = *cfg;
+	pthread_mutex_init(&srv->lock, NULL);
+	pthread_mutex_init(&srv->qlock, NULL);
+	pthread_cond_init(&srv->qcond, NULL);
+
+	if(pipe(srv->wake) != 0){
+		perror("Error creating pipe");
+		unlink(sock_path);
+		close(lfd);
+		return 1;
+	}
+	fcntl(srv->wake[0], F_SETFL, O_NONBLOCK);
+	fcntl(srv->wake[1], F_SETFL, O_NONBLOCK);
+
+	int started = 0;
+	for(; started < cfg->threads; started++){
+		pthread_t t;
+		if(pthread_create(&t, NULL, worker, srv) != 0)
+			break;
+		pthread_detach(t);
+	}
+	if(started == 0){
+		fprintf(stderr, "Error: could not start any worker threads\n");
+		unlink(sock_path);
+		close(lfd);
+		return 1;
+	}
+
+	fprintf(stderr, "myISS: serving on %s with %d threads\n", sock_path, started);
+
+	dispatch(srv, lfd);
+
+	unlink(sock_path);
+	close(lfd);
+	return 1;
+}
@@ -0,0 +1,35 @@
+#ifndef ISSSERVE_H
+#define ISSSERVE_H
+
+#include "myiss.h"
+
+//--serve: a warm myISS on a unix domain socket for the test farm
+//text protocol, any number of requests per connection, one reply line each:
+//
+//  LOAD <bytes>\n<assembly text>
+//      -> OK <hash>            decoded program is cached under the hash of its text
+//  RUN <hash> [addr-bits=8|16|32] [latency=<preset>] [max-instr=<n>] [R<i>=<v>]... [M<addr>=<v>]...
+//      -> OK instr=<n> cycles=<n> hits=<n> ldst=<n>
+//      -> ERR instruction limit  if it ran max-instr (default --max-instr) instructions without halting
+//
+//anything that goes wrong is "ERR <message>", a RUN of a hash the server
+//doesn't have (never loaded, or evicted) answers "ERR unknown program" so the
+//client can LOAD it and retry. RUN starts from the normal zeroed cpu with
+//the given registers and memory bytes set.
+
+#define SERVE_MAX_PROGRAM (16 * 1024 * 1024) //biggest LOAD in bytes
+#define SERVE_CACHE_MAX_INSTR (256 * 1024) //decoded instructions kept before evicting
+#define SERVE_DEFAULT_MAX_INSTR (1000 * 1000 * 1000) //--max-instr, a few seconds of simulation
+
+typedef struct{
+	int threads; //worker threads, each serves one request at a time (idle connections are polled)
+	int addr_bits; //for RUNs that don't say
+	const LatencyModel *lat; //same, requests can only pick a preset
+	bool fold; //--engine fold: fold_program every program once at LOAD
+	int max_instr; //--max-instr: budget of RUNs that don't give one, 0 = none
+}ServeConfig;
+
+//listens on sock_path until SIGINT/SIGTERM, returns non-zero if it can't start
+int serve(const char *sock_path, const ServeConfig *cfg);
+
+#endif
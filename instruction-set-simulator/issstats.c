@@ -0,0 +1,188 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "issstats.h"
+
+static const char *phase_names[NUM_PHASES] = {"read", "parse", "resolve", "execute", "output"};
+static const char *hw_names[NUM_HW] = {"cycles", "instructions", "branch-misses", "L1D-misses"};
+
+double stats_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+//glibc has no wrapper for perf_event_open
+//reference: https://man7.org/linux/man-pages/man2/perf_event_open.2.html
+static int perf_open(uint32_t type, uint64_t config)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1; //user-only counting works with perf_event_paranoid <= 2
+	attr.exclude_hv = 1;
+	attr.inherit = 1; //so the --cores worker threads are counted too
+
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+//each counter is opened on its own instead of as a group, so a VM or a CPU
+//that lacks one of them (usually the L1D one) still reports the rest
+static void hw_open(HwCounters *hw)
+{
+	hw->err = 0;
+	hw->fd[HW_CYCLES] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+	hw->fd[HW_INSTRUCTIONS] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+	hw->fd[HW_BRANCH_MISSES] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+	hw->fd[HW_L1D_MISSES] = perf_open(PERF_TYPE_HW_CACHE,
+		PERF_COUNT_HW_CACHE_L1D
+		| (PERF_COUNT_HW_CACHE_OP_READ << 8)
+		| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+
+	for(int i = 0; i < NUM_HW; i++){
+		hw->val[i] = 0;
+		if(hw->fd[i] < 0 && hw->err == 0)
+			hw->err = errno;
+	}
+}
+
+void hw_enable(HwCounters *hw)
+{
+	for(int i = 0; i < NUM_HW; i++){
+		if(hw->fd[i] >= 0){
+			ioctl(hw->fd[i], PERF_EVENT_IOC_RESET, 0);
+			ioctl(hw->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+}
+
+void hw_disable(HwCounters *hw)
+{
+	for(int i = 0; i < NUM_HW; i++){
+		if(hw->fd[i] < 0)
+			continue;
+
+		ioctl(hw->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+
+		uint64_t v;
+		if(read(hw->fd[i], &v, sizeof(v)) == (ssize_t)sizeof(v)){
+			hw->val[i] = v;
+		}else{
+			close(hw->fd[i]);
+			hw->fd[i] = -1;
+		}
+	}
+}
+
+void hw_close(HwCounters *hw)
+{
+	for(int i = 0; i < NUM_HW; i++){
+		if(hw->fd[i] >= 0)
+			close(hw->fd[i]);
+		hw->fd[i] = -1;
+	}
+}
+
+void stats_start(IssStats *stats, bool with_hw)
+{
+	memset(stats, 0, sizeof(*stats));
+	for(int i = 0; i < NUM_HW; i++)
+		stats->hw.fd[i] = -1;
+
+	if(with_hw)
+		hw_open(&stats->hw);
+	stats->last = stats_now();
+}
+
+void stats_mark(IssStats *stats, Phase phase)
+{
+	double now = stats_now();
+	stats->sec[phase] += now - stats->last;
+	stats->last = now;
+}
+
+//rate helper so an empty phase prints 0 instead of inf
+static double per_sec(double count, double sec)
+{
+	return sec > 0.0 ? count / sec : 0.0;
+}
+
+//goes to stderr from main so the normal output stays diffable
+void stats_print(FILE *out, const IssStats *stats)
+{
+	double total = 0.0;
+	for(int i = 0; i < NUM_PHASES; i++)
+		total += stats->sec[i];
+
+	fprintf(out, "--- myISS stats ---\n");
+	fprintf(out, "%-8s %12s  %s\n", "phase", "time (us)", "throughput");
+
+	for(int i = 0; i < NUM_PHASES; i++){
+		double us = stats->sec[i] * 1e6;
+		fprintf(out, "%-8s %12.1f  ", phase_names[i], us);
+
+		switch((Phase)i){
+			case PHASE_READ:
+				fprintf(out, "%.1f MB/s (%zu bytes)\n", per_sec((double)stats->bytes, stats->sec[i]) / 1e6, stats->bytes);
+				break;
+			case PHASE_PARSE:
+				fprintf(out, "%.2f M lines/s (%zu lines)\n", per_sec((double)stats->lines, stats->sec[i]) / 1e6, stats->lines);
+				break;
+			case PHASE_RESOLVE:
+				fprintf(out, "%.2f M instr/s (%zu instr)\n", per_sec((double)stats->n, stats->sec[i]) / 1e6, stats->n);
+				break;
+			case PHASE_EXECUTE:
+				if(stats->cache_hit)
+					fprintf(out, "cache hit, not simulated\n");
+				else
+					fprintf(out, "%.2f simulated MIPS (%lld instr)\n", per_sec((double)stats->executed, stats->sec[i]) / 1e6, stats->executed);
+				break;
+			default:
+				fprintf(out, "-\n");
+				break;
+		}
+	}
+	fprintf(out, "%-8s %12.1f\n", "total", total * 1e6);
+	if(stats->fold_regions > 0)
+		fprintf(out, "folded %zu regions, %zu instr\n", stats->fold_regions, stats->folded);
+
+	if(stats->cache_hit)
+		return;
+
+	//hardware counters for the execute loop only
+	bool any = false;
+	for(int i = 0; i < NUM_HW; i++){
+		if(stats->hw.fd[i] < 0)
+			continue;
+		if(!any)
+			fprintf(out, "hw counters (execute):\n");
+		any = true;
+		fprintf(out, "  %-14s %llu\n", hw_names[i], (unsigned long long)stats->hw.val[i]);
+	}
+
+	if(!any){
+		fprintf(out, "hw counters: unavailable (perf_event_open: %s)\n", strerror(stats->hw.err));
+		return;
+	}
+
+	if(stats->hw.fd[HW_CYCLES] >= 0 && stats->hw.fd[HW_INSTRUCTIONS] >= 0 && stats->hw.val[HW_CYCLES] > 0)
+		fprintf(out, "  %-14s %.2f\n", "IPC", (double)stats->hw.val[HW_INSTRUCTIONS] / (double)stats->hw.val[HW_CYCLES]);
+	if(stats->hw.fd[HW_INSTRUCTIONS] >= 0 && stats->executed > 0)
+		fprintf(out, "  %-14s %.1f\n", "host/sim instr", (double)stats->hw.val[HW_INSTRUCTIONS] / (double)stats->executed);
+	if(stats->hw.fd[HW_CYCLES] >= 0 && stats->executed > 0)
+		fprintf(out, "  %-14s %.1f\n", "cycles/sim instr", (double)stats->hw.val[HW_CYCLES] / (double)stats->executed);
+}
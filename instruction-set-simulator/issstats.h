@@ -0,0 +1,64 @@
+#ifndef ISSSTATS_H
+#define ISSSTATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+//phases of one myISS run, in the order main goes through them
+typedef enum{
+	PHASE_READ,
+	PHASE_PARSE,
+	PHASE_RESOLVE,
+	PHASE_EXECUTE,
+	PHASE_OUTPUT,
+	NUM_PHASES
+}Phase;
+
+//hardware counters sampled around the execute loop
+typedef enum{
+	HW_CYCLES,
+	HW_INSTRUCTIONS,
+	HW_BRANCH_MISSES,
+	HW_L1D_MISSES,
+	NUM_HW
+}HwEvent;
+
+typedef struct{
+	int fd[NUM_HW]; //-1 if perf_event_open refused that counter
+	uint64_t val[NUM_HW];
+	int err; //errno of the first refused counter, for the report
+}HwCounters;
+
+//everything --stats prints
+typedef struct{
+	double last; //timestamp of the previous stats_mark
+	double sec[NUM_PHASES];
+
+	size_t bytes; //size of the assembly file
+	size_t lines; //raw lines read
+	size_t n; //decoded instructions
+	long long executed; //simulated instructions
+	size_t fold_regions; //--engine fold
+	size_t folded; //instructions inside those regions
+	bool cache_hit;
+
+	HwCounters hw;
+}IssStats;
+
+double stats_now(void); //monotonic seconds
+
+//starts the clock for PHASE_READ, with_hw also opens the (disabled) hw counters
+void stats_start(IssStats *stats, bool with_hw);
+
+//charges the time since the previous mark to phase
+void stats_mark(IssStats *stats, Phase phase);
+
+void hw_enable(HwCounters *hw);
+void hw_disable(HwCounters *hw); //also reads the counters
+void hw_close(HwCounters *hw);
+
+void stats_print(FILE *out, const IssStats *stats);
+
+#endif
@@ -0,0 +1,402 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+#include <unistd.h>
+
+#include "issstream.h"
+
+//target of a line that isn't in the program, jumping there halts like it
+//does after resolve_targets
+#define MISSING INT_MAX
+
+typedef struct{
+	Opcode orig; //real opcode of a branch waiting for its target line (op is TRAP meanwhile)
+	int next; //next branch waiting on the same line, -1 = none
+}StreamAux;
+
+//line number -> where it is, open addressing
+typedef struct{
+	bool used;
+	int line;
+	int idx; //first instruction with that line, -1 until it arrives, MISSING if it never will
+	int pend; //first branch waiting for it, -1 = none
+}LineSlot;
+
+typedef struct{
+	CPU *cpu;
+	IssStats *stats;
+	size_t window;
+
+	//decoded instructions, prog[len] is always a TRAP so the loop stops when
+	//pc gets to the part that hasn't arrived; a halt leaves pc at len + 1
+	Instr *prog;
+	StreamAux *aux;
+	size_t len;
+	size_t cap; //not counting the TRAP
+
+	LineSlot *slots;
+	size_t nslots; //power of 2
+	size_t nused;
+
+	bool any; //something arrived, last_line is the latest line number
+	int last_line;
+	bool dropped; //--window dropped something, last_dropped is its highest line
+	int last_dropped;
+
+	//bytes read but not decoded yet, with --window decoding stops when the
+	//window is full so it can't run further ahead of pc than that
+	char in[STREAM_CHUNK];
+	size_t in_pos;
+	size_t in_len;
+
+	//the line being cut, carried over between reads
+	char linebuf[MEM];
+	size_t k;
+	bool eof;
+	bool halted; //the rest is only checked, like the whole file is before a normal run
+}Stream;
+
+static LineSlot *slot_find(LineSlot *slots, size_t nslots, int line)
+{
+	size_t mask = nslots - 1;
+	size_t h = ((uint32_t)line * 2654435761u) & mask;
+	while(slots[h].used && slots[h].line != line)
+		h = (h + 1) & mask;
+	return &slots[h];
+}
+
+static bool slots_grow(Stream *s)
+{
+	size_t nslots = s->nslots * 2;
+	LineSlot *slots = (LineSlot*)calloc(nslots, sizeof(*slots));
+	if(!slots)
+		return false;
+
+	for(size_t i = 0; i < s->nslots; i++){
+		if(s->slots[i].used)
+			*slot_find(slots, nslots, s->slots[i].line) = s->slots[i];
+	}
+	free(s->slots);
+	s->slots = slots;
+	s->nslots = nslots;
+	return true;
+}
+
+//the slot for line, added if it isn't there yet, NULL if out of memory
+static LineSlot *slot_get(Stream *s, int line)
+{
+	if((s->nused + 1) * 2 > s->nslots && !slots_grow(s))
+		return NULL;
+
+	LineSlot *slot = slot_find(s->slots, s->nslots, line);
+	if(!slot->used){
+		slot->used = true;
+		slot->line = line;
+		slot->idx = -1;
+		slot->pend = -1;
+		s->nused++;
+	}
+	return slot;
+}
+
+//line is at idx (or MISSING), every branch waiting on it gets its opcode back
+static void stream_resolve(Stream *s, LineSlot *slot, int idx)
+{
+	for(int p = slot->pend; p >= 0; p = s->aux[p].next){
+		s->prog[p].op = s->aux[p].orig;
+		s->prog[p].addr = idx;
+	}
+	slot->pend = -1;
+	slot->idx = idx;
+}
+
+static bool stream_oom(void)
+{
+	fprintf(stderr, "Error: out of memory for the streamed program\n");
+	return false;
+}
+
+//--window: drops everything before the lowest pc that can still run, which
+//is the lowest of pc, the return addresses and the targets of the branches
+//from there on. Indices move down, so the line table is rebuilt
+static bool stream_compact(Stream *s)
+{
+	CPU *cpu = s->cpu;
+	int keep = cpu->pc;
+
+	for(int i = 0; i < cpu->sp; i++){
+		if(cpu->stack[i] < keep)
+			keep = cpu->stack[i];
+	}
+	//walking down, a branch below keep is dropped anyway unless keep moves under it
+	for(int i = (int)s->len - 1; i >= keep; i--){
+		const Instr *ins = &s->prog[i];
+		if(ins->op != TRAP && isa_info[ins->op].form == FORM_ADDR && ins->addr < keep)
+			keep = ins->addr;
+	}
+
+	if(keep <= 0){
+		fprintf(stderr, "Error: --window %zu is too small, the program needs more instructions at once\n", s->window);
+		return false;
+	}
+
+	size_t drop = (size_t)keep;
+	s->dropped = true;
+	s->last_dropped = s->prog[drop - 1].line_num;
+	memmove(s->prog, s->prog + drop, (s->len + 1 - drop) * sizeof(*s->prog));
+	memmove(s->aux, s->aux + drop, (s->len - drop) * sizeof(*s->aux));
+	s->len -= drop;
+
+	cpu->pc -= keep;
+	for(int i = 0; i < cpu->sp; i++)
+		cpu->stack[i] -= keep;
+
+	memset(s->slots, 0, s->nslots * sizeof(*s->slots));
+	s->nused = 0;
+	for(size_t i = 0; i < s->len; i++){
+		Instr *ins = &s->prog[i];
+		if(ins->op != TRAP && isa_info[ins->op].form == FORM_ADDR && ins->addr != MISSING)
+			ins->addr -= keep;
+
+		LineSlot *slot = slot_get(s, ins->line_num);
+		if(!slot)
+			return stream_oom();
+		if(slot->idx < 0)
+			slot->idx = (int)i;
+	}
+
+	//a waiting branch keeps its target line number in addr
+	for(size_t i = 0; i < s->len; i++){
+		if(s->prog[i].op != TRAP)
+			continue;
+
+		LineSlot *slot = slot_get(s, s->prog[i].addr);
+		if(!slot)
+			return stream_oom();
+		s->aux[i].next = slot->pend;
+		slot->pend = (int)i;
+	}
+	return true;
+}
+
+static bool stream_grow(Stream *s)
+{
+	size_t cap = s->cap * 2;
+	Instr *prog = (Instr*)realloc(s->prog, (cap + 1) * sizeof(*prog));
+	if(!prog)
+		return stream_oom();
+	s->prog = prog;
+
+	StreamAux *aux = (StreamAux*)realloc(s->aux, cap * sizeof(*aux));
+	if(!aux)
+		return stream_oom();
+	s->aux = aux;
+
+	s->cap = cap;
+	return true;
+}
+
+//adds one decoded instruction: its line resolves whatever was waiting for
+//it, and its own target is looked up now or it waits as a TRAP
+static bool stream_append(Stream *s, const Instr *ins)
+{
+	if(s->window){
+		if(s->any && ins->line_num <= s->last_line){
+			fprintf(stderr, "Error: --window needs increasing line numbers (line %d after %d)\n", ins->line_num, s->last_line);
+			return false;
+		}
+		if(s->len == s->window && !stream_compact(s))
+			return false;
+	}else if(s->len == s->cap && !stream_grow(s)){
+		return false;
+	}
+
+	size_t idx = s->len;
+	s->prog[idx] = *ins;
+	s->len++;
+	s->prog[s->len].op = TRAP;
+	s->any = true;
+	s->last_line = ins->line_num;
+
+	LineSlot *slot = slot_get(s, ins->line_num);
+	if(!slot)
+		return stream_oom();
+	if(slot->idx < 0)
+		stream_resolve(s, slot, (int)idx);
+
+	Instr *in = &s->prog[idx];
+	if(isa_info[in->op].form != FORM_ADDR)
+		return true;
+
+	int target = in->addr;
+	slot = slot_get(s, target);
+	if(!slot)
+		return stream_oom();
+
+	if(slot->idx >= 0){
+		in->addr = slot->idx;
+	}else if(s->window && target <= s->last_line){
+		//lines only go up, so it either left the window or was never there
+		if(s->dropped && target <= s->last_dropped){
+			fprintf(stderr, "Error: line %d jumps back to line %d, which already left the --window\n", in->line_num, target);
+			return false;
+		}
+		stream_resolve(s, slot, MISSING);
+		in->addr = MISSING;
+	}else{
+		s->aux[idx].orig = in->op;
+		s->aux[idx].next = slot->pend;
+		slot->pend = (int)idx;
+		in->op = TRAP;
+	}
+	return true;
+}
+
+//one line cut the way parse_program cuts them
+static bool stream_line(Stream *s)
+{
+	s->linebuf[s->k] = '\0';
+	s->k = 0;
+	s->stats->lines++;
+
+	if(s->linebuf[0] == '\n')
+		return true; //empty lines
+
+	Instr ins;
+	if(!parse_line(s->linebuf, &ins)){
+		fprintf(stderr, "Unknown instruction: %s\n", s->linebuf);
+		return false;
+	}
+	s->stats->n++;
+	return s->halted || stream_append(s, &ins);
+}
+
+//decodes the complete lines that are buffered, reading whatever the writer
+//has sent so far first if nothing is (waiting if it's nothing). At EOF the
+//last line and every target still missing are settled
+static bool stream_feed(Stream *s, int fd)
+{
+	if(s->in_pos == s->in_len){
+		ssize_t got;
+		do{
+			got = read(fd, s->in, sizeof(s->in));
+		}while(got < 0 && errno == EINTR);
+
+		if(got < 0){
+			perror("Error reading program");
+			return false;
+		}
+		s->stats->bytes += (size_t)got;
+		stats_mark(s->stats, PHASE_READ);
+
+		if(got == 0){
+			s->eof = true;
+			if(s->k > 0 && !stream_line(s))
+				return false;
+			for(size_t i = 0; i < s->nslots; i++){
+				if(s->slots[i].used && s->slots[i].pend >= 0)
+					stream_resolve(s, &s->slots[i], MISSING);
+			}
+			stats_mark(s->stats, PHASE_PARSE);
+			return true;
+		}
+
+		s->in_pos = 0;
+		s->in_len = (size_t)got;
+	}
+
+	while(s->in_pos < s->in_len){
+		char c = s->in[s->in_pos++];
+		s->linebuf[s->k++] = c;
+		if(c != '\n' && s->k < sizeof(s->linebuf) - 1)
+			continue;
+		if(!stream_line(s))
+			return false;
+		if(s->window && s->len == s->window && !s->halted)
+			break; //let pc catch up, the next feed drops what it's done with
+	}
+	stats_mark(s->stats, PHASE_PARSE);
+	return true;
+}
+
+int stream_run(CPU *cpu, int fd, size_t window, IssStats *stats)
+{
+	static Stream s; //the input buffer is too big for the stack
+	memset(&s, 0, sizeof(s));
+	s.cpu = cpu;
+	s.stats = stats;
+	s.window = window;
+	s.cap = window ? window : 1024;
+	s.nslots = 1024;
+	s.prog = (Instr*)malloc((s.cap + 1) * sizeof(*s.prog));
+	s.aux = (StreamAux*)malloc(s.cap * sizeof(*s.aux));
+	s.slots = (LineSlot*)calloc(s.nslots, sizeof(*s.slots));
+
+	int ret = 1;
+	if(!s.prog || !s.aux || !s.slots){
+		stream_oom();
+		goto out;
+	}
+	s.prog[0].op = TRAP;
+
+	//read, parse and execute take turns, so the counters cover all three here
+	hw_enable(&stats->hw);
+	for(;;){
+		execute_program(cpu, s.prog, s.len + 1);
+		stats_mark(stats, PHASE_EXECUTE);
+
+		//jumped out of the program or past the end of the stack
+		if(cpu->pc < 0 || (size_t)cpu->pc > s.len){
+			//a bad line further on still fails the run, and the writer
+			//doesn't get a broken pipe
+			s.halted = true;
+			while(!s.eof){
+				if(!stream_feed(&s, fd))
+					goto out;
+			}
+			break;
+		}
+
+		size_t pc = (size_t)cpu->pc;
+		if(pc == s.len){
+			if(s.eof)
+				break; //ran off the end
+			if(!stream_feed(&s, fd))
+				goto out;
+			continue;
+		}
+
+		//a branch whose target line hasn't arrived, one that falls through doesn't need it
+		Instr *ins = &s.prog[pc];
+		if(isa_cond(cpu, s.aux[pc].orig) == 0){
+			ins->op = s.aux[pc].orig;
+			execute_step(cpu, s.prog, s.len + 1);
+			ins->op = TRAP;
+			stats_mark(stats, PHASE_EXECUTE);
+		}else if(window && ins->addr < s.last_line){
+			//lines only go up, a later one already arrived so this one never will
+			LineSlot *slot = slot_get(&s, ins->addr);
+			if(!slot){
+				stream_oom();
+				goto out;
+			}
+			stream_resolve(&s, slot, MISSING);
+		}else if(!stream_feed(&s, fd)){
+			goto out;
+		}
+	}
+	stats->executed = cpu->num_instr;
+	ret = 0;
+
+out:
+	hw_disable(&stats->hw);
+	free(s.prog);
+	free(s.aux);
+	free(s.slots);
+	return ret;
+}
@@ -0,0 +1,24 @@
+#ifndef ISSSTREAM_H
+#define ISSSTREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "myiss.h"
+#include "issstats.h"
+
+//--stream: runs assembly from fd while it is still being written, so a tool
+//generating the program and the simulator overlap. Lines are decoded as
+//they arrive and executed as soon as pc gets to them, a jump whose target
+//line hasn't arrived yet waits for it (a JE/BNE/BLT that falls through
+//doesn't). The result is the same as running the whole file
+//
+//window 0 keeps every decoded instruction. Otherwise at most window are kept,
+//the ones nothing can reach any more are dropped, which needs increasing
+//line numbers and no jump further back than the window
+#define STREAM_CHUNK (64 * 1024) //bytes per read
+
+//returns 0 with the final state in cpu, 1 after printing an error
+int stream_run(CPU *cpu, int fd, size_t window, IssStats *stats);
+
+#endif
@@ -6,95 +6,599 @@
 #include <errno.h>
 
 #include <ctype.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "myiss.h"
+#include "isscache.h"
+#include "issstats.h"
+#include "issmc.h"
+#include "issdbg.h"
+#include "isscov.h"
+#include "issserve.h"
+#include "issfold.h"
+#include "issstream.h"
+#include "issdiff.h"
 
-//helper constants
-#define NUMREGS 6 
-#define MEM 256
-
-// enum for switch for 8 commands
-// typedef to directly refer to instructions
-// https://www.geeksforgeeks.org/c/enumeration-enum-c/ 
-typedef enum{
-	MOV,
-	ADD_REG,
-	ADD_NUM,
-	CMP,
-	JE,
-	JMP,
-	LD,
-	ST,
-	INVALID
-}Opcode;
-
-//struct to hold full instruction including opcode
-typedef struct{
-	Opcode op;
-	int rn, rm, num, addr;
+// headers for the helper functions
+static bool parse_operands(IsaForm form, const char *field1, const char *field2, Instr *ins); //operands of one decoded opcode
+static long long parse_size(const char *s); //function to parse byte counts like 64M for --cache-max
+static char *read_file(const char *path, size_t *len); //function to slurp the assembly file
+static Instr *load_program(const char *path, size_t *count, IssStats *stats); //read + parse + resolve
+static int run_multicore(char **paths, int npaths, int ncores, int quantum, int addr_bits, const LatencyModel *lat, IssStats *stats); //--cores mode
+static Instr *load_source(const char *path, size_t *count); //quiet load_program for the coverage report
+
+//execution engines selectable with --engine, the first one is the default
+static const Engine engines[] = {
+	{"switch", false, execute_program},
+	{"fold", true, execute_program},
+};
+#define NUM_ENGINES (sizeof(engines) / sizeof(engines[0]))
+
+static void print_usage(void)
+{
+	fprintf(stderr, "Usage: ./myISS [--stats] [--addr-bits 8|16|32] [--latency <preset>|<file>|list] [--engine <name>|list] [--cache <dir>] [--cache-max <bytes>] <assembly_file>\n");
+	fprintf(stderr, "       ./myISS --coverage <file> [--addr-bits 8|16|32] [--stats] <assembly_file>\n");
+	fprintf(stderr, "       ./myISS --coverage-report <file>\n");
+	fprintf(stderr, "       ./myISS --serve <socket> [--threads <N>] [--max-instr <N>] [--addr-bits 8|16|32] [--latency <preset>|<file>] [--engine <name>]\n");
+	fprintf(stderr, "       ./myISS --stream [--window <instr>] [--addr-bits 8|16|32] [--latency <preset>|<file>] [--stats] < assembly_file\n");
+	fprintf(stderr, "       ./myISS --diff <programs> [--threads <N>] [--seed <N>] [--diff-out <dir>]\n");
+	fprintf(stderr, "       ./myISS --debug | --debug-script <file> [--addr-bits 8|16|32] <assembly_file>\n");
+	fprintf(stderr, "       ./myISS --cores <N> [--quantum <instr>] [--addr-bits 8|16|32] [--stats] <assembly_file>...\n");
+}
 
-	int line_num;
+int main(int argc, char **argv){
+	char *paths[MC_MAX_CORES];
+	int npaths = 0;
+	int ncores = 0; //--cores: 0 = the normal single-core simulator
+	int quantum = MC_DEFAULT_QUANTUM;
+	int addr_bits = ADDR_BITS_DEFAULT; //--addr-bits: 8, 16 or 32 bit addresses/registers
+	const char *cache_dir = NULL; //--cache: on-disk result cache shared by batch runs
+	long long cache_max = CACHE_DEFAULT_MAX;
+	bool show_stats = false; //--stats: per-phase timing + hw counters on stderr
+	bool debug = false; //--debug: commands from stdin
+	const char *debug_script = NULL; //--debug-script: commands from a file
+	const char *cov_path = NULL; //--coverage: merge this run's coverage into a file
+	const char *serve_path = NULL; //--serve: unix socket to answer simulation requests on
+	bool stream = false; //--stream: run the program from stdin while it's still arriving
+	long long window = 0; //--window: decoded instructions --stream keeps, 0 = all
+	long long diff_count = 0; //--diff: random programs to run through every engine
+	unsigned long long seed = (unsigned long long)time(NULL); //--seed: first program --diff generates
+	const char *diff_out = "."; //--diff-out: where --diff writes the programs engines disagree on
+	int threads = (int)sysconf(_SC_NPROCESSORS_ONLN); //--threads: --serve / --diff worker pool
+	long long max_instr = SERVE_DEFAULT_MAX_INSTR; //--max-instr: --serve's budget for RUNs that don't give one, 0 = none
+	const Engine *engine = &engines[0];
+	const LatencyModel *lat = LAT_DEFAULT; //--latency: cycle costs
+	LatencyModel lat_file; //--latency with a config file instead of a preset name
+
+	for(int i = 1; i < argc; i++){
+		if(strcmp(argv[i], "--cache") == 0 && i + 1 < argc){
+			cache_dir = argv[++i];
+		}else if(strcmp(argv[i], "--cache-max") == 0 && i + 1 < argc){
+			cache_max = parse_size(argv[++i]);
+			if(cache_max < 0){
+				print_usage();
+				return 1;
+			}
+		}else if(strcmp(argv[i], "--stats") == 0){
+			show_stats = true;
+		}else if(strcmp(argv[i], "--coverage") == 0 && i + 1 < argc){
+			cov_path = argv[++i];
+		}else if(strcmp(argv[i], "--coverage-report") == 0 && i + 1 < argc){
+			//report only, doesn't run anything
+			const char *report = argv[++i];
+			if(!cov_report(stdout, report, load_source)){
+				fprintf(stderr, "Error: no coverage data in %s\n", report);
+				return 1;
+			}
+			return 0;
+		}else if(strcmp(argv[i], "--serve") == 0 && i + 1 < argc){
+			serve_path = argv[++i];
+		}else if(strcmp(argv[i], "--stream") == 0){
+			stream = true;
+		}else if(strcmp(argv[i], "--window") == 0 && i + 1 < argc){
+			window = parse_size(argv[++i]);
+			if(window < 1){
+				print_usage();
+				return 1;
+			}
+		}else if(strcmp(argv[i], "--diff") == 0 && i + 1 < argc){
+			diff_count = parse_size(argv[++i]);
+			if(diff_count < 1){
+				print_usage();
+				return 1;
+			}
+		}else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc){
+			seed = strtoull(argv[++i], NULL, 0);
+		}else if(strcmp(argv[i], "--diff-out") == 0 && i + 1 < argc){
+			diff_out = argv[++i];
+		}else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc){
+			threads = atoi(argv[++i]);
+			if(threads < 1){
+				print_usage();
+				return 1;
+			}
+		}else if(strcmp(argv[i], "--max-instr") == 0 && i + 1 < argc){
+			max_instr = parse_size(argv[++i]);
+			if(max_instr < 0 || max_instr > INT_MAX){
+				print_usage();
+				return 1;
+			}
+		}else if(strcmp(argv[i], "--debug") == 0){
+			debug = true;
+		}else if(strcmp(argv[i], "--debug-script") == 0 && i + 1 < argc){
+			debug = true;
+			debug_script = argv[++i];
+		}else if(strcmp(argv[i], "--engine") == 0 && i + 1 < argc){
+			const char *name = argv[++i];
+			engine = NULL;
+			for(size_t e = 0; e < NUM_ENGINES; e++){
+				if(strcmp(engines[e].name, name) == 0)
+					engine = &engines[e];
+			}
 
-	char full_line[MEM];
-}Instr;
-
-//struct to make up cpu which holds:
-//the 6 registers R1, R2, ... R6
-//byte-addressable 256-Byte local mem
-//total number of executed instructions
-//total cycle count
-//# hits to local mem
-//# executed LD/ST instructions
-//flag for whether an instr was cached locally
-//flag for JE comparison
-//program counter to index into the Instr array when made
-typedef struct{
-	int R[NUMREGS];
-	int mem[MEM];
-	int num_instr;
-	int num_cycles;
-	int local_hits;
-	int num_ldst;
-
-	bool cached_local[MEM];
-	bool last_je;
-	
-	int pc;
-}CPU;
+			//--engine list (or a typo) prints what this build has, bench.sh relies on it
+			if(engine == NULL){
+				for(size_t e = 0; e < NUM_ENGINES; e++)
+					printf("%s\n", engines[e].name);
+				return strcmp(name, "list") == 0 ? 0 : 1;
+			}
+		}else if(strcmp(argv[i], "--latency") == 0 && i + 1 < argc){
+			const char *name = argv[++i];
+			if(strcmp(name, "list") == 0){
+				for(size_t p = 0; p < NUM_LAT_PRESETS; p++){
+					char desc[512];
+					lat_format(&lat_presets[p], desc, sizeof(desc));
+					printf("%-8s %s\n", lat_presets[p].name, desc);
+				}
+				return 0;
+			}
 
-// headers for the helper functions
-static bool parse_line(const char *linebuf, Instr *ins); //function to parse each line of the assembly program
-static void print_output(const CPU *cpu); //function to print expected output
-static void execute_program(CPU *cpu, const Instr *prog, size_t n); //function to run simulator
+			//a preset name wins over a file with the same name
+			lat = lat_find(name);
+			if(lat == NULL){
+				char err[512];
+				if(!lat_load(name, &lat_file, err, sizeof(err))){
+					fprintf(stderr, "Error: --latency %s\n", err);
+					return 1;
+				}
+				lat = &lat_file;
+			}
+		}else if(strcmp(argv[i], "--cores") == 0 && i + 1 < argc){
+			ncores = atoi(argv[++i]);
+			if(ncores < 1 || ncores > MC_MAX_CORES){
+				fprintf(stderr, "--cores must be between 1 and %d\n", MC_MAX_CORES);
+				return 1;
+			}
+		}else if(strcmp(argv[i], "--addr-bits") == 0 && i + 1 < argc){
+			addr_bits = atoi(argv[++i]);
+			if(addr_bits != 8 && addr_bits != 16 && addr_bits != 32){
+				fprintf(stderr, "--addr-bits must be 8, 16 or 32\n");
+				return 1;
+			}
+		}else if(strcmp(argv[i], "--quantum") == 0 && i + 1 < argc){
+			quantum = atoi(argv[++i]);
+			if(quantum < 1){
+				print_usage();
+				return 1;
+			}
+		}else if(argv[i][0] == '-' || npaths == MC_MAX_CORES){
+			print_usage();
+			return 1;
+		}else{
+			paths[npaths++] = argv[i];
+		}
+	}
+
+	//--diff makes up its own programs and runs them on every engine, with
+	//every address width and latency preset
+	if(diff_count > 0){
+		if(npaths > 0 || ncores > 0 || cache_dir || debug || cov_path || serve_path || stream){
+			print_usage();
+			return 1;
+		}
+
+		DiffConfig cfg;
+		cfg.engines = engines;
+		cfg.nengines = NUM_ENGINES;
+		cfg.count = diff_count;
+		cfg.threads = threads > 0 ? threads : 1;
+		cfg.seed = seed;
+		cfg.out_dir = diff_out;
+		return diff_run(&cfg);
+	}
+
+	//the server takes its programs over the socket
+	if(serve_path){
+		if(npaths > 0 || ncores > 0 || cache_dir || debug || cov_path || stream){
+			print_usage();
+			return 1;
+		}
+
+		ServeConfig cfg;
+		cfg.threads = threads > 0 ? threads : 1;
+		cfg.addr_bits = addr_bits;
+		cfg.lat = lat;
+		cfg.fold = engine->fold;
+		cfg.max_instr = (int)max_instr;
+		return serve(serve_path, &cfg);
+	}
+
+	//--stream never has the whole program, so nothing that needs it up front
+	//(the cache key, coverage hash, debugger, folding) goes with it
+	if(stream){
+		if(npaths > 0 || ncores > 0 || cache_dir || debug || cov_path || engine->fold){
+			print_usage();
+			return 1;
+		}
+
+		IssStats stats;
+		stats_start(&stats, show_stats);
+
+		CPU cpu;
+		if(!cpu_init(&cpu, addr_bits)){
+			fprintf(stderr, "Error: could not allocate a %d-bit address space\n", addr_bits);
+			hw_close(&stats.hw);
+			return 1;
+		}
+		cpu.lat = lat;
+
+		int ret = stream_run(&cpu, STDIN_FILENO, (size_t)window, &stats);
+		if(ret == 0){
+			print_output(&cpu);
+			fflush(stdout);
+			stats_mark(&stats, PHASE_OUTPUT);
+			if(show_stats)
+				stats_print(stderr, &stats);
+		}
+
+		hw_close(&stats.hw);
+		cpu_free(&cpu);
+		return ret;
+	}
 
-int main(int argc, char **argv){
 	//check for incorrect usage
-	if(argc != 2)
+	//more than one file only makes sense with --cores, and the result cache is single-core only
+	//the debugger patches the single-core program, so it goes with neither, and
+	//coverage needs the program to actually run through the normal loop
+	if(npaths == 0 || window > 0 || (ncores == 0 && npaths > 1) || (ncores > 0 && cache_dir) || (debug && (ncores > 0 || cache_dir))
+		|| (cov_path && (ncores > 0 || cache_dir || debug)))
 	{
-		fprintf(stderr, "Usage: ./myISS <assembly_file>\n");
+		print_usage();
 		return 1;
 	}
 
-	FILE *pFile;
-	pFile = fopen(argv[1], "r");
-	if(pFile == NULL)
+	IssStats stats;
+	stats_start(&stats, show_stats);
+
+	if(ncores > 0){
+		int ret = run_multicore(paths, npaths, ncores, quantum, addr_bits, lat, &stats);
+		if(ret == 0 && show_stats)
+			stats_print(stderr, &stats);
+		hw_close(&stats.hw);
+		return ret;
+	}
+
+	size_t n = 0;
+	Instr *program = load_program(paths[0], &n, &stats);
+	if(program == NULL){
+		hw_close(&stats.hw);
+		return 1;
+	}
+
+	//run the actual simulator
+	CPU cpu;
+	if(!cpu_init(&cpu, addr_bits)){
+		fprintf(stderr, "Error: could not allocate a %d-bit address space\n", addr_bits);
+		free(program);
+		hw_close(&stats.hw);
+		return 1;
+	}
+	cpu.pc = 0;
+	cpu.last_je = false;
+	cpu.lat = lat;
+
+	if(cov_path){
+		cpu.cov = (uint8_t*)calloc(n ? n : 1, 1);
+		if(!cpu.cov){
+			fprintf(stderr, "Error: out of memory for coverage flags\n");
+			cpu_free(&cpu);
+			free(program);
+			hw_close(&stats.hw);
+			return 1;
+		}
+		//the coverage loop is part of the switch interpreter
+		engine = &engines[0];
+	}
+
+	//the debugger runs the program itself, then it's the normal output
+	if(debug){
+		FILE *in = debug_script ? fopen(debug_script, "r") : stdin;
+		if(in == NULL){
+			perror("Error opening debug script");
+			cpu_free(&cpu);
+			free(program);
+			hw_close(&stats.hw);
+			return 1;
+		}
+
+		int ret = debug_session(&cpu, program, n, in, !debug_script && isatty(STDIN_FILENO));
+		if(debug_script)
+			fclose(in);
+		if(ret != 0)
+			fprintf(stderr, "Error: out of memory for debugger state\n");
+		else
+			print_output(&cpu);
+
+		hw_close(&stats.hw);
+		cpu_free(&cpu);
+		free(program);
+		return ret;
+	}
+
+	//with --cache, a run of the same decoded program from the same state is looked up
+	//instead of simulated, key has to be taken before execute_program touches cpu
+	CacheKey key;
+	if(cache_dir){
+		char options[640];
+		char desc[512];
+		lat_format(lat, desc, sizeof(desc));
+		snprintf(options, sizeof(options), "addr-bits=%d %s", addr_bits, desc);
+
+		cache_key_init(&key);
+		cache_key_run(&key, program, n, &cpu, options);
+		stats.cache_hit = cache_lookup(cache_dir, &key, &cpu);
+		//hashing the program and the lookup aren't simulation, a hit then shows
+		//up as an empty execute phase instead of a slow one
+		stats_mark(&stats, PHASE_RESOLVE);
+	}
+
+	//folding only pays off when the program actually runs, the time it
+	//takes counts as resolve like the rest of getting the program ready
+	FoldRegion *fold = NULL;
+	if(engine->fold && !stats.cache_hit){
+		fold = fold_program(program, n, &stats.fold_regions, &stats.folded);
+		if(fold == NULL){
+			fprintf(stderr, "Error: out of memory for fold regions\n");
+			cpu_free(&cpu);
+			free(program);
+			hw_close(&stats.hw);
+			return 1;
+		}
+		cpu.fold = fold;
+		stats_mark(&stats, PHASE_RESOLVE);
+	}
+
+	if(!stats.cache_hit){
+		hw_enable(&stats.hw);
+		engine->run(&cpu, program, n);
+		hw_disable(&stats.hw);
+		stats.executed = cpu.num_instr;
+	}
+	stats_mark(&stats, PHASE_EXECUTE);
+
+	//storing the result counts as output, so the MIPS number is just the simulator loop
+	if(cache_dir && !stats.cache_hit && !cache_store(cache_dir, &key, &cpu, cache_max))
+		fprintf(stderr, "Warning: could not write result cache in %s: %s\n", cache_dir, strerror(errno));
+	if(cov_path && !cov_merge(cov_path, paths[0], program, n, cpu.cov))
+		fprintf(stderr, "Warning: could not merge coverage into %s: %s\n", cov_path, strerror(errno));
+
+	//print expected output
+	print_output(&cpu);
+	fflush(stdout);
+	stats_mark(&stats, PHASE_OUTPUT);
+
+	if(show_stats)
+		stats_print(stderr, &stats);
+	hw_close(&stats.hw);
+
+	free(cpu.cov);
+	free(fold);
+	cpu_free(&cpu);
+	free(program);
+	return 0;
+}
+
+//function to read, parse and resolve one assembly file, charging each step to its phase
+static Instr *load_program(const char *path, size_t *count, IssStats *stats)
+{
+	size_t len = 0;
+	char *text = read_file(path, &len);
+	if(text == NULL)
 	{
 		perror("Error opening file");
-		return 1;
+		return NULL;
 	}
-	
+	stats->bytes += len;
+	stats_mark(stats, PHASE_READ);
+
+	size_t n = 0;
+	size_t lines = 0;
+	Instr *program = parse_program(text, len, &n, &lines);
+	free(text);
+	if(program == NULL)
+		return NULL;
+	stats->lines += lines;
+	stats->n += n;
+	stats_mark(stats, PHASE_PARSE);
+
+	resolve_targets(program, n);
+	stats_mark(stats, PHASE_RESOLVE);
+
+	*count = n;
+	return program;
+}
+
+static Instr *load_source(const char *path, size_t *count)
+{
+	size_t len = 0;
+	char *text = read_file(path, &len);
+	if(text == NULL)
+		return NULL;
+
+	size_t lines = 0;
+	Instr *program = parse_program(text, len, count, &lines);
+	free(text);
+	if(program)
+		resolve_targets(program, *count);
+	return program;
+}
+
+//function to run --cores mode: core i runs paths[i % npaths] against one shared memory
+static int run_multicore(char **paths, int npaths, int ncores, int quantum, int addr_bits, const LatencyModel *lat, IssStats *stats)
+{
+	Instr *programs[MC_MAX_CORES];
+	McProgram progs[MC_MAX_CORES];
+	int ret = 1;
+
+	int loaded = 0;
+	for(; loaded < npaths; loaded++){
+		size_t n = 0;
+		programs[loaded] = load_program(paths[loaded], &n, stats);
+		if(programs[loaded] == NULL)
+			goto out;
+		progs[loaded].prog = programs[loaded];
+		progs[loaded].n = n;
+	}
+
+	for(int i = npaths; i < ncores; i++)
+		progs[i] = progs[i % npaths];
+
+	CPU *cpus = (CPU*)calloc((size_t)ncores, sizeof(*cpus));
+	if(!cpus)
+		goto out;
+
+	int ninit = 0;
+	for(; ninit < ncores; ninit++){
+		if(!cpu_init(&cpus[ninit], addr_bits))
+			break;
+		cpus[ninit].lat = lat;
+	}
+	if(ninit < ncores){
+		fprintf(stderr, "Error: could not allocate a %d-bit address space\n", addr_bits);
+		for(int i = 0; i < ninit; i++)
+			cpu_free(&cpus[i]);
+		free(cpus);
+		goto out;
+	}
+
+	McStats mc;
+	hw_enable(&stats->hw);
+	int rc = mc_run(cpus, progs, ncores, quantum, &mc);
+	hw_disable(&stats->hw);
+	stats_mark(stats, PHASE_EXECUTE);
+
+	if(rc != 0){
+		if(rc == -2)
+			fprintf(stderr, "Error: out of memory for the store buffer\n");
+		else
+			fprintf(stderr, "Error: could not start %d simulator threads\n", ncores);
+		for(int i = 0; i < ncores; i++)
+			cpu_free(&cpus[i]);
+		free(cpus);
+		goto out;
+	}
+
+	//per-core output in the normal format, then the totals
+	CPU total;
+	memset(&total, 0, sizeof(total));
+	for(int i = 0; i < ncores; i++){
+		printf("Core %d (%s):\n", i, paths[i % npaths]);
+		print_output(&cpus[i]);
+
+		total.num_instr += cpus[i].num_instr;
+		total.num_cycles += cpus[i].num_cycles;
+		total.local_hits += cpus[i].local_hits;
+		total.num_ldst += cpus[i].num_ldst;
+	}
+	printf("All cores:\n");
+	print_output(&total);
+	printf("Coherence invalidations: %lld\n", mc.invalidations);
+	fflush(stdout);
+	stats->executed = total.num_instr;
+	stats_mark(stats, PHASE_OUTPUT);
+
+	for(int i = 0; i < ncores; i++)
+		cpu_free(&cpus[i]);
+	free(cpus);
+	ret = 0;
+
+out:
+	for(int i = 0; i < loaded; i++)
+		free(programs[i]);
+	return ret;
+}
+
+//function to read the whole assembly file into one buffer, so reading and
+//parsing can be timed on their own
+static char *read_file(const char *path, size_t *len)
+{
+	FILE *pFile;
+	pFile = fopen(path, "r");
+	if(pFile == NULL)
+		return NULL;
+
+	size_t size = 4096;
+	size_t used = 0;
+	char *buf = (char*)malloc(size);
+
+	while(buf){
+		used += fread(buf + used, 1, size - used, pFile);
+		if(used < size)
+			break; //EOF or error
+
+		size *= 2;
+		char *tmp = (char*)realloc(buf, size);
+		if(!tmp){
+			free(buf);
+			buf = NULL;
+			errno = ENOMEM;
+		}
+		buf = tmp;
+	}
+
+	if(buf && ferror(pFile)){
+		free(buf);
+		buf = NULL;
+	}
+	fclose(pFile);
+
+	*len = used;
+	return buf;
+}
+
+//function to split the buffer into lines and parse each one
+//lines are cut the same way fgets into a MEM-sized buffer used to cut them
+Instr *parse_program(const char *buf, size_t len, size_t *count, size_t *lines)
+{
 	//dynamic array to hold all instructions
 	//reference: https://www.geeksforgeeks.org/c/dynamic-array-in-c/
 	size_t size = 128;
 	size_t n = 0; //temp variable
 
 	Instr *program = (Instr*)malloc(size * sizeof(*program));
+	if(!program)
+		return NULL;
 
 	char linebuf[MEM]; //buffer to hold each raw line in assembly file
 	int line_num = 0; //keeps track of line number
+	size_t pos = 0;
 
-	while(fgets(linebuf, sizeof(linebuf), pFile))
+	while(pos < len)
 	{
+		//copy one line (or the first MEM-1 bytes of it) like fgets would
+		size_t k = 0;
+		while(pos < len && k < sizeof(linebuf) - 1){
+			char c = buf[pos++];
+			linebuf[k++] = c;
+			if(c == '\n')
+				break;
+		}
+		linebuf[k] = '\0';
+
 		line_num++; //we got a line from file
-		
+
 		if(linebuf[0] == '\n')
 			continue; //empty lines 
 
@@ -105,8 +609,7 @@ int main(int argc, char **argv){
 			//print: Unknown instruction: <print the instruction> and exit without crashing
 			fprintf(stderr, "Unknown instruction: %s\n", linebuf);
 			free(program);
-			fclose(pFile);
-			return 1;
+			return NULL;
 		}
 
 		//dynamic array size was reached by temp, so realloc more space
@@ -117,50 +620,88 @@ int main(int argc, char **argv){
 			Instr *tmp = (Instr*)realloc(program, size * sizeof(*program));
 			if(!tmp){
 				free(program);
-				fclose(pFile);
-				return 1;
+				return NULL;
 			}
 			program = tmp;
 		}
 		program[n++] = ins;
 	}
-	fclose(pFile);
 
-	//pass through the program to check addr -> line_num (based on line num in beginning of each line in input file)
-	for(size_t i = 0; i < n; i++){
-		if(program[i].op == JE || program[i].op == JMP){
-			int target_line_num = program[i].addr;
-
-			int found = -1; //temp flag to see if we found the wanted addr (based on line number at beginning of lines)
-			
-			for(size_t j = 0; j < n; j++){
-				if(program[j].line_num == target_line_num){
-					found = (int)j;
-					break;
-				}
-			}
+	*count = n;
+	*lines = (size_t)line_num;
+	return program;
+}
 
-			if(found >= 0){
-				program[i].addr = found;
-			}else{
-				program[i].addr = (int)n; //if not found exit cleanly
+//line number -> index pair used to look up jump targets
+typedef struct{
+	int line_num;
+	int idx;
+}LineIdx;
+
+static int cmp_line_idx(const void *a, const void *b)
+{
+	const LineIdx *la = (const LineIdx*)a;
+	const LineIdx *lb = (const LineIdx*)b;
+
+	if(la->line_num != lb->line_num)
+		return la->line_num < lb->line_num ? -1 : 1;
+	return la->idx < lb->idx ? -1 : (la->idx > lb->idx);
+}
+
+//function to pass through the program to check addr -> line_num
+//(based on line num in beginning of each line in input file)
+//line numbers are sorted once and binary searched, the old nested loop was
+//O(n^2) and dominated startup on big generated programs. Ties keep the lowest
+//index so a duplicated line number still resolves to its first occurrence
+void resolve_targets(Instr *prog, size_t n)
+{
+	LineIdx *lines = (LineIdx*)malloc((n ? n : 1) * sizeof(*lines));
+	if(!lines){
+		//no memory for the index, fall back to the plain scan
+		for(size_t i = 0; i < n; i++){
+			if((int)prog[i].op < NUM_ISA_OPS && isa_info[prog[i].op].form == FORM_ADDR){
+				int found = (int)n; //if not found exit cleanly
+				for(size_t j = 0; j < n; j++){
+					if(prog[j].line_num == prog[i].addr){
+						found = (int)j;
+						break;
+					}
+				}
+				prog[i].addr = found;
 			}
 		}
+		return;
 	}
 
-	//run the actual simulator
-	CPU cpu;
-	memset(&cpu, 0, sizeof(cpu));
-	cpu.pc = 0;
-	cpu.last_je = false;
+	for(size_t i = 0; i < n; i++){
+		lines[i].line_num = prog[i].line_num;
+		lines[i].idx = (int)i;
+	}
+	qsort(lines, n, sizeof(*lines), cmp_line_idx);
 
-	execute_program(&cpu, program, n);
+	for(size_t i = 0; i < n; i++){
+		if((int)prog[i].op < NUM_ISA_OPS && isa_info[prog[i].op].form == FORM_ADDR){
+			int target_line_num = prog[i].addr;
+
+			//lower bound on line_num
+			size_t lo = 0, hi = n;
+			while(lo < hi){
+				size_t mid = lo + (hi - lo) / 2;
+				if(lines[mid].line_num < target_line_num)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
 
-	//print expected output
-	print_output(&cpu);
+			if(lo < n && lines[lo].line_num == target_line_num){
+				prog[i].addr = lines[lo].idx;
+			}else{
+				prog[i].addr = (int)n; //if not found exit cleanly
+			}
+		}
+	}
 
-	free(program);
-	return 0;
+	free(lines);
 }
 
 //function to parse each line and fill Instr struct
@@ -173,7 +714,7 @@ int main(int argc, char **argv){
 // 	JMP address	unconditionally jumps to the instruction at <Address>
 // 	LD rn, [rm]	loads from the address stored in Rm into Rn
 // 	ST [rm], rn	stores the contents of Rn into the memory address that is in Rm
-static bool parse_line(const char *linebuf, Instr *ins)
+bool parse_line(const char *linebuf, Instr *ins)
 {
 	//copy linebuf into a buffer we can deal with
 	char buf[MEM];
@@ -193,283 +734,337 @@ static bool parse_line(const char *linebuf, Instr *ins)
 
 	//chop up buf into needed components: first token is the opcode
 	//https://www.geeksforgeeks.org/cpp/strtok-strtok_r-functions-c-examples/
+	//strtok_r because --serve parses on several threads at once
 	//for some reason, since I am working on a Windows laptop, when i created sample.assembly
 	//windows adds \r instead of \n so I was getting unknown lines even though they were valid instructions
 	const char *delimiters = " ,[]\n\r\t"; //tokenizes at any of the characters in the delimiters string
-	char *token = strtok(buf, delimiters);
+	char *save = NULL;
+	char *token = strtok_r(buf, delimiters, &save);
 	if(!token) //nothing there
 		return false;
 
 	ins->line_num = (int)strtol(token, NULL, 10);
 
-	token = strtok(NULL, delimiters);
-
-	// token now includes ONLY the opcode, meaning we can set ins->op
-	if(strcmp(token, "MOV") == 0){
-		ins->op = MOV;
-	}else if(strcmp(token, "ADD") == 0){
-		ins->op = ADD_NUM; //for now and later we can check if rm is being used instead of num
-	}else if(strcmp(token, "CMP") == 0){
-		ins->op = CMP; 
-	}else if(strcmp(token, "JE") == 0){
-		ins->op = JE;
-	}else if(strcmp(token, "JMP") == 0){
-		ins->op = JMP;
-	}else if(strcmp(token, "LD") == 0){
-		ins->op = LD;
-	}else if(strcmp(token, "ST") == 0){
-		ins->op = ST;
-	}else{
-		return false; // ins->op already set to INVALID
-	}
+	token = strtok_r(NULL, delimiters, &save);
+	if(!token) //line number only
+		return false;
 
 	//after the opcode, there only up to 2 extra fields for Rn, Rm, num or addr
 	//so here i'll just get the 2 (if applicable) fields from buf
-	char *field1 = strtok(NULL, delimiters);
-	char *field2 = strtok(NULL, delimiters);
+	char *field1 = strtok_r(NULL, delimiters, &save);
+	char *field2 = strtok_r(NULL, delimiters, &save);
 
-	char *toomanyfields = strtok(NULL, delimiters);
+	char *toomanyfields = strtok_r(NULL, delimiters, &save);
 	if(toomanyfields)
 		return false; // too many (shouldn't happen)
 
-	//fill rest of the fields of Instr struct
-	bool ret = false;
-	switch(ins->op){
-		case MOV: // MOV Rn, <num>
-			if(!field1 || !field2)
-				break;
-			ins->rn = (int)(field1[1] - '1');
-			if(ins->rn < 0)
-				break;
-
-			char *end = NULL;
-			long n = strtol(field2, &end, 10);
-			
-			ins->num = (int)n;
-			ret = true;
-
-			break;
-
-		case ADD_NUM: // ADD Rn, Rm || ADD Rn, <num>
-			if(!field1 || !field2)
-				break;
-			ins->rn = (int)(field1[1] - '1');
-			if(ins->rn < 0)
-				break;
-
-			//check if the second field's first character is 'R', if not its num
-			if(field2[0] == 'R'){
-				ins->op = ADD_REG;
-				ins->rm = (int)(field2[1] - '1');
-				ret = true;
-			}else{
-				ins->op = ADD_NUM;
-				
-				char *end = NULL;
-				long n4 = strtol(field2, &end, 10);
-
-				ins->num = (int)n4;
-				ret = true;
-			}
-
-			break;
-
-		case CMP: // CMP Rn, Rm
-			if(!field1 || !field2)
-				break;
-			ins->rn = (int)(field1[1] - '1');
-			if(ins->rn < 0)
-				break;
+	// token now includes ONLY the opcode, the ISA table (issisa.h) says which
+	// opcodes use that mnemonic and what operands they take
+	// ADD Rn, Rm and ADD Rn, <num> share one, so a second field starting with 'R'
+	// picks the register form and anything else the number form
+	for(int op = 0; op < NUM_ISA_OPS; op++){
+		const IsaInfo *info = &isa_info[op];
+		if(strcmp(info->mnemonic, token) != 0)
+			continue;
+		if(info->form == FORM_RN_RM && (!field2 || field2[0] != 'R'))
+			continue;
+
+		ins->op = (Opcode)op;
+		return parse_operands(info->form, field1, field2, ins);
+	}
 
-			ins->rm = (int)(field2[1] - '1');
-			if(ins->rm < 0)
-				break;
-			
-			ret = true;
-			break;
+	return false; // ins->op already set to INVALID
+}
 
-		case JE: // JE <Address>
-			if(!field1 || field2)
-				break;
+//register field like R3, stored as index 2
+static bool parse_reg(const char *field, int *reg)
+{
+	if(!field)
+		return false;
+	*reg = (int)(field[1] - '1');
+	return *reg >= 0 && *reg < NUMREGS;
+}
 
-			char *end2 = NULL;
-			long n2 = strtol(field1, &end2, 10);
-			if(n2 < 0)
-				break;
+//function to fill rest of the fields of Instr struct for one operand form
+static bool parse_operands(IsaForm form, const char *field1, const char *field2, Instr *ins)
+{
+	switch(form){
+		case FORM_RN_NUM: // MOV Rn, <num> / ADD Rn, <num> ...
+			if(!field2 || !parse_reg(field1, &ins->rn))
+				return false;
+			ins->num = (int)strtol(field2, NULL, 10);
+			return true;
 
-			ins->addr = (int)n2;
-			
-			ret = true;
-			break;
+		case FORM_RN_RM: // CMP Rn, Rm / ADD Rn, Rm ...
+			return parse_reg(field1, &ins->rn) && parse_reg(field2, &ins->rm);
 
-		case JMP: // JMP <Address>
+		case FORM_ADDR:{ // JE <Address> ...
 			if(!field1 || field2)
-				break;
-
-			char *end3 = NULL;
-			long n3 = strtol(field1, &end3, 10);
-			if(n3 < 0)
-				break;
-
-			ins->addr = (int)n3;
-			
-			ret = true;
-			break;
-
-		case LD: // LD Rn, [Rm]
-			if(!field1 || !field2)
-				break;
-
-			ins->rn = (int)(field1[1] - '1');
-			if(ins->rn < 0)
-				break;
+				return false;
+			long addr = strtol(field1, NULL, 10);
+			if(addr < 0)
+				return false;
+			ins->addr = (int)addr;
+			return true;
+			}
 
-			ins->rm = (int)(field2[1] - '1');
-			if(ins->rm < 0)
-				break;
+		case FORM_LD: // LD Rn, [Rm]
+			return parse_reg(field1, &ins->rn) && parse_reg(field2, &ins->rm);
 
-			ret = true;			
-			break;
+		case FORM_ST: // ST [Rm], Rn
+			return parse_reg(field1, &ins->rm) && parse_reg(field2, &ins->rn);
 
-		case ST: // ST [Rm], Rn
-			if(!field1 || !field2)
-				break;
+		case FORM_NONE: // RET
+			return field1 == NULL;
+	}
 
-			ins->rm = (int)(field1[1] - '1');
-			if(ins->rm < 0)
-				break;
+	return false;
+}
 
-			ins->rn = (int)(field2[1] - '1');
-			if(ins->rn < 0)
-				break;
-			
-			ret = true;
-			break;
+//LD/ST timing: miss cycles if external mem (first time touched), hit cycles if in local mem
+//(50 and 2 in the default model) added to *cycles, returns the page so the caller can do the actual load/store
+static inline __attribute__((always_inline)) MemPage *mem_access(CPU *cpu, SimMem *mem, uint32_t addr, int hit, int miss, int *cycles)
+{
+	MemPage *page = mem_page(mem, addr);
+	uint32_t off = addr & PAGE_MASK;
 
+	cpu->num_ldst += 1;
+	if(page->cached[off]){
+		*cycles += hit;
+		cpu->local_hits += 1;
+	}else{
+		*cycles += miss;
+		page->cached[off] = true;
 	}
 
-	return ret;
+	return page;
 }
 
+//LD/ST cases of execute_width, the memory side of the generated ISA_OPS switch
+// ST is the same as LD
+#define ISA_EXEC_LD(op, arg, cost) \
+	case op:{ \
+		uint32_t addr = ((uint32_t)cpu->R[ins->rm] & mask); \
+		MemPage *page = mem_access(cpu, mem, addr, lat->cost##_hit, lat->cost##_miss, &cycles); \
+		cpu->R[ins->rn] = page->data[addr & PAGE_MASK]; \
+		pc += 1; \
+		}break;
+
+#define ISA_EXEC_ST(op, arg, cost) \
+	case op:{ \
+		uint32_t addr = ((uint32_t)cpu->R[ins->rm] & mask); \
+		MemPage *page = mem_access(cpu, mem, addr, lat->cost##_hit, lat->cost##_miss, &cycles); \
+		page->data[addr & PAGE_MASK] = (uint8_t)(cpu->R[ins->rn] & 0xFF); \
+		pc += 1; \
+		}break;
+
+//the branch already knows which way it goes, so no second look at the flags,
+//and its one OR covers executed too (the loop skips its COV_EXEC for branches)
+#define ISA_COV_BRANCH(taken) \
+	do{ \
+		if(coverage) \
+			cov[pc] |= (uint8_t)(COV_EXEC | (COV_NOT_TAKEN << (taken))); \
+	}while(0)
+
 //function to use struct Instr (now filled by parse_line) &
 //initialized "CPU"  to go through and fill CPU struct
-static void execute_program(CPU *cpu, const Instr *prog, size_t n)
+//bits is the register/address width, single stops after one instruction
+//(debugger step), coverage records cpu->cov, limited stops at cpu->max_instr and
+//lat gives the cycle costs, all constants at the call sites below so each
+//combination gets its own copy of the loop with the checks (and for presets,
+//the costs) folded in
+static inline __attribute__((always_inline)) void execute_width(CPU *cpu, const Instr *prog, size_t n, const int bits, const bool single, const bool coverage,
+	const bool limited, const LatencyModel *lat)
 {
+	const uint32_t mask = reg_mask(bits);
+	SimMem *mem = &cpu->mem;
+	uint8_t *cov = cpu->cov;
+
+	//the counters every instruction touches stay in locals until the loop stops
+	int pc = cpu->pc;
+	int cycles = cpu->num_cycles;
+	int num_instr = cpu->num_instr;
+
 	// keep executing while program counter (pc) is within 0 & n
-	while(cpu->pc >= 0 && (size_t)cpu->pc < n){
+	while(pc >= 0 && (size_t)pc < n){
+		//a FOLD can go a few instructions past the limit, that's fine
+		if(limited && num_instr >= cpu->max_instr){
+			cpu->limit_hit = true;
+			break;
+		}
+
 		// get the wanted instruction from the program
-		const Instr *ins = &prog[cpu->pc];
+		const Instr *ins = &prog[pc];
 		// increment num_instr since we executed an instruction
-		cpu->num_instr++;
+		num_instr++;
+
+		//one OR per instruction, branches do theirs in ISA_COV_BRANCH
+		if(coverage && (ins->op >= NUM_ISA_OPS || !isa_info[ins->op].cond))
+			cov[pc] |= COV_EXEC;
 
 		//based on the opcode, simulate instruction
-		// keep in mind each register has 8 bits (signed)
+		// keep in mind each register has 8 bits (signed) unless --addr-bits made them wider
+		// the cases come from ISA_OPS (issisa.h), LD/ST are the two ISA_EXEC_* above
 		switch(ins->op){
-			case MOV:{
-				int8_t num8bit = (int8_t)ins->num;
-				cpu->R[ins->rn] = num8bit;
-				// MOV = 1 clock cycle
-				cpu->num_cycles += 1;
-				cpu->pc += 1;
-				 }break;
-
-			case ADD_REG:{
-				//Rn = Rn + Rm
-				int sum = (cpu->R[ins->rn] & 0xFF) + (cpu->R[ins->rm] & 0xFF);
-				cpu->R[ins->rn] = (int8_t)(sum & 0xFF);
-
-				// ADD = 1 clock cycle
-				cpu->num_cycles += 1;
-				cpu->pc += 1;
-				     }break;
-
-			case ADD_NUM:{
-				// Rn = Rn + num
-				int sum = (cpu->R[ins->rn] & 0xFF) + (int8_t)ins->num;
-				cpu->R[ins->rn] = (int8_t)(sum & 0xFF);
-
-				cpu->num_cycles += 1;
-				cpu->pc += 1;
-				     }break;
-
-			case CMP:{
-				bool temp = ((cpu->R[ins->rn] & 0xFF) == (cpu->R[ins->rm] & 0xFF));
-				cpu->last_je = temp;
-
-				// CMP = 1 clock cycle
-				cpu->num_cycles += 1;
-				cpu->pc += 1;
-				 }break;
-
-			case JE:{
-				cpu->num_cycles += 1;
-				// if last_je == true, jump to instruction addr
-				if(cpu->last_je){
-					if(ins->addr < 0 || (size_t)ins->addr >= n){
-						cpu->pc = (int)n; // exit cleanly
-					}else{
-						cpu->pc = ins->addr;
-					}
-				}else{
-					cpu->pc += 1;
+#define X(op, mnemonic, form, kind, arg, cost) ISA_EXEC_##kind(op, arg, cost)
+			ISA_OPS(X)
+#undef X
+
+			//the debugger swaps every LD/ST for these while a watchpoint is set,
+			//so the bitmap is never looked at otherwise
+			case LD_W:{
+				uint32_t addr = ((uint32_t)cpu->R[ins->rm] & mask);
+				MemPage *page = mem_access(cpu, mem, addr, lat->ld_hit, lat->ld_miss, &cycles);
+
+				cpu->R[ins->rn] = page->data[addr & PAGE_MASK];
+				pc += 1;
+				if(watch_test(cpu->watch, addr)){
+					cpu->watch_hit = addr;
+					goto out;
 				}
 				}break;
 
-			case JMP:{
-				cpu->num_cycles += 1;
-				if(ins->addr < 0 || (size_t)ins->addr >= n){
-					cpu->pc = (int)n;
-				}else{
-					cpu->pc = ins->addr;
-				}
-				 }break;
-
-			case LD:{
-				// LD = 50 if external mem (first time touched), 2 cycles if in local mem
-				cpu->num_ldst += 1;
-				
-				int addr = (cpu->R[ins->rm] & 0xFF);
-
-				if(cpu->cached_local[addr]){
-					cpu->num_cycles += 2;
-					cpu->local_hits += 1;
-				}else{
-					cpu->num_cycles += 50;
-					cpu->cached_local[addr] = true;
-				}
+			case ST_W:{
+				uint32_t addr2 = ((uint32_t)cpu->R[ins->rm] & mask);
+				MemPage *page2 = mem_access(cpu, mem, addr2, lat->st_hit, lat->st_miss, &cycles);
 
-				cpu->R[ins->rn] = (cpu->mem[addr] & 0xFF);
-				cpu->pc += 1;
+				page2->data[addr2 & PAGE_MASK] = (uint8_t)(cpu->R[ins->rn] & 0xFF);
+				pc += 1;
+				if(watch_test(cpu->watch, addr2)){
+					cpu->watch_hit = addr2;
+					goto out;
+				}
 				}break;
 
-			case ST:{
-				// ST is the same as LD
-				cpu->num_ldst += 1;
-
-				int addr2 = (cpu->R[ins->rm] & 0xFF);
-				if(cpu->cached_local[addr2]){
-					cpu->num_cycles += 2;
-					cpu->local_hits += 1;
-				}else{
-					cpu->num_cycles += 50;
-					cpu->cached_local[addr2] = true;
+			//a folded region (issfold.c): everything is worked out from the
+			//registers as they are now before any of them is written
+			case FOLD:{
+				const FoldRegion *r = &cpu->fold[ins->addr];
+				int v[NUMREGS];
+
+				for(int i = 0; i < r->nwrites; i++)
+					v[i] = wrap_reg(fold_eval(cpu->R, r->w[i].v) & mask, bits);
+				if(r->cmp){
+					uint32_t a = fold_eval(cpu->R, r->cmp_a) & mask;
+					uint32_t b = fold_eval(cpu->R, r->cmp_b) & mask;
+					cpu->last_je = a == b;
+					cpu->last_lt = wrap_reg(a, bits) < wrap_reg(b, bits);
 				}
+				for(int i = 0; i < r->nwrites; i++)
+					cpu->R[r->w[i].rn] = v[i];
 
-				cpu->mem[addr2] = (cpu->R[ins->rn] & 0xFF);
-				cpu->pc += 1;
+				num_instr += r->ninstr - 1;
+				cycles += r->nmov * lat->mov + r->nadd_reg * lat->add_reg + r->nadd_num * lat->add_num
+					+ r->nalu * lat->alu + r->ncmp * lat->cmp;
+				pc = r->end;
 				}break;
 
+			case TRAP:
+				//breakpoint: not executed, hand control back to the debugger
+				num_instr--;
+				goto out;
+
 			default:
-				return;
+				goto out;
 		}
+
+		if(single)
+			goto out;
+	}
+
+out:
+	cpu->pc = pc;
+	cpu->num_cycles = cycles;
+	cpu->num_instr = num_instr;
+}
+
+static inline __attribute__((always_inline)) void execute_dispatch(CPU *cpu, const Instr *prog, size_t n, const bool single, const bool coverage,
+	const bool limited, const LatencyModel *lat)
+{
+	switch(cpu->mem.addr_bits){
+		case 16:
+			execute_width(cpu, prog, n, 16, single, coverage, limited, lat);
+			break;
+		case 32:
+			execute_width(cpu, prog, n, 32, single, coverage, limited, lat);
+			break;
+		default:
+			execute_width(cpu, prog, n, 8, single, coverage, limited, lat);
+			break;
+	}
+}
+
+_Static_assert(NUM_LAT_PRESETS == 3, "every preset needs a case in execute_program");
+
+//only the plain run gets a loop per preset, coverage, the server's limited runs
+//and the debugger's single steps read the model like a loaded one
+void execute_program(CPU *cpu, const Instr *prog, size_t n)
+{
+	if(cpu->cov){
+		execute_dispatch(cpu, prog, n, false, true, false, cpu->lat);
+		return;
+	}
+
+	switch(cpu->lat->preset){
+		case 0:
+			execute_dispatch(cpu, prog, n, false, false, false, &lat_presets[0]);
+			break;
+		case 1:
+			execute_dispatch(cpu, prog, n, false, false, false, &lat_presets[1]);
+			break;
+		case 2:
+			execute_dispatch(cpu, prog, n, false, false, false, &lat_presets[2]);
+			break;
+		default:
+			execute_dispatch(cpu, prog, n, false, false, false, cpu->lat);
+			break;
 	}
 }
 
+//its own entry point rather than a branch in execute_program so the plain
+//loops stay exactly what the CLI runs
+void execute_limited(CPU *cpu, const Instr *prog, size_t n)
+{
+	execute_dispatch(cpu, prog, n, false, false, true, cpu->lat);
+}
+
+void execute_step(CPU *cpu, const Instr *prog, size_t n)
+{
+	execute_dispatch(cpu, prog, n, true, false, false, cpu->lat);
+}
+
 //function to print expected output
-static void print_output(const CPU *cpu)
+void print_output(const CPU *cpu)
 {
 	printf("Total number of executed instructions: %d\n", cpu->num_instr);
 	printf("Total number of clock cycles: %d\n", cpu->num_cycles);
 	printf("Number of hits to local memory: %d\n", cpu->local_hits);
 	printf("Total number of executed LD/ST instructions: %d\n", cpu->num_ldst);
 }
+
+//function to parse a byte count with an optional K/M/G suffix, -1 if malformed
+static long long parse_size(const char *s)
+{
+	char *end = NULL;
+	long long v = strtoll(s, &end, 10);
+	if(end == s || v < 0)
+		return -1;
+
+	switch(*end){
+		case '\0':
+			return v;
+		case 'k': case 'K':
+			v *= 1024LL;
+			break;
+		case 'm': case 'M':
+			v *= 1024LL * 1024;
+			break;
+		case 'g': case 'G':
+			v *= 1024LL * 1024 * 1024;
+			break;
+		default:
+			return -1;
+	}
+
+	return end[1] == '\0' ? v : -1;
+}
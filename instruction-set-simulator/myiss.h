@@ -0,0 +1,170 @@
+#ifndef MYISS_H
+#define MYISS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "issmem.h"
+#include "isslat.h"
+#include "issisa.h"
+
+//helper constants
+#define NUMREGS 6
+#define MEM 256
+#define ADDR_BITS_DEFAULT 8 //--addr-bits, 8 is the original 256-byte memory
+
+// enum for switch for the commands, generated from ISA_OPS in issisa.h
+// typedef to directly refer to instructions
+// https://www.geeksforgeeks.org/c/enumeration-enum-c/
+typedef enum{
+#define X(op, mnemonic, form, kind, arg, cost) op,
+	ISA_OPS(X)
+#undef X
+	TRAP, //debugger breakpoint, swapped in over the real opcode
+	LD_W, //LD/ST while a watchpoint is set, these check the watch bitmap
+	ST_W,
+	FOLD, //--engine fold: a whole register-only region, addr indexes cpu->fold
+	INVALID
+}Opcode;
+
+#define NUM_ISA_OPS ((int)TRAP) //opcodes that can appear in a program
+
+//what parse_line needs to know about each opcode, indexed by Opcode
+typedef struct{
+	const char *mnemonic;
+	IsaForm form;
+	bool cond; //conditional branch
+}IsaInfo;
+
+static const IsaInfo isa_info[] __attribute__((unused)) = {
+#define X(op, mnemonic, form, kind, arg, cost) {mnemonic, form, ISA_IS_COND_##kind},
+	ISA_OPS(X)
+#undef X
+};
+
+typedef struct FoldRegion FoldRegion; //issfold.h
+
+//struct to hold full instruction including opcode
+typedef struct{
+	Opcode op;
+	int rn, rm, num, addr;
+
+	int line_num;
+
+	char full_line[MEM];
+}Instr;
+
+//struct to make up cpu which holds:
+//the 6 registers R1, R2, ... R6
+//byte-addressable local mem (256 bytes by default, 2^addr_bits in general)
+//with the flag for whether an addr was cached locally, both paged (see issmem.h)
+//total number of executed instructions
+//total cycle count
+//# hits to local mem
+//# executed LD/ST instructions
+//flags for JE/BNE (equal) and BLT (signed less than) from the last CMP
+//program counter to index into the Instr array when made
+//return addresses pushed by CALL
+typedef struct{
+	int R[NUMREGS];
+	SimMem mem;
+	int num_instr;
+	int num_cycles;
+	int local_hits;
+	int num_ldst;
+
+	bool last_je;
+	bool last_lt;
+
+	int pc;
+
+	int stack[CALL_STACK_DEPTH];
+	int sp;
+
+	//debugger only: LD_W/ST_W test addresses against watch and stop the
+	//loop after the access, leaving the address in watch_hit (-1 = none)
+	const WatchMap *watch;
+	int64_t watch_hit;
+
+	//--coverage: one flag byte per pc, see isscov.h (NULL = off)
+	uint8_t *cov;
+
+	//--engine fold: the regions FOLD instructions point at (NULL = not folded)
+	const FoldRegion *fold;
+
+	//--latency: cycle costs, LAT_DEFAULT unless a preset or file was given
+	const LatencyModel *lat;
+
+	//--serve: execute_limited() stops once this many instructions ran and sets
+	//limit_hit, so a program that never halts can't keep a worker forever
+	int max_instr;
+	bool limit_hit;
+}CPU;
+
+//zeroed cpu with a 2^addr_bits memory
+static inline bool cpu_init(CPU *cpu, int addr_bits)
+{
+	memset(cpu, 0, sizeof(*cpu));
+	cpu->watch_hit = -1;
+	cpu->lat = LAT_DEFAULT;
+	return mem_init(&cpu->mem, addr_bits);
+}
+
+static inline void cpu_free(CPU *cpu)
+{
+	mem_free(&cpu->mem);
+}
+
+//registers are as wide as an address: 8 bits (signed) by default, so MOV/ADD
+//wrap like int8_t, with --addr-bits 16/32 they wrap like int16_t/int32_t
+static inline uint32_t reg_mask(int bits)
+{
+	return bits >= 32 ? 0xFFFFFFFFu : ((1u << bits) - 1);
+}
+
+static inline int wrap_reg(uint32_t v, int bits)
+{
+	if(bits == 8)
+		return (int8_t)v;
+	if(bits == 16)
+		return (int16_t)v;
+	return (int32_t)v;
+}
+
+//-1 if op isn't a conditional branch, otherwise whether it would be taken now
+static inline int isa_cond(const CPU *cpu, Opcode op)
+{
+	switch(op){
+#define X(op, mnemonic, form, kind, arg, cost) ISA_COND_##kind(op, arg)
+		ISA_OPS(X)
+#undef X
+		default:
+			return -1;
+	}
+}
+
+static inline bool isa_is_cond(Opcode op)
+{
+	return (int)op < NUM_ISA_OPS && isa_info[op].cond;
+}
+
+//an execution engine (--engine, the table is in myiss.c), every engine has
+//to give the same CPU state as the switch interpreter, --diff checks that
+typedef struct{
+	const char *name;
+	bool fold; //run fold_program (issfold.h) on the program once it's loaded
+	void (*run)(CPU *cpu, const Instr *prog, size_t n);
+}Engine;
+
+//myiss.c
+Instr *parse_program(const char *buf, size_t len, size_t *count, size_t *lines); //decodes every line, NULL on a bad line
+bool parse_line(const char *linebuf, Instr *ins); //decodes one line, false if it isn't an instruction
+void resolve_targets(Instr *prog, size_t n); //turns branch/JMP/CALL line numbers into indices
+void execute_program(CPU *cpu, const Instr *prog, size_t n); //runs until the program halts (or hits TRAP / a watchpoint)
+void execute_limited(CPU *cpu, const Instr *prog, size_t n); //same, but also stops after cpu->max_instr (> 0) instructions
+void execute_step(CPU *cpu, const Instr *prog, size_t n); //executes exactly one instruction
+void print_output(const CPU *cpu);
+
+#endif
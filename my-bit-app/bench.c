@@ -0,0 +1,331 @@
+// Noah Hathout
+// nhathout
+// bench.c
+
+//microbenchmarks for the hot functions, "make bench" builds and runs it
+//
+//	MyBitBench [-m max_values] [-r reps] [name]
+//
+//every function runs over generated datasets of 10^3, 10^4, ... up to max_values
+//(10^7 by default, 10^8 is about 3 GB for the parse/sort datasets). One warm-up
+//run, then reps timed runs (5 by default), small datasets are looped so a run
+//takes at least ~1 ms. Prints the median ns per value, the spread of the runs
+//(min..max around the median, in %) and the throughput at the median
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bits.h"
+#include "mylist.h"
+#include "myindex.h"
+#include "parse.h"
+#include "output.h"
+
+#define BENCH_MIN_RUN_NS 1000000.0
+#define BENCH_INSERT_MAX 10000 //insertSorted() is O(n^2), 10^5 values is already ~30 s a run
+
+typedef struct{
+	const uint32_t* values;
+	uint32_t* out;
+	const char* text; //values as the input file would have them
+	size_t textLen;
+	size_t n;
+	double bytes; //text one run reads or writes, for the MB/s column (0 = none)
+}BenchData;
+
+typedef struct{
+	const char* name;
+	void (*run)(const BenchData* data);
+	size_t maxN; //0 = no limit
+	bool text; //needs data->text
+}Bench;
+
+static volatile uint64_t sink; //keeps results from being optimized away
+
+static double nowNs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t rnd(uint64_t* state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+//every length from 1 to 10 digits: a random word shifted right by 0..31
+static void makeValues(uint32_t* values, size_t n)
+{
+	uint64_t state = 0x9e3779b97f4a7c15ull;
+	for(size_t i = 0; i < n; ++i){
+		uint64_t r = rnd(&state);
+		values[i] = (uint32_t)r >> (r >> 59); //shift 0..31
+	}
+}
+
+//--- benchmarks, one run over the dataset each ---
+
+static void benchBinaryMirror(const BenchData* d)
+{
+	uint32_t acc = 0;
+	for(size_t i = 0; i < d->n; ++i){
+		acc += BinaryMirror(d->values[i]);
+	}
+	sink += acc;
+}
+
+static void benchBinaryMirrorBatch(const BenchData* d)
+{
+	BinaryMirrorBatch(d->values, d->out, d->n);
+	sink += d->out[d->n - 1];
+}
+
+static void benchCountSequence(const BenchData* d)
+{
+	uint32_t acc = 0;
+	for(size_t i = 0; i < d->n; ++i){
+		acc += CountSequence(d->values[i]);
+	}
+	sink += acc;
+}
+
+static void benchCountSequenceBatch(const BenchData* d)
+{
+	CountSequenceBatch(d->values, d->out, d->n);
+	sink += d->out[d->n - 1];
+}
+
+static void benchDecToASCII(const BenchData* d)
+{
+	char str[11];
+	uint32_t acc = 0;
+	for(size_t i = 0; i < d->n; ++i){
+		decToASCII(d->values[i], str);
+		acc += (uint8_t)str[0];
+	}
+	sink += acc;
+}
+
+static void benchDecToBinArr(const BenchData* d)
+{
+	char str[33];
+	uint32_t acc = 0;
+	for(size_t i = 0; i < d->n; ++i){
+		decToBinArr(d->values[i], str);
+		acc += (uint8_t)str[31];
+	}
+	sink += acc;
+}
+
+static void benchInsertSorted(const BenchData* d)
+{
+	NodeArena* arena = createArena();
+	Node* head = NULL;
+	for(size_t i = 0; i < d->n; ++i){
+		Node* node = createNode(arena, d->values[i]);
+		if(!node){
+			perror("createNode");
+			exit(1);
+		}
+		insertSorted(&head, node);
+	}
+	sink += head ? head->mirror : 0;
+	freeArena(arena);
+}
+
+//the same inserts into the B+-tree index, then one walk over it in order
+static void benchIndexInsert(const BenchData* d)
+{
+	NodeArena* arena = createArena();
+	AsciiIndex* index = createIndex();
+	for(size_t i = 0; i < d->n; ++i){
+		Node* node = createNode(arena, d->values[i]);
+		if(!node || indexInsert(index, node) != 0){
+			perror("indexInsert");
+			exit(1);
+		}
+	}
+
+	IndexIter iter;
+	indexBegin(index, &iter);
+	uint32_t acc = 0;
+	for(Node* node; (node = indexNext(&iter)); ){
+		acc += node->mirror;
+	}
+	sink += acc;
+	freeIndex(index);
+	freeArena(arena);
+}
+
+static void benchSortByAscii(const BenchData* d)
+{
+	memcpy(d->out, d->values, d->n * sizeof(*d->out));
+	if(sortByAscii(d->out, d->n) != 0){
+		perror("sortByAscii");
+		exit(1);
+	}
+	sink += d->out[0];
+}
+
+//the text is the values one per line, 1 to 10 digits mixed (about 6 bytes a
+//number), so MB/s here is the low end: 10 digit numbers are nearly twice the
+//bytes for each one parsed
+static void benchParse(const BenchData* d)
+{
+	size_t used;
+	bool stop;
+	sink += parseUints(d->text, d->textLen, true, d->out, d->n, &used, &stop);
+}
+
+//"mirror\tcount\n" lines like the first section, to /dev/null
+static void benchOutput(const BenchData* d)
+{
+	OutBuf out;
+	if(outOpen(&out, "/dev/null") != 0){
+		perror("/dev/null");
+		exit(1);
+	}
+	for(size_t i = 0; i < d->n; ++i){
+		outU32(&out, d->values[i], '\t');
+		outU32(&out, d->out[i], '\n');
+	}
+	outClose(&out);
+}
+
+static const Bench benches[] = {
+	{"BinaryMirror", benchBinaryMirror, 0, false},
+	{"BinaryMirrorBatch", benchBinaryMirrorBatch, 0, false},
+	{"CountSequence", benchCountSequence, 0, false},
+	{"CountSequenceBatch", benchCountSequenceBatch, 0, false},
+	{"decToASCII", benchDecToASCII, 0, false},
+	{"decToBinArr", benchDecToBinArr, 0, false},
+	{"insertSorted", benchInsertSorted, BENCH_INSERT_MAX, false},
+	{"indexInsert", benchIndexInsert, 0, false},
+	{"sortByAscii", benchSortByAscii, 0, false},
+	{"parseUints", benchParse, 0, true},
+	{"output", benchOutput, 0, false},
+};
+
+static int cmpDouble(const void* a, const void* b)
+{
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+//times one benchmark on one dataset and prints its row
+static void measure(const Bench* bench, BenchData* data, int reps)
+{
+	bench->run(data); //warm-up (page faults, caches, the SIMD dispatch)
+
+	//loop small datasets so the clock's resolution doesn't matter
+	double start = nowNs();
+	bench->run(data);
+	double once = nowNs() - start;
+	int loops = once < BENCH_MIN_RUN_NS ? (int)(BENCH_MIN_RUN_NS / (once + 1)) + 1 : 1;
+
+	double* perValue = (double*)malloc(reps * sizeof(*perValue));
+	for(int r = 0; r < reps; ++r){
+		start = nowNs();
+		for(int l = 0; l < loops; ++l){
+			bench->run(data);
+		}
+		perValue[r] = (nowNs() - start) / ((double)loops * data->n);
+	}
+	qsort(perValue, reps, sizeof(*perValue), cmpDouble);
+
+	double median = reps % 2 ? perValue[reps / 2] : (perValue[reps / 2 - 1] + perValue[reps / 2]) / 2;
+	double lo = (perValue[0] - median) / median * 100;
+	double hi = (perValue[reps - 1] - median) / median * 100;
+
+	printf("%-20s %10zu %10.2f %+7.1f%% %+7.1f%% %10.1f", bench->name, data->n, median, lo, hi, 1e3 / median);
+	if(data->bytes > 0){
+		printf(" %10.1f", data->bytes / (median * data->n) * 1e3);
+	}
+	printf("\n");
+	fflush(stdout);
+	free(perValue);
+}
+
+int main(int argc, char* argv[])
+{
+	size_t maxN = 10000000;
+	int reps = 5;
+
+	int opt;
+	while((opt = getopt(argc, argv, "m:r:")) != -1){
+		if(opt == 'm' && atoll(optarg) >= 1000){
+			maxN = (size_t)atoll(optarg);
+		}else if(opt == 'r' && atoi(optarg) >= 1){
+			reps = atoi(optarg);
+		}else{
+			fprintf(stderr, "Usage: %s [-m max_values] [-r reps] [name]\n", argv[0]);
+			return 1;
+		}
+	}
+	const char* only = optind < argc ? argv[optind] : NULL;
+
+	uint32_t* values = (uint32_t*)malloc(maxN * sizeof(*values));
+	uint32_t* out = (uint32_t*)malloc(maxN * sizeof(*out));
+	char* text = (char*)malloc(maxN * 11 + 1); //10 digits + newline each
+	if(!values || !out || !text){
+		perror("Error allocating datasets");
+		return 1;
+	}
+	makeValues(values, maxN);
+
+	printf("%-20s %10s %10s %8s %8s %10s %10s\n", "function", "values", "ns/value", "min", "max", "Mvalues/s", "MB/s");
+
+	for(size_t b = 0; b < sizeof(benches) / sizeof(benches[0]); ++b){
+		const Bench* bench = &benches[b];
+		if(only && strcmp(only, bench->name) != 0){
+			continue;
+		}
+
+		for(size_t n = 1000; n <= maxN; n *= 10){
+			if(bench->maxN && n > bench->maxN){
+				break;
+			}
+
+			BenchData data;
+			memset(&data, 0, sizeof(data));
+			data.values = values;
+			data.out = out;
+			data.n = n;
+			if(bench->text){
+				char* p = text;
+				for(size_t i = 0; i < n; ++i){
+					p += formatU32(p, values[i]);
+					*p++ = '\n';
+				}
+				data.text = text;
+				data.textLen = (size_t)(p - text);
+				data.bytes = (double)data.textLen;
+			}
+
+			//output's counts get overwritten by the sorts, put them back
+			if(bench->run == benchOutput){
+				CountSequenceBatch(values, out, n);
+				char line[OUT_MAX_PUT];
+				for(size_t i = 0; i < n; ++i){
+					data.bytes += formatU32(line, values[i]) + formatU32(line, out[i]) + 2;
+				}
+			}
+			measure(bench, &data, reps);
+		}
+	}
+
+	free(values);
+	free(out);
+	free(text);
+	return 0;
+}
@@ -0,0 +1,135 @@
+// Noah Hathout
+// nhathout
+// bitpat.h
+
+#ifndef BITPAT_H
+#define BITPAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//counts a k-bit pattern in 8/16/32/64-bit words or in a stream of them.
+//BITPAT_DEFINE(name, type, bits, pattern, k) makes
+//
+//	unsigned name##Count(type x)			matches in x, overlapping
+//	unsigned name##CountNonOverlap(type x)		matches in x, each bit used once
+//	uint64_t name##StreamCount(const type* w, size_t n)
+//	uint64_t name##StreamCountNonOverlap(const type* w, size_t n)
+//
+//pattern is read like the binary string, so "010" is pattern 0x2 with k = 3, and
+//bit j of a word matches when bits j+k-1..j are the pattern. A stream is the words
+//in order, each one from its top bit down, and a match can span two words.
+//Non-overlapping is greedy in that reading order (the match read first wins).
+//
+//Everything is always_inline with constant pattern/k, so every instantiation
+//is its own unrolled shift/and/popcount kernel (1 <= k <= bits)
+
+#define BITPAT_INLINE static inline __attribute__((always_inline))
+
+//all ones in the low n bits, n = 0..64
+#define BITPAT_ONES(n) ((n) >= 64 ? ~0ull : ((1ull << (n)) - 1))
+
+//bits where a whole window fits in one word
+#define BITPAT_WINDOW_MASK(bits, k) BITPAT_ONES((bits) - (k) + 1)
+
+//bit j = the window ending at bit j matches, with the window's top bits taken
+//from the low bits of prev (prev = 0 and masking off the windows that don't
+//fit gives the single word case)
+BITPAT_INLINE uint64_t bitpatMatches(uint64_t x, uint64_t prev, int bits, uint64_t pattern, int k)
+{
+	uint64_t ones = BITPAT_ONES(bits);
+	uint64_t m = (pattern & 1) ? x : ~x;
+
+	#pragma GCC unroll 64
+	for(int b = 1; b < k; ++b){
+		uint64_t s = ((x >> b) | (prev << (bits - b))) & ones; //stream shifted by b
+		m &= ((pattern >> b) & 1) ? s : ~s;
+	}
+	return m & ones;
+}
+
+//can two matches share bits? (some proper suffix of the pattern is also a prefix)
+BITPAT_INLINE int bitpatSelfOverlaps(uint64_t pattern, int k)
+{
+	#pragma GCC unroll 64
+	for(int s = 1; s < k; ++s){
+		if((pattern >> s) == (pattern & BITPAT_ONES(k - s))){
+			return 1;
+		}
+	}
+	return 0;
+}
+
+//greedy pick from the top of m, the first *blocked top bits can't start a match
+//(the end of a match in the word before). Sets *blocked for the next word
+BITPAT_INLINE unsigned bitpatPick(uint64_t m, int bits, int k, int* blocked)
+{
+	unsigned count = 0;
+	int next = 0;
+
+	if(*blocked){
+		m &= BITPAT_ONES(bits - *blocked);
+	}
+	while(m){
+		int p = 63 - __builtin_clzll(m);
+		++count;
+		if(p >= k - 1){
+			m &= BITPAT_ONES(p - k + 1); //the next k-1 ends would reuse bits
+			next = 0;
+		}else{
+			m = 0;
+			next = k - 1 - p;
+		}
+	}
+	*blocked = next;
+	return count;
+}
+
+#define BITPAT_DEFINE(name, type, bits, pattern, k) \
+	BITPAT_INLINE unsigned name##Count(type x) \
+	{ \
+		uint64_t m = bitpatMatches((uint64_t)x, 0, (bits), (pattern), (k)); \
+		return (unsigned)__builtin_popcountll(m & BITPAT_WINDOW_MASK((bits), (k))); \
+	} \
+	\
+	BITPAT_INLINE unsigned name##CountNonOverlap(type x) \
+	{ \
+		if(!bitpatSelfOverlaps((pattern), (k))){ \
+			return name##Count(x); \
+		} \
+		int blocked = 0; \
+		uint64_t m = bitpatMatches((uint64_t)x, 0, (bits), (pattern), (k)); \
+		return bitpatPick(m & BITPAT_WINDOW_MASK((bits), (k)), (bits), (k), &blocked); \
+	} \
+	\
+	BITPAT_INLINE uint64_t name##StreamCount(const type* w, size_t n) \
+	{ \
+		if(n == 0){ \
+			return 0; \
+		} \
+		uint64_t count = name##Count(w[0]); /* nothing before the first word */ \
+		for(size_t i = 1; i < n; ++i){ \
+			count += (unsigned)__builtin_popcountll(bitpatMatches((uint64_t)w[i], (uint64_t)w[i - 1], (bits), (pattern), (k))); \
+		} \
+		return count; \
+	} \
+	\
+	BITPAT_INLINE uint64_t name##StreamCountNonOverlap(const type* w, size_t n) \
+	{ \
+		if(!bitpatSelfOverlaps((pattern), (k))){ \
+			return name##StreamCount(w, n); \
+		} \
+		if(n == 0){ \
+			return 0; \
+		} \
+		int blocked = 0; \
+		uint64_t m = bitpatMatches((uint64_t)w[0], 0, (bits), (pattern), (k)); \
+		uint64_t count = bitpatPick(m & BITPAT_WINDOW_MASK((bits), (k)), (bits), (k), &blocked); \
+		for(size_t i = 1; i < n; ++i){ \
+			m = bitpatMatches((uint64_t)w[i], (uint64_t)w[i - 1], (bits), (pattern), (k)); \
+			count += bitpatPick(m, (bits), (k), &blocked); \
+		} \
+		return count; \
+	}
+
+#endif
@@ -4,6 +4,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <immintrin.h>
+
+#include "bits.h"
+#include "bitpat.h"
 
 // function to convert decimal to binary
 // from class 09/10/2025 edited to handle larger numbers (more digits)
@@ -58,56 +62,209 @@ unsigned int binaryToDecimal(unsigned int n) {
 //The above functions are no longer used in my second attempt but I will keep them to show my thought process
 //The above was my first attempt, until I realized C stores all integers as binary (bits) already.
 //
-//Second attempt I outlined in the Hw1-535.pdf included in the .zip
+//Second attempt I outlined in the Hw1-535.pdf included in the .zip moved the
+//bits over one at a time in a 32 step loop. Third attempt: no loop and no branches,
+//bswap puts the bytes in mirrored order, then the bits inside every byte are
+//mirrored by swapping the two nibbles, the bit pairs in each nibble and the
+//bits in each pair (all 4 bytes at once with masks)
 unsigned int BinaryMirror(unsigned int n)
 {
-	unsigned int binMirror = 0;
+	n = __builtin_bswap32(n);
+	n = ((n >> 4) & 0x0f0f0f0fu) | ((n & 0x0f0f0f0fu) << 4);
+	n = ((n >> 2) & 0x33333333u) | ((n & 0x33333333u) << 2);
+	n = ((n >> 1) & 0x55555555u) | ((n & 0x55555555u) << 1);
+
+	return n;
+}
 
-	for(int i = 0; i < 32; ++i) //uses i = i + 1 
-	{
-		unsigned int lastBit = n & 1;
+//count '010's
+//this used to walk the 32 bits MSB first through a 3 state state machine
+//(0 = nothing yet, 1 = just saw a 0, 2 = just saw 01, a 0 in state 2 counts
+//and goes back to state 1 so matches can overlap). That is the same as counting
+//every window of 3 neighboring bits that reads 010, so it can be done for all
+//30 windows at once: bit j of the mask is set when bit j+2 is 0, bit j+1 is 1
+//and bit j is 0. Bits 30 and 31 would need bits past the top of the word, so
+//they are masked off. bitpat.h builds that kernel for any pattern, 010 on 32
+//bits is just one instantiation (the batch versions below are still hand written)
+BITPAT_DEFINE(seq010, uint32_t, 32, 0x2, 3)
 
-		binMirror <<= 1;
-		if(lastBit == 1){
-			binMirror += 1;
-		}
+unsigned int CountSequence(unsigned int n)
+{
+	return seq010Count(n);
+}
 
-		n >>= 1;
+//batch versions, same math on 8 or 16 words per instruction
+//
+//AVX2 doesn't have a popcount instruction so it looks up the bit count of every
+//nibble with pshufb and adds the 4 bytes of each word together
+__attribute__((target("avx2")))
+static void countSequenceAvx2(const uint32_t* in, uint32_t* out, size_t n)
+{
+	const __m256i windowMask = _mm256_set1_epi32((int)SEQ_WINDOW_MASK);
+	const __m256i lowNibble = _mm256_set1_epi8(0x0f);
+	const __m256i nibbleCount = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+						      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i ones16 = _mm256_set1_epi16(1);
+	size_t i = 0;
+
+	for(; i + 8 <= n; i += 8){
+		__m256i x = _mm256_loadu_si256((const __m256i*)(in + i));
+		__m256i w = _mm256_andnot_si256(x, _mm256_srli_epi32(x, 1));
+		w = _mm256_andnot_si256(_mm256_srli_epi32(x, 2), w);
+		w = _mm256_and_si256(w, windowMask);
+
+		__m256i lo = _mm256_shuffle_epi8(nibbleCount, _mm256_and_si256(w, lowNibble));
+		__m256i hi = _mm256_shuffle_epi8(nibbleCount, _mm256_and_si256(_mm256_srli_epi16(w, 4), lowNibble));
+		__m256i bytes = _mm256_add_epi8(lo, hi); //bit count of every byte
+
+		__m256i pairs = _mm256_maddubs_epi16(bytes, _mm256_set1_epi8(1)); //byte pairs -> 16 bits
+		__m256i words = _mm256_madd_epi16(pairs, ones16); //16-bit pairs -> 32 bits
+		_mm256_storeu_si256((__m256i*)(out + i), words);
+	}
+
+	for(; i < n; ++i){
+		out[i] = CountSequence(in[i]);
 	}
-	return binMirror;
 }
 
-//count '010's (3 state state machine)
-unsigned int CountSequence(unsigned int n)
+//AVX-512 with VPOPCNTDQ has a per-word popcount, so it's 5 instructions for 16 words
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static void countSequenceAvx512(const uint32_t* in, uint32_t* out, size_t n)
+{
+	const __m512i windowMask = _mm512_set1_epi32((int)SEQ_WINDOW_MASK);
+	size_t i = 0;
+
+	for(; i + 16 <= n; i += 16){
+		__m512i x = _mm512_loadu_si512((const void*)(in + i));
+		//0x04 is the truth table of ~a & b & ~c (only a=0 b=1 c=0) for a = x, b = x >> 1, c = x >> 2
+		__m512i w = _mm512_ternarylogic_epi32(x, _mm512_srli_epi32(x, 1), _mm512_srli_epi32(x, 2), 0x04);
+		w = _mm512_and_si512(w, windowMask);
+		_mm512_storeu_si512((void*)(out + i), _mm512_popcnt_epi32(w));
+	}
+
+	//the tail goes through a mask instead of the scalar loop
+	if(i < n){
+		__mmask16 tail = (__mmask16)((1u << (n - i)) - 1);
+		__m512i x = _mm512_maskz_loadu_epi32(tail, (const void*)(in + i));
+		__m512i w = _mm512_ternarylogic_epi32(x, _mm512_srli_epi32(x, 1), _mm512_srli_epi32(x, 2), 0x04);
+		w = _mm512_and_si512(w, windowMask);
+		_mm512_mask_storeu_epi32((void*)(out + i), tail, _mm512_popcnt_epi32(w));
+	}
+}
+
+static void countSequenceScalar(const uint32_t* in, uint32_t* out, size_t n)
+{
+	for(size_t i = 0; i < n; ++i){
+		out[i] = CountSequence(in[i]);
+	}
+}
+
+//picked the first time CountSequenceBatch is called, by what the CPU running it has
+static void countSequenceDispatch(const uint32_t* in, uint32_t* out, size_t n);
+static void (*countSequenceImpl)(const uint32_t*, uint32_t*, size_t) = countSequenceDispatch;
+
+static void countSequenceDispatch(const uint32_t* in, uint32_t* out, size_t n)
+{
+	void (*chosen)(const uint32_t*, uint32_t*, size_t);
+
+	__builtin_cpu_init();
+
+	if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq")){
+		chosen = countSequenceAvx512;
+	}else if(__builtin_cpu_supports("avx2")){
+		chosen = countSequenceAvx2;
+	}else{
+		chosen = countSequenceScalar;
+	}
+
+	__atomic_store_n(&countSequenceImpl, chosen, __ATOMIC_RELAXED); //threads can get here at the same time, they all pick the same one
+	chosen(in, out, n);
+}
+
+void CountSequenceBatch(const uint32_t* in, uint32_t* out, size_t n)
+{
+	__atomic_load_n(&countSequenceImpl, __ATOMIC_RELAXED)(in, out, n);
+}
+
+//batch BinaryMirror, pshufb does the byte swap and uses a 16 entry table of
+//mirrored nibbles: each byte becomes mirror(low nibble) << 4 | mirror(high nibble)
+#define MIRROR_NIBBLES 0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe, 0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf
+#define MIRROR_BSWAP 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+
+__attribute__((target("avx2")))
+static void binaryMirrorAvx2(const uint32_t* in, uint32_t* out, size_t n)
+{
+	const __m256i lowNibble = _mm256_set1_epi8(0x0f);
+	const __m256i mirrorLo = _mm256_setr_epi8(MIRROR_NIBBLES, MIRROR_NIBBLES); //mirror(x) for the low nibble, stays low
+	const __m256i bswap = _mm256_setr_epi8(MIRROR_BSWAP, MIRROR_BSWAP);
+	const __m256i mirrorHi = _mm256_slli_epi16(mirrorLo, 4); //mirror(x) << 4, for the low nibble going high
+	size_t i = 0;
+
+	for(; i + 8 <= n; i += 8){
+		__m256i x = _mm256_loadu_si256((const __m256i*)(in + i));
+		x = _mm256_shuffle_epi8(x, bswap);
+
+		__m256i lo = _mm256_shuffle_epi8(mirrorHi, _mm256_and_si256(x, lowNibble));
+		__m256i hi = _mm256_shuffle_epi8(mirrorLo, _mm256_and_si256(_mm256_srli_epi16(x, 4), lowNibble));
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_or_si256(lo, hi));
+	}
+
+	for(; i < n; ++i){
+		out[i] = BinaryMirror(in[i]);
+	}
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void binaryMirrorAvx512(const uint32_t* in, uint32_t* out, size_t n)
 {
-	unsigned int count = 0;
-	int state = 0;
-
-	for(int i = 31; i >= 0; --i){
-		unsigned int bit = (n >> i) & 1; //get most significant bit
-
-		if(state == 0){
-			if(bit == 0){
-				state = 1;
-			}else{
-				state = 0;
-			}
-		}else if(state == 1){
-			if(bit == 1){
-				state = 2;
-			}else{
-				state = 1;
-			}
-		}else if(state == 2){
-			if(bit == 0){
-				++count;
-				state = 1;
-			}else{
-				state = 0;
-			}
-		}
+	const __m512i lowNibble = _mm512_set1_epi8(0x0f);
+	const __m512i mirrorLo = _mm512_broadcast_i32x4(_mm_setr_epi8(MIRROR_NIBBLES));
+	const __m512i bswap = _mm512_broadcast_i32x4(_mm_setr_epi8(MIRROR_BSWAP));
+	const __m512i mirrorHi = _mm512_slli_epi16(mirrorLo, 4);
+	size_t i = 0;
+
+	for(; i < n; i += 16){
+		//the tail goes through a mask instead of the scalar loop
+		__mmask16 words = n - i >= 16 ? (__mmask16)0xffff : (__mmask16)((1u << (n - i)) - 1);
+		__m512i x = _mm512_maskz_loadu_epi32(words, (const void*)(in + i));
+		x = _mm512_shuffle_epi8(x, bswap);
+
+		__m512i lo = _mm512_shuffle_epi8(mirrorHi, _mm512_and_si512(x, lowNibble));
+		__m512i hi = _mm512_shuffle_epi8(mirrorLo, _mm512_and_si512(_mm512_srli_epi16(x, 4), lowNibble));
+		_mm512_mask_storeu_epi32((void*)(out + i), words, _mm512_or_si512(lo, hi));
+	}
+}
+
+static void binaryMirrorScalar(const uint32_t* in, uint32_t* out, size_t n)
+{
+	for(size_t i = 0; i < n; ++i){
+		out[i] = BinaryMirror(in[i]);
 	}
+}
 
-	return count;
+//same first call dispatch as CountSequenceBatch
+static void binaryMirrorDispatch(const uint32_t* in, uint32_t* out, size_t n);
+static void (*binaryMirrorImpl)(const uint32_t*, uint32_t*, size_t) = binaryMirrorDispatch;
 
+static void binaryMirrorDispatch(const uint32_t* in, uint32_t* out, size_t n)
+{
+	void (*chosen)(const uint32_t*, uint32_t*, size_t);
+
+	__builtin_cpu_init();
+
+	if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")){
+		chosen = binaryMirrorAvx512;
+	}else if(__builtin_cpu_supports("avx2")){
+		chosen = binaryMirrorAvx2;
+	}else{
+		chosen = binaryMirrorScalar;
+	}
+
+	__atomic_store_n(&binaryMirrorImpl, chosen, __ATOMIC_RELAXED); //atomic for the same reason as above
+	chosen(in, out, n);
+}
+
+void BinaryMirrorBatch(const uint32_t* in, uint32_t* out, size_t n)
+{
+	__atomic_load_n(&binaryMirrorImpl, __ATOMIC_RELAXED)(in, out, n);
 }
@@ -4,6 +4,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 #ifndef BITS_H
 #define BITS_H
@@ -11,4 +12,15 @@
 unsigned int BinaryMirror(unsigned int);
 unsigned int CountSequence(unsigned int);
 
+//out[i] = BinaryMirror(in[i]) for n words, uses AVX-512 or AVX2 when the CPU has them
+//(in and out can be the same array, same for CountSequenceBatch)
+void BinaryMirrorBatch(const uint32_t* in, uint32_t* out, size_t n);
+
+//the windows of 3 bits that fit in a word, bit j = bits j+2..j
+//(BITPAT_WINDOW_MASK(32, 3) in bitpat.h)
+#define SEQ_WINDOW_MASK 0x3fffffffu
+
+//out[i] = CountSequence(in[i]) for n words, uses AVX-512 or AVX2 when the CPU has them
+void CountSequenceBatch(const uint32_t* in, uint32_t* out, size_t n);
+
 #endif
@@ -4,57 +4,125 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
 #include "bits.h"
 #include "mylist.h"
+#include "parse.h"
+#include "output.h"
+#include "pipeline.h"
+#include "stream.h"
+
+//--mem size: bytes, or with a K, M or G suffix. 0 if it isn't one
+static size_t parseMem(const char* arg)
+{
+	char* end;
+	unsigned long long size = strtoull(arg, &end, 10);
+	if(end == arg || arg[0] == '-'){
+		return 0;
+	}
+
+	int shift = 0;
+	switch(*end){
+		case 'K': case 'k': shift = 10; ++end; break;
+		case 'M': case 'm': shift = 20; ++end; break;
+		case 'G': case 'g': shift = 30; ++end; break;
+	}
+	if(*end != '\0' || size > (SIZE_MAX >> shift)){
+		return 0;
+	}
+	return (size_t)size << shift;
+}
 
 int main(int argc, char* argv[])
 {
-	if(argc != 3){
-		fprintf(stderr, "Usage: %s <input.txt> <output.txt>\n", argv[0]); //error checking for incorrect run command
+	int threads = 0; //-j: threads for both sections (1 if not given)
+	size_t mem = 0; //--mem: stream the input with at most about this much memory
+
+	static const struct option longOpts[] = {
+		{"mem", required_argument, NULL, 'm'},
+		{NULL, 0, NULL, 0}
+	};
+
+	int opt;
+	while((opt = getopt_long(argc, argv, "j:", longOpts, NULL)) != -1){
+		if(opt == 'j' && atoi(optarg) >= 1 && atoi(optarg) <= PIPE_MAX_THREADS){
+			threads = atoi(optarg);
+		}else if(opt == 'm' && parseMem(optarg) >= STREAM_MIN_MEM){
+			mem = parseMem(optarg);
+		}else{
+			argc = 0; //prints the usage below
+			break;
+		}
+	}
+
+	//streaming is one pass on one thread, the two don't mix
+	if(argc - optind != 2 || (mem && threads)){
+		fprintf(stderr, "Usage: %s [-j threads | --mem size] <input.txt> <output.txt>\n", argv[0]); //error checking for incorrect run command
 		return 1;
 	}
+	if(!threads){
+		threads = 1;
+	}
+
+	const char* input_path = argv[optind];
+	const char* output_path = argv[optind + 1];
 
-	const char* input_path = argv[1];
-	const char* output_path = argv[2];
+	if(mem){
+		OutBuf output;
+		if(outOpen(&output, output_path) != 0){ //overwrites/cleans
+			perror("Error opening output file");
+			return 1;
+		}
+		if(streamSections(input_path, &output, mem) != 0){
+			perror("Error streaming input file");
+			return 1;
+		}
+		if(outClose(&output) != 0){
+			perror("Error writing output file");
+			return 1;
+		}
+		return 0;
+	}
 
-	FILE *input;
-	input = fopen(input_path, "r"); //read
-       	if(!input){
+	//the whole input is parsed once into an array both sections use
+	uint32_t* values;
+	size_t count;
+	if(readValues(input_path, &values, &count) != 0){
 		perror("Error opening input file");
 		return 1;
 	}
 
-	FILE *output;
-	output = fopen(output_path, "w"); //overwrites/cleans
-	if(!output){
+	OutBuf output;
+	if(outOpen(&output, output_path) != 0){ //overwrites/cleans
 		perror("Error opening output file");
 		return 1;
 	}
 
-	unsigned int num;
-	while(fscanf(input, "%u", &num) == 1){ //while unsigned int exists (also is stored in num)
-		unsigned int binMirror = BinaryMirror(num);
-		unsigned int count = CountSequence(num);
+	uint32_t* mirrors = (uint32_t*)malloc((count ? count : 1) * sizeof(*mirrors));
+	if(!mirrors){
+		perror("Error allocating values");
+		return 1;
+	}
 
-		fprintf(output, "%u\t%u\n", binMirror, count); //print to output file with tab in the middle
+	//"mirror\tcount" lines, a blank line, then the mirrors sorted the way
+	//insertSorted() orders them (as decimal strings)
+	if(writeMirrorSection(&output, values, mirrors, count, threads) != 0){
+		perror("Error writing output file");
+		return 1;
+	}
+	outChar(&output, '\n');
+	if(writeSortedSection(&output, mirrors, count, threads) != 0){
+		perror("Error writing output file");
+		return 1;
 	}
 
-	fprintf(output, "\n");
-	
-	//to rewind the input file, credit: https://www.geeksforgeeks.org/c/rewind-in-c/
-	rewind(input);
+	free(values);
+	free(mirrors);
 
-	Node* head = NULL;
-	unsigned int num2;
-	while(fscanf(input, "%u", &num2) == 1){
-		Node *node = createNode(num2);
-		insertSorted(&head, node);
+	if(outClose(&output) != 0){
+		perror("Error writing output file");
+		return 1;
 	}
-
-	printListToFile(output, head);
-	freeList(head);
-	
-	fclose(input);
-	fclose(output);
-	return 0;	
+	return 0;
 }
@@ -0,0 +1,341 @@
+// Noah Hathout
+// nhathout
+// myindex.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "myindex.h"
+
+//a split leaves both halves with at least FANOUT / 2 keys/children, so every
+//level multiplies the count by at least 2^INDEX_LEVEL_BITS (log2 of that,
+//rounded down). 64 bits of count then can't need more than 64 / bits levels:
+//13 for the default fanout of 64, 64 for a fanout of 4
+_Static_assert(INDEX_FANOUT >= 4, "INDEX_FANOUT has to be at least 4");
+
+#define INDEX_HALF (INDEX_FANOUT / 2)
+#define INDEX_LEVEL_BITS (INDEX_HALF >= 64 ? 6 : INDEX_HALF >= 32 ? 5 : INDEX_HALF >= 16 ? 4 : \
+	INDEX_HALF >= 8 ? 3 : INDEX_HALF >= 4 ? 2 : 1)
+#define INDEX_MAX_HEIGHT (64 / INDEX_LEVEL_BITS + 1)
+
+#define INDEX_NO_END UINT64_MAX //bigger than any asciiKey()
+
+struct IndexLeaf{
+	int count;
+	uint64_t keys[INDEX_FANOUT];
+	Node* nodes[INDEX_FANOUT];
+	struct IndexLeaf* next; //the leaf with the next keys, NULL for the last one
+};
+
+//children[i] only has keys between keys[i - 1] and keys[i] (equal ones included,
+//a run of the same mirror can be split over two leaves)
+typedef struct{
+	int count; //children
+	uint64_t keys[INDEX_FANOUT - 1];
+	void* children[INDEX_FANOUT];
+}IndexInner;
+
+struct AsciiIndex{
+	void* root; //a leaf if height is 0
+	int height; //inner levels above the leaves
+	size_t size;
+	IndexLeaf* first;
+};
+
+//how many keys are <= key (upper) or < key (lower), binary search
+static int upperBound(const uint64_t* keys, int n, uint64_t key)
+{
+	int lo = 0;
+	while(n > 0){
+		int half = n / 2;
+		if(keys[lo + half] <= key){
+			lo += half + 1;
+			n -= half + 1;
+		}else{
+			n = half;
+		}
+	}
+	return lo;
+}
+
+static int lowerBound(const uint64_t* keys, int n, uint64_t key)
+{
+	int lo = 0;
+	while(n > 0){
+		int half = n / 2;
+		if(keys[lo + half] < key){
+			lo += half + 1;
+			n -= half + 1;
+		}else{
+			n = half;
+		}
+	}
+	return lo;
+}
+
+AsciiIndex* createIndex(void)
+{
+	AsciiIndex* index = (AsciiIndex*)calloc(1, sizeof(*index));
+	IndexLeaf* leaf = (IndexLeaf*)calloc(1, sizeof(*leaf));
+	if(!index || !leaf){
+		free(index);
+		free(leaf);
+		return NULL;
+	}
+
+	index->root = leaf;
+	index->first = leaf;
+	return index;
+}
+
+//inserts at slot, shifting the rest up (the arrays have room for one more)
+static void leafPut(IndexLeaf* leaf, int pos, uint64_t key, Node* node)
+{
+	memmove(&leaf->keys[pos + 1], &leaf->keys[pos], (leaf->count - pos) * sizeof(*leaf->keys));
+	memmove(&leaf->nodes[pos + 1], &leaf->nodes[pos], (leaf->count - pos) * sizeof(*leaf->nodes));
+	leaf->keys[pos] = key;
+	leaf->nodes[pos] = node;
+	leaf->count++;
+}
+
+//key + the child right of it go in at children[slot + 1]
+static void innerPut(IndexInner* inner, int slot, uint64_t key, void* child)
+{
+	memmove(&inner->keys[slot + 1], &inner->keys[slot], (inner->count - 1 - slot) * sizeof(*inner->keys));
+	memmove(&inner->children[slot + 2], &inner->children[slot + 1], (inner->count - 1 - slot) * sizeof(*inner->children));
+	inner->keys[slot] = key;
+	inner->children[slot + 1] = child;
+	inner->count++;
+}
+
+int indexInsert(AsciiIndex* index, Node* node)
+{
+	uint64_t key = asciiKey(node->mirror);
+
+	//down to the leaf, after any equal keys so equal mirrors keep their order
+	IndexInner* path[INDEX_MAX_HEIGHT];
+	int slots[INDEX_MAX_HEIGHT];
+	void* curr = index->root;
+	for(int level = 0; level < index->height; ++level){
+		IndexInner* inner = (IndexInner*)curr;
+		path[level] = inner;
+		slots[level] = upperBound(inner->keys, inner->count - 1, key);
+		curr = inner->children[slots[level]];
+	}
+	IndexLeaf* leaf = (IndexLeaf*)curr;
+	int pos = upperBound(leaf->keys, leaf->count, key);
+
+	if(leaf->count < INDEX_FANOUT){
+		leafPut(leaf, pos, key, node);
+		index->size++;
+		return 0;
+	}
+
+	//full: every full node on the way up splits, so get their new halves (and a
+	//new root if it goes all the way up) first, a failed malloc then changes nothing
+	int splits = 1;
+	while(splits <= index->height && path[index->height - splits]->count == INDEX_FANOUT){
+		++splits;
+	}
+	if(splits > index->height && index->height == INDEX_MAX_HEIGHT){
+		return -1; //can't happen with a real count of nodes, but path[] ends here
+	}
+	void* fresh[INDEX_MAX_HEIGHT + 1]; //fresh[0] the leaf, then one per level up
+	int need = splits + (splits > index->height);
+	for(int i = 0; i < need; ++i){
+		fresh[i] = malloc(i == 0 ? sizeof(IndexLeaf) : sizeof(IndexInner));
+		if(!fresh[i]){
+			while(i-- > 0){
+				free(fresh[i]);
+			}
+			return -1;
+		}
+	}
+	index->size++;
+
+	//leaf: the top half moves to a new leaf right of it
+	IndexLeaf* right = (IndexLeaf*)fresh[0];
+	int half = INDEX_FANOUT / 2;
+	right->count = INDEX_FANOUT - half;
+	memcpy(right->keys, &leaf->keys[half], right->count * sizeof(*right->keys));
+	memcpy(right->nodes, &leaf->nodes[half], right->count * sizeof(*right->nodes));
+	right->next = leaf->next;
+	leaf->next = right;
+	leaf->count = half;
+	if(pos <= half){
+		leafPut(leaf, pos, key, node);
+	}else{
+		leafPut(right, pos - half, key, node);
+	}
+
+	uint64_t upKey = right->keys[0];
+	void* upChild = right;
+
+	//then up the path until a node has room
+	for(int level = index->height - 1; level >= 0; --level){
+		IndexInner* inner = path[level];
+		int slot = slots[level];
+		if(inner->count < INDEX_FANOUT){
+			innerPut(inner, slot, upKey, upChild);
+			return 0;
+		}
+
+		//all FANOUT + 1 children in order, then the top half goes right and the
+		//key between the halves goes up
+		uint64_t keys[INDEX_FANOUT];
+		void* children[INDEX_FANOUT + 1];
+		memcpy(keys, inner->keys, slot * sizeof(*keys));
+		keys[slot] = upKey;
+		memcpy(&keys[slot + 1], &inner->keys[slot], (INDEX_FANOUT - 1 - slot) * sizeof(*keys));
+		memcpy(children, inner->children, (slot + 1) * sizeof(*children));
+		children[slot + 1] = upChild;
+		memcpy(&children[slot + 2], &inner->children[slot + 1], (INDEX_FANOUT - 1 - slot) * sizeof(*children));
+
+		IndexInner* split = (IndexInner*)fresh[index->height - level];
+		int leftCount = (INDEX_FANOUT + 1) / 2;
+		inner->count = leftCount;
+		memcpy(inner->keys, keys, (leftCount - 1) * sizeof(*keys));
+		memcpy(inner->children, children, leftCount * sizeof(*children));
+
+		split->count = INDEX_FANOUT + 1 - leftCount;
+		memcpy(split->keys, &keys[leftCount], (split->count - 1) * sizeof(*keys));
+		memcpy(split->children, &children[leftCount], split->count * sizeof(*children));
+
+		upKey = keys[leftCount - 1];
+		upChild = split;
+	}
+
+	//the root split too, a new one goes on top
+	IndexInner* root = (IndexInner*)fresh[need - 1];
+	root->count = 2;
+	root->keys[0] = upKey;
+	root->children[0] = index->root;
+	root->children[1] = upChild;
+	index->root = root;
+	index->height++;
+	return 0;
+}
+
+size_t indexSize(const AsciiIndex* index)
+{
+	return index->size;
+}
+
+//iter at the first key >= key
+static void indexSeek(const AsciiIndex* index, uint64_t key, uint64_t end, IndexIter* iter)
+{
+	const void* curr = index->root;
+	for(int level = 0; level < index->height; ++level){
+		const IndexInner* inner = (const IndexInner*)curr;
+		curr = inner->children[lowerBound(inner->keys, inner->count - 1, key)];
+	}
+
+	const IndexLeaf* leaf = (const IndexLeaf*)curr;
+	iter->leaf = leaf;
+	iter->pos = lowerBound(leaf->keys, leaf->count, key);
+	iter->end = end;
+}
+
+void indexBegin(const AsciiIndex* index, IndexIter* iter)
+{
+	iter->leaf = index->first;
+	iter->pos = 0;
+	iter->end = INDEX_NO_END;
+}
+
+//the key a digit string would have if it were an ascii (asciiKey() layout:
+//digits left-aligned to 10 places, then the length). Compares the same as strcmp()
+//for any strings of 0 to 10 digits, leading zeros too
+static int stringKey(const char* s, uint64_t* key)
+{
+	uint64_t value = 0;
+	int digits = 0;
+	for(; s[digits]; ++digits){
+		if(digits == 10 || s[digits] < '0' || s[digits] > '9'){
+			return -1;
+		}
+		value = value * 10 + (uint64_t)(s[digits] - '0');
+	}
+	for(int i = digits; i < 10; ++i){
+		value *= 10;
+	}
+
+	*key = value << 4 | (uint64_t)digits;
+	return 0;
+}
+
+int indexRange(const AsciiIndex* index, const char* lo, const char* hi, IndexIter* iter)
+{
+	uint64_t loKey = 0;
+	uint64_t hiKey = INDEX_NO_END;
+	if((lo && stringKey(lo, &loKey) != 0) || (hi && stringKey(hi, &hiKey) != 0)){
+		return -1;
+	}
+
+	indexSeek(index, loKey, hiKey, iter);
+	return 0;
+}
+
+int indexPrefix(const AsciiIndex* index, const char* prefix, IndexIter* iter)
+{
+	uint64_t loKey;
+	if(stringKey(prefix, &loKey) != 0){
+		return -1;
+	}
+
+	//everything starting with prefix sorts before the next string that doesn't:
+	//the last digit that isn't a 9 goes up by one and the rest is cut off
+	//("129" -> "13"). Nothing comes after all 9s
+	char next[11];
+	int len = (int)strlen(prefix);
+	while(len > 0 && prefix[len - 1] == '9'){
+		--len;
+	}
+
+	uint64_t hiKey = INDEX_NO_END;
+	if(len > 0){
+		memcpy(next, prefix, len);
+		next[len - 1]++;
+		next[len] = '\0';
+		stringKey(next, &hiKey);
+	}
+
+	indexSeek(index, loKey, hiKey, iter);
+	return 0;
+}
+
+Node* indexNext(IndexIter* iter)
+{
+	while(iter->leaf && iter->pos >= iter->leaf->count){
+		iter->leaf = iter->leaf->next;
+		iter->pos = 0;
+	}
+	if(!iter->leaf || iter->leaf->keys[iter->pos] >= iter->end){
+		iter->leaf = NULL;
+		return NULL;
+	}
+
+	return iter->leaf->nodes[iter->pos++];
+}
+
+static void freeLevel(void* node, int height)
+{
+	if(height > 0){
+		IndexInner* inner = (IndexInner*)node;
+		for(int i = 0; i < inner->count; ++i){
+			freeLevel(inner->children[i], height - 1);
+		}
+	}
+	free(node);
+}
+
+void freeIndex(AsciiIndex* index)
+{
+	if(!index){
+		return;
+	}
+
+	freeLevel(index->root, index->height);
+	free(index);
+}
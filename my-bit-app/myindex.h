@@ -0,0 +1,57 @@
+// Noah Hathout
+// nhathout
+// myindex.h
+
+#ifndef MYINDEX_H
+#define MYINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mylist.h"
+
+//ordered index of Nodes for when values keep coming in and the order has to be
+//printed or searched in between: a B+-tree on asciiKey() of the mirror (the same
+//order as insertSorted()/cmpNodes(), equal mirrors stay in the order they were
+//added). Wide nodes (INDEX_FANOUT keys, a few cache lines of keys each) keep it
+//shallow, insert is O(log n) instead of insertSorted()'s walk down the list,
+//and the leaves are linked so walking the order is a scan over arrays.
+//
+//The index only points at the Nodes, they still belong to their arena.
+//"make check" also builds it with a fanout of 4 so small tests get a deep tree
+#ifndef INDEX_FANOUT
+#define INDEX_FANOUT 64
+#endif
+
+typedef struct AsciiIndex AsciiIndex;
+typedef struct IndexLeaf IndexLeaf;
+
+//walks the index in order from where indexBegin()/indexRange()/indexPrefix()
+//put it. Inserting into the index invalidates it
+typedef struct{
+	const IndexLeaf* leaf;
+	int pos;
+	uint64_t end; //stops at the first key >= end
+}IndexIter;
+
+AsciiIndex* createIndex(void); //NULL if it can't be allocated
+
+int indexInsert(AsciiIndex* index, Node* node); //-1 if the index can't grow (node isn't added)
+
+size_t indexSize(const AsciiIndex* index);
+
+void indexBegin(const AsciiIndex* index, IndexIter* iter); //every node
+
+//nodes whose ascii (decToASCII() of the mirror) is >= lo and < hi in strcmp()
+//order. lo/hi are digit strings of up to 10 digits, NULL for no bound.
+//-1 if a bound isn't one
+int indexRange(const AsciiIndex* index, const char* lo, const char* hi, IndexIter* iter);
+
+//nodes whose ascii starts with prefix (up to 10 digits, "" is every node)
+int indexPrefix(const AsciiIndex* index, const char* prefix, IndexIter* iter);
+
+Node* indexNext(IndexIter* iter); //next node in order, NULL at the end
+
+void freeIndex(AsciiIndex* index); //the tree only, not the nodes
+
+#endif
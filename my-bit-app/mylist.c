@@ -5,74 +5,113 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <emmintrin.h>
 
 #include "mylist.h"
 #include "bits.h"
+#include "output.h"
 
-void decToBinArr(unsigned int num, char output[33])
+//the 32 bits as '0'/'1' bytes, 16 at a time with SSE2 (every x86-64 has it):
+//each byte of the result gets a copy of the byte its bit is in, the mask picks
+//that bit out, cmpeq makes it 0 or -1 and '0' - -1 is '1'
+static inline void binChars(uint32_t num, char* output)
 {
-	for(int i = 31; i >= 0; --i){
-		output[31-i] = ((num >> i) & 1) ? '1' : '0'; //same concept as decToBinary function in bits.c but void and working with an array
-	}
+	const __m128i bit = _mm_setr_epi8((char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+					  (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+	const __m128i zeros = _mm_set1_epi8('0');
+
+	__m128i v = _mm_cvtsi32_si128((int)__builtin_bswap32(num)); //top byte first
+	v = _mm_unpacklo_epi8(v, v);
+	v = _mm_unpacklo_epi16(v, v); //every byte 4 times
+	__m128i top = _mm_unpacklo_epi32(v, v); //bits 31..16, every byte 8 times
+	__m128i bottom = _mm_unpackhi_epi32(v, v); //bits 15..0
+
+	top = _mm_cmpeq_epi8(_mm_and_si128(top, bit), bit);
+	bottom = _mm_cmpeq_epi8(_mm_and_si128(bottom, bit), bit);
+	_mm_storeu_si128((__m128i*)output, _mm_sub_epi8(zeros, top));
+	_mm_storeu_si128((__m128i*)(output + 16), _mm_sub_epi8(zeros, bottom));
+}
 
+void decToBinArr(unsigned int num, char output[33])
+{
+	binChars(num, output); //same concept as decToBinary function in bits.c but void and working with an array
 	output[32] = '\0'; //null terminator
 }
 
 //convert to decimal string which can be used in strcmp()
+//(the digit count comes first so the digits go straight to their place, two at a
+//time, instead of % 10 into a temp and reversing it; formatU32() in output.c)
 void decToASCII(unsigned int num, char output[11])
 {
-	if(num == 0){ //edge-case (num is 0 so just fill output with '0' and null terminator
-		output[0] = '0';
-		output[1] = '\0';
-	}else{
-		char temp[11];
-		int count = 0;
-
-		while(num > 0){
-			unsigned int currBit = num % 10;
-			temp[count] = (char)('0' + currBit);
-			count++;
-			num /= 10;
-		}
+	output[formatU32(output, num)] = '\0';
+}
 
-		//reverse into output[] to match input num
-		for(int i = 0; i < count; ++i){
-			output[i] = temp[count - 1 - i];
-		}
+//blocks start at ARENA_FIRST nodes and double, so a big list is a few dozen mallocs
+#define ARENA_FIRST 1024
 
-		output[count] = '\0';
-	}
+typedef struct ArenaBlock{
+	struct ArenaBlock* next;
+	size_t used;
+	size_t size;
+	Node nodes[];
+}ArenaBlock;
+
+struct NodeArena{
+	ArenaBlock* blocks; //newest first, that's the one being filled
+};
+
+NodeArena* createArena(void)
+{
+	return (NodeArena*)calloc(1, sizeof(NodeArena));
 }
 
-Node* createNode(unsigned int x)
+Node* createNode(NodeArena* arena, unsigned int x)
 {
-	Node* node = (Node*)malloc(sizeof(Node));
-	if(!node){ //error allocating memory for node
-		return NULL;
+	ArenaBlock* block = arena->blocks;
+	if(!block || block->used == block->size){
+		size_t size = block ? block->size * 2 : ARENA_FIRST;
+		ArenaBlock* grown = (ArenaBlock*)malloc(sizeof(ArenaBlock) + size * sizeof(Node));
+		if(!grown){ //error allocating memory for node
+			return NULL;
+		}
+		grown->next = block;
+		grown->used = 0;
+		grown->size = size;
+		arena->blocks = block = grown;
 	}
 
+	Node* node = &block->nodes[block->used++];
 	node->num = x;
-
-	unsigned int mirr = BinaryMirror(x);
-	
-	decToBinArr(mirr, node->binMirror);
-	decToASCII(mirr, node->ascii);
+	node->mirror = BinaryMirror(x);
+	node->next = NULL;
 
 	return node;
 }
 
-//function to take in two node pointers and strcmp their ASCII
+void nodeAscii(const Node* node, char output[11])
+{
+	decToASCII(node->mirror, output);
+}
+
+void nodeBinMirror(const Node* node, char output[33])
+{
+	decToBinArr(node->mirror, output);
+}
+
+//function to take in two node pointers and compare their ASCII
 //strcmp() documentation states that "characters in the same pos from both strings are
 //compared one by one starting from the left. returns 0 if equal, >0 if first > second,
 // <0 if first < second
 //
 // source: https://www.w3schools.com/c/ref_string_strcmp.php
+//
+//the strings aren't kept anymore, asciiKey() orders the mirrors the same way strcmp() would
 static int cmpNodes(const Node* a, const Node* b)
 {
-	int cmp = strcmp(a->ascii, b->ascii);
-	
-	//realizing this function wasn't necessary because it's basically just one line
-	return cmp;
+	uint64_t keyA = asciiKey(a->mirror);
+	uint64_t keyB = asciiKey(b->mirror);
+
+	return (keyA > keyB) - (keyA < keyB);
 }
 
 
@@ -101,20 +140,128 @@ void insertSorted(Node** head, Node* node)
 	curr->next = node;
 }
 
+//PRINT_BATCH mirrors at a time get formatted into one buffer and one fwrite()
+#define PRINT_BATCH 256
+
 void printListToFile(FILE* output, const Node* head)
 {
-	for(const Node *curr = head; curr; curr = curr->next)
+	char text[PRINT_BATCH * 11];
+
+	const Node* curr = head;
+	while(curr)
 	{
-		fprintf(output, "%s\n", curr->ascii);
+		char* p = text;
+		for(size_t n = 0; curr && n < PRINT_BATCH; curr = curr->next, ++n){
+			p += formatU32(p, curr->mirror);
+			*p++ = '\n';
+		}
+		fwrite(text, 1, (size_t)(p - text), output);
 	}
 }
 
-void freeList(Node* head)
+void freeArena(NodeArena* arena)
 {
-	while(head)
+	if(!arena){
+		return;
+	}
+
+	ArenaBlock* block = arena->blocks;
+	while(block)
 	{
-		Node* next = head->next;
-		free(head);
-		head = next;
+		ArenaBlock* next = block->next;
+		free(block);
+		block = next;
+	}
+	free(arena);
+}
+
+static const uint64_t pow10[11] = {1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+	10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL};
+
+static int numDigits(unsigned int num)
+{
+	int digits = 1;
+	while(digits < 10 && num >= pow10[digits]){
+		++digits;
 	}
+	return digits;
+}
+
+//"12" < "120" < "13": left-aligned that's 1200000000 = 1200000000 < 1300000000,
+//and the shorter one wins the tie. Fits in 34 + 4 = 38 bits
+uint64_t asciiKey(unsigned int num)
+{
+	int digits = numDigits(num);
+	return ((uint64_t)num * pow10[10 - digits]) << 4 | (uint64_t)digits;
+}
+
+#define RADIX_BITS 11
+#define RADIX_PASSES 4 //44 bits >= the 38 of a key
+#define RADIX_SIZE (1 << RADIX_BITS)
+
+unsigned int asciiKeyNum(uint64_t key)
+{
+	int digits = (int)(key & 15);
+	return (unsigned int)((key >> 4) / pow10[10 - digits]);
+}
+
+uint64_t* sortKeys(uint64_t* keys, uint64_t* tmp, size_t n)
+{
+	size_t counts[RADIX_PASSES][RADIX_SIZE] = {{0}};
+
+	//one pass over the keys for every digit's histogram
+	for(size_t i = 0; i < n; ++i){
+		for(int p = 0; p < RADIX_PASSES; ++p){
+			counts[p][(keys[i] >> (p * RADIX_BITS)) & (RADIX_SIZE - 1)]++;
+		}
+	}
+
+	//LSD radix sort, a pass where every key has the same digit is skipped
+	for(int p = 0; p < RADIX_PASSES; ++p){
+		int shift = p * RADIX_BITS;
+		if(n == 0 || counts[p][(keys[0] >> shift) & (RADIX_SIZE - 1)] == n){
+			continue;
+		}
+
+		size_t sum = 0;
+		for(int d = 0; d < RADIX_SIZE; ++d){
+			size_t c = counts[p][d];
+			counts[p][d] = sum;
+			sum += c;
+		}
+
+		for(size_t i = 0; i < n; ++i){
+			tmp[counts[p][(keys[i] >> shift) & (RADIX_SIZE - 1)]++] = keys[i];
+		}
+
+		uint64_t* swap = keys;
+		keys = tmp;
+		tmp = swap;
+	}
+
+	return keys;
+}
+
+int sortByAscii(unsigned int* nums, size_t n)
+{
+	uint64_t* keys = (uint64_t*)malloc((n ? n : 1) * sizeof(*keys));
+	uint64_t* tmp = (uint64_t*)malloc((n ? n : 1) * sizeof(*tmp));
+	if(!keys || !tmp){
+		free(keys);
+		free(tmp);
+		return -1;
+	}
+
+	for(size_t i = 0; i < n; ++i){
+		keys[i] = asciiKey(nums[i]);
+	}
+
+	const uint64_t* sorted = sortKeys(keys, tmp, n);
+	for(size_t i = 0; i < n; ++i){
+		nums[i] = asciiKeyNum(sorted[i]);
+	}
+
+	free(keys);
+	free(tmp);
+	return 0;
 }
@@ -6,25 +6,51 @@
 #define MYLIST_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 
+//16 bytes: the strings aren't stored, nodeAscii()/nodeBinMirror() write them
+//out when they are needed (the mirror is all it takes)
 typedef struct Node{
 	unsigned int num;
-	char binMirror[33];
-	char ascii[11];
+	unsigned int mirror; //BinaryMirror(num)
 
 	struct Node* next;
 }Node;
 
-Node* createNode(unsigned int value);
+//nodes are carved out of an arena in big blocks and freed all at once,
+//instead of a malloc and a free per node
+typedef struct NodeArena NodeArena;
+
+NodeArena* createArena(void);
+
+Node* createNode(NodeArena* arena, unsigned int value); //NULL if the arena can't grow
+
+void nodeAscii(const Node* node, char output[11]); //decimal string of the mirror, what the list is sorted by
+
+void nodeBinMirror(const Node* node, char output[33]); //mirror as '0'/'1' characters
 
 void insertSorted(Node** head, Node* node); //insert binary mirror into position (ASCII lexicographic ascending order)
 
 void printListToFile(FILE* output, const Node* head);
 
-void freeList(Node* head);
+void freeArena(NodeArena* arena); //frees every node created from it (so every list built from them)
 
 void decToBinArr(unsigned int num, char output[33]); //same idea as decToBinary() in bits.c, only bitwise and outputs an array
 
 void decToASCII(unsigned int num, char output[11]); //decimal number into bytewise arra
 
+//sort key that orders numbers the way strcmp() orders their decToASCII() strings:
+//the digits left-aligned to 10 places, then the digit count (a prefix sorts first)
+uint64_t asciiKey(unsigned int num);
+
+unsigned int asciiKeyNum(uint64_t key); //the number a key was made from
+
+//radix sorts n keys using tmp (n more), returns whichever of the two ends up holding them
+uint64_t* sortKeys(uint64_t* keys, uint64_t* tmp, size_t n);
+
+//bulk replacement for insertSorted() on a whole array, sorts nums into the same
+//order (radix sort on asciiKey), returns -1 if the temp buffers can't be allocated
+int sortByAscii(unsigned int* nums, size_t n);
+
 #endif
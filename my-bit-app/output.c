@@ -0,0 +1,142 @@
+// Noah Hathout
+// nhathout
+// output.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "output.h"
+
+//"00" "01" ... "99"
+static const char digitPairs[200] = {
+	'0','0','0','1','0','2','0','3','0','4','0','5','0','6','0','7','0','8','0','9',
+	'1','0','1','1','1','2','1','3','1','4','1','5','1','6','1','7','1','8','1','9',
+	'2','0','2','1','2','2','2','3','2','4','2','5','2','6','2','7','2','8','2','9',
+	'3','0','3','1','3','2','3','3','3','4','3','5','3','6','3','7','3','8','3','9',
+	'4','0','4','1','4','2','4','3','4','4','4','5','4','6','4','7','4','8','4','9',
+	'5','0','5','1','5','2','5','3','5','4','5','5','5','6','5','7','5','8','5','9',
+	'6','0','6','1','6','2','6','3','6','4','6','5','6','6','6','7','6','8','6','9',
+	'7','0','7','1','7','2','7','3','7','4','7','5','7','6','7','7','7','8','7','9',
+	'8','0','8','1','8','2','8','3','8','4','8','5','8','6','8','7','8','8','8','9',
+	'9','0','9','1','9','2','9','3','9','4','9','5','9','6','9','7','9','8','9','9'
+};
+
+static const uint32_t pow10[10] = {1u, 10u, 100u, 1000u, 10000u, 100000u, 1000000u, 10000000u, 100000000u, 1000000000u};
+
+//bits used -> digits is nearly a lookup (a 32-bit number with b bits has
+//b * log10(2) or one more digits), one compare settles it
+static inline int countDigits(uint32_t num)
+{
+	int bits = 32 - __builtin_clz(num | 1);
+	int digits = (bits * 1233) >> 12; //1233 / 4096 ~ log10(2)
+	return digits + ((num | 1) >= pow10[digits]); //| 1 so 0 is 1 digit
+}
+
+int formatU32(char* p, uint32_t num)
+{
+	int digits = countDigits(num);
+	char* end = p + digits;
+
+	//from the back two at a time, each pair is one copy from the table
+	while(num >= 100){
+		uint32_t pair = (num % 100) * 2;
+		num /= 100;
+		end -= 2;
+		end[0] = digitPairs[pair];
+		end[1] = digitPairs[pair + 1];
+	}
+	if(num >= 10){
+		end[-2] = digitPairs[num * 2];
+		end[-1] = digitPairs[num * 2 + 1];
+	}else{
+		end[-1] = (char)('0' + num);
+	}
+
+	return digits;
+}
+
+int outOpen(OutBuf* out, const char* path)
+{
+	out->len = 0;
+	out->error = 0;
+	out->buf = (char*)malloc(OUT_BUF_SIZE);
+	if(!out->buf){
+		return -1;
+	}
+
+	out->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if(out->fd < 0){
+		free(out->buf);
+		return -1;
+	}
+	return 0;
+}
+
+//write() until all of it is out, the first error sticks in out->error
+static int writeAll(OutBuf* out, const char* data, size_t len)
+{
+	size_t done = 0;
+
+	while(done < len && !out->error){
+		ssize_t wrote = write(out->fd, data + done, len - done);
+		if(wrote < 0){
+			if(errno == EINTR){
+				continue;
+			}
+			out->error = errno;
+			break;
+		}
+		done += (size_t)wrote;
+	}
+
+	if(out->error){
+		errno = out->error;
+		return -1;
+	}
+	return 0;
+}
+
+int outFlush(OutBuf* out)
+{
+	int ret = writeAll(out, out->buf, out->len);
+	out->len = 0; //after an error the rest is dropped, outClose reports it
+	return ret;
+}
+
+int outWrite(OutBuf* out, const char* data, size_t len)
+{
+	if(len == 0){
+		return out->error ? -1 : 0;
+	}
+	if(len < OUT_BUF_SIZE / 2 && len <= OUT_BUF_SIZE - out->len){
+		memcpy(out->buf + out->len, data, len);
+		out->len += len;
+		return out->error ? -1 : 0;
+	}
+
+	//a big block isn't worth copying, it goes out directly after what's buffered
+	if(outFlush(out) != 0){
+		return -1;
+	}
+	return writeAll(out, data, len);
+}
+
+int outClose(OutBuf* out)
+{
+	int ret = outFlush(out);
+	if(close(out->fd) != 0 && ret == 0){
+		ret = -1;
+	}
+	if(ret != 0 && out->error){
+		errno = out->error;
+	}
+
+	free(out->buf);
+	out->buf = NULL;
+	return ret;
+}
@@ -0,0 +1,60 @@
+// Noah Hathout
+// nhathout
+// output.h
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//bytes formatted before they go out in one write()
+#define OUT_BUF_SIZE (1 << 20)
+
+//the longest thing a single put adds (a 10 digit number + separator)
+#define OUT_MAX_PUT 16
+
+//output buffer in front of a file descriptor, replaces fprintf() per line
+//(format parsing + stdio locking every call)
+typedef struct{
+	int fd;
+	char* buf;
+	size_t len;
+	int error; //errno of the first failed write, 0 = none
+}OutBuf;
+
+int outOpen(OutBuf* out, const char* path); //creates/truncates like fopen(path, "w"), -1 with errno set on errors
+
+int outFlush(OutBuf* out); //writes out what's buffered, -1 if this or an earlier write failed
+
+int outWrite(OutBuf* out, const char* data, size_t len); //a block of already formatted text, -1 if a write failed
+
+int outClose(OutBuf* out); //flush + close, -1 if anything failed
+
+//decimal digits of num at p (no terminator), returns how many. Two digits at a
+//time from a 200 byte table, the length is worked out first so nothing is reversed
+int formatU32(char* p, uint32_t num);
+
+//makes room for OUT_MAX_PUT more bytes
+static inline void outReserve(OutBuf* out)
+{
+	if(out->len > OUT_BUF_SIZE - OUT_MAX_PUT){
+		outFlush(out);
+	}
+}
+
+//num followed by the separator character
+static inline void outU32(OutBuf* out, uint32_t num, char sep)
+{
+	outReserve(out);
+	out->len += (size_t)formatU32(out->buf + out->len, num);
+	out->buf[out->len++] = sep;
+}
+
+static inline void outChar(OutBuf* out, char c)
+{
+	outReserve(out);
+	out->buf[out->len++] = c;
+}
+
+#endif
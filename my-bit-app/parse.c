@@ -0,0 +1,494 @@
+// Noah Hathout
+// nhathout
+// parse.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <immintrin.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "parse.h"
+
+//same characters as isspace() in the C locale, without the locale lookup
+static inline bool isSpace(char c)
+{
+	return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static const uint64_t pow10[9] = {1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL};
+
+//up to 8 digits at once (SWAR): after ^ '0' every digit byte is 0-9 and every other
+//byte is 10 or more, adding 0x76 to the low 7 bits sets the top bit of the ones
+//that are 10+ (bytes with the top bit already set aren't digits either).
+//The first non-digit byte gives the number of digits, they get shifted up so the
+//missing ones are leading zeros, then pairs, quads and the two halves are combined
+//with multiplies (the trick from simdjson's parse_eight_digits_unrolled)
+static inline uint64_t swarValue(uint64_t x, int digits)
+{
+	x <<= 8 * (8 - digits);
+	x = (x * 10) + (x >> 8);
+	return (((x & 0x000000ff000000ffULL) * (100 + (1000000ULL << 32))) + (((x >> 16) & 0x000000ff000000ffULL) * (1 + (10000ULL << 32)))) >> 32;
+}
+
+static inline int swarDigits(const char* p, uint64_t* value)
+{
+	uint64_t word;
+	memcpy(&word, p, sizeof(word)); //little-endian: p[0] is the low byte
+
+	uint64_t x = word ^ 0x3030303030303030ULL;
+	uint64_t notDigit = (((x & 0x7f7f7f7f7f7f7f7fULL) + 0x7676767676767676ULL) | x) & 0x8080808080808080ULL;
+	int digits = notDigit ? __builtin_ctzll(notDigit) / 8 : 8;
+	if(digits == 0){
+		*value = 0;
+		return 0;
+	}
+
+	*value = swarValue(x, digits);
+	return digits;
+}
+
+//bytes parseBlock() reads: the block and a 16 byte load from a number at its end
+#define BLOCK_SPAN (64 + 16)
+
+//bit k set where p[k] is a digit (*space: whitespace), 16 bytes per SSE2 compare.
+//min_epu8(x, 9) == x is x <= 9 unsigned, so c - '0' <= 9 is a digit and
+//c - '\t' <= 4 is \t \n \v \f \r
+static inline uint64_t blockMasks(const char* p, uint64_t* space)
+{
+	uint64_t digit = 0;
+	*space = 0;
+	for(int k = 0; k < 4; ++k){
+		__m128i v = _mm_loadu_si128((const __m128i*)(p + 16 * k));
+		__m128i d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+		__m128i c = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+		__m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+		__m128i isSpace = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(c, _mm_set1_epi8(4)), c), _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+		digit |= (uint64_t)(uint16_t)_mm_movemask_epi8(isDigit) << (16 * k);
+		*space |= (uint64_t)(uint16_t)_mm_movemask_epi8(isSpace) << (16 * k);
+	}
+	return digit;
+}
+
+//the usual input in bulk: 64 bytes of only digits and whitespace, p right after
+//a number or whitespace. The numbers are the runs of digits in the mask, so
+//where the next one starts doesn't wait on parsing this one (one at a time it's
+//a load -> ctz -> next load chain per number, most of the time for short ones),
+//and 1-16 digits take both SWAR halves with selects, no branch on the length.
+//Goes up to the last whitespace, a number touching the end of the block is left
+//for the next call. Returns the bytes used (numbers in *count, at most 32), 0 if
+//the block has anything else (a sign, junk, over 16 digits, no whitespace)
+static size_t parseBlock(const char* p, uint32_t* out, size_t* count)
+{
+	uint64_t space;
+	uint64_t digit = blockMasks(p, &space);
+	if((digit | space) != ~0ULL || space == 0){
+		return 0;
+	}
+
+	int last = 63 - __builtin_clzll(space);
+	digit &= (2ULL << last) - 1; //2 << 63 wraps to 0, all ones
+	uint64_t starts = digit & ~(digit << 1);
+	uint64_t ends = digit & ~(digit >> 1);
+
+	size_t n = 0;
+	while(starts){
+		int s = __builtin_ctzll(starts);
+		int digits = __builtin_ctzll(ends) - s + 1;
+		if(digits > 16){
+			return 0; //strtoul's overflow, the one at a time loop does that
+		}
+
+		uint64_t high;
+		uint64_t low;
+		memcpy(&high, p + s, sizeof(high));
+		memcpy(&low, p + s + 8, sizeof(low));
+		int highDigits = digits < 8 ? digits : 8;
+		int lowDigits = digits - highDigits;
+		uint64_t value = swarValue(high ^ 0x3030303030303030ULL, highDigits);
+		low = swarValue(low ^ 0x3030303030303030ULL, lowDigits & 7); //a shift by 64 otherwise
+		out[n++] = (uint32_t)(value * pow10[lowDigits] + (lowDigits ? low : 0));
+
+		starts &= starts - 1;
+		ends &= ends - 1;
+	}
+
+	*count = n;
+	return (size_t)last + 1;
+}
+
+//pshufb control for a number's 16 byte load, 16 + digits bytes in: byte j of the
+//result is byte j + digits - 16 of the load, the negative ones come out zero. So
+//the digits end up at the top (right-aligned) with zeros in front
+static const int8_t alignDigits[32] = {-16, -15, -14, -13, -12, -11, -10, -9, -8, -7, -6, -5, -4, -3, -2, -1,
+					0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+
+//16 digit characters (already - '0', right-aligned) per lane into the first 8
+//and last 8 digits as two 32 bit values: pairs, then quads, then eights
+__attribute__((target("avx2,bmi")))
+static inline __m256i eightDigits(__m256i a, __m256i b)
+{
+	a = _mm256_maddubs_epi16(a, _mm256_set1_epi16(0x010a)); //10, 1
+	b = _mm256_maddubs_epi16(b, _mm256_set1_epi16(0x010a));
+	a = _mm256_madd_epi16(a, _mm256_set1_epi32(0x00010064)); //100, 1
+	b = _mm256_madd_epi16(b, _mm256_set1_epi32(0x00010064));
+	__m256i quads = _mm256_packus_epi32(a, b); //a's lane then b's, per lane
+	return _mm256_madd_epi16(quads, _mm256_set1_epi32(0x00012710)); //10000, 1
+}
+
+//the numbers at p + s0 and p + s1 (d0/d1 digits) in the two lanes, right-aligned, as 0-9 bytes
+__attribute__((target("avx2,bmi")))
+static inline __m256i loadNumbers(const char* p, int s0, int d0, int s1, int d1)
+{
+	__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(p + s0))),
+					    _mm_loadu_si128((const __m128i*)(p + s1)), 1);
+	__m256i ctrl = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(alignDigits + d0))),
+					       _mm_loadu_si128((const __m128i*)(alignDigits + d1)), 1);
+	return _mm256_shuffle_epi8(_mm256_sub_epi8(v, _mm256_set1_epi8('0')), ctrl);
+}
+
+//parseBlock() with AVX2: the masks 32 bytes at a time and the digits converted
+//for 4 numbers at once instead of the SWAR multiplies one number at a time. The
+//17+ digit check is on the mask, so nothing in the loop branches on a number
+__attribute__((target("avx2,bmi")))
+static size_t parseBlockAvx2(const char* p, uint32_t* out, size_t* count)
+{
+	__m256i lo = _mm256_loadu_si256((const __m256i*)p);
+	__m256i hi = _mm256_loadu_si256((const __m256i*)(p + 32));
+	uint64_t digit = 0;
+	uint64_t space = 0;
+	for(int k = 0; k < 2; ++k){
+		__m256i v = k ? hi : lo;
+		__m256i d = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+		__m256i c = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+		__m256i isDigit = _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(9)), d);
+		__m256i isSpace = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(c, _mm256_set1_epi8(4)), c), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+		digit |= (uint64_t)(uint32_t)_mm256_movemask_epi8(isDigit) << (32 * k);
+		space |= (uint64_t)(uint32_t)_mm256_movemask_epi8(isSpace) << (32 * k);
+	}
+	if((digit | space) != ~0ULL || space == 0){
+		return 0;
+	}
+
+	int last = 63 - __builtin_clzll(space);
+	digit &= (2ULL << last) - 1;
+
+	//a run of 17+ digits: strtoul's overflow, the one at a time loop does that
+	uint64_t run = digit & (digit >> 1);
+	run &= run >> 2;
+	run &= run >> 4;
+	run &= run >> 8;
+	if(run & (run >> 1)){
+		return 0;
+	}
+
+	uint64_t starts = digit & ~(digit << 1);
+	uint64_t ends = digit & ~(digit >> 1);
+	int n = __builtin_popcountll(starts);
+
+	//4 at a time, past the last number tzcnt is 64 (a 1 digit "number" at p + 64,
+	//still inside BLOCK_SPAN) and the results land past *count
+	for(int k = 0; k < n; k += 4){
+		int s[4];
+		int d[4];
+		for(int j = 0; j < 4; ++j){
+			s[j] = (int)_tzcnt_u64(starts);
+			d[j] = (int)_tzcnt_u64(ends) - s[j] + 1;
+			starts &= starts - 1;
+			ends &= ends - 1;
+		}
+
+		__m256i v = eightDigits(loadNumbers(p, s[0], d[0], s[2], d[2]), loadNumbers(p, s[1], d[1], s[3], d[3]));
+		//first 8 * 10^8 + last 8 in every 64 bits, the low 32 bits are the number
+		v = _mm256_add_epi64(_mm256_mul_epu32(v, _mm256_set1_epi64x(100000000)), _mm256_srli_epi64(v, 32));
+		v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6));
+		_mm_storeu_si128((__m128i*)(out + k), _mm256_castsi256_si128(v));
+	}
+
+	*count = (size_t)n;
+	return (size_t)last + 1;
+}
+
+//parseBlock() or parseBlockAvx2()
+typedef size_t (*BlockParser)(const char* p, uint32_t* out, size_t* count);
+
+//the parseUints() loop, block is a constant in both copies below so each gets
+//its block parser inlined
+static inline __attribute__((always_inline)) size_t parseLoop(BlockParser block, const char* buf, size_t len, bool last,
+	uint32_t* out, size_t max, size_t* used, bool* stop)
+{
+	size_t n = 0;
+	size_t i = 0;
+	size_t slowUntil = 0; //a block parseBlock() turned down, one at a time up to here
+	*stop = false;
+
+	while(n < max){
+		if(i >= slowUntil && i + BLOCK_SPAN <= len && max - n >= 32){
+			size_t count;
+			size_t took = block(buf + i, out + n, &count);
+			if(took){
+				i += took;
+				n += count;
+				continue;
+			}
+			slowUntil = i + 64;
+		}
+
+		while(i < len && isSpace(buf[i])){
+			++i;
+		}
+		if(i == len){
+			break; //only whitespace left
+		}
+
+		size_t start = i;
+
+		bool negative = false;
+		if(buf[i] == '+' || buf[i] == '-'){
+			negative = buf[i] == '-';
+			++i;
+		}
+
+		uint64_t value = 0;
+		size_t first = i;
+		int digits = 0; //how many SWAR found, under 8 (or 16) means the number ended there
+		if(i + 16 <= len){
+			//9 and 10 digit numbers (most 32-bit ones) take a second SWAR step
+			digits = swarDigits(buf + i, &value);
+			if(digits == 8){
+				uint64_t low;
+				int more = swarDigits(buf + i + 8, &low);
+				value = value * pow10[more] + low;
+				digits += more;
+			}
+		}else if(i + 8 <= len){
+			digits = swarDigits(buf + i, &value);
+		}
+		i += (size_t)digits;
+
+		//the rest one at a time: short numbers at the end of buf and ones
+		//longer than 16 digits (only there to overflow like strtoul does)
+		bool overflow = false;
+		if(digits == 0 || digits % 8 == 0){
+			while(i < len && (unsigned char)(buf[i] - '0') < 10){
+				unsigned int digit = (unsigned int)(buf[i] - '0');
+				if(__builtin_mul_overflow(value, 10, &value) || __builtin_add_overflow(value, digit, &value)){
+					overflow = true;
+				}
+				++i;
+			}
+		}
+
+		if(i == len && !last){
+			i = start; //might continue in the next block
+			break;
+		}
+		if(i == first){
+			*stop = true; //not a number, a fscanf loop ends here
+			i = start;
+			break;
+		}
+
+		//strtoul: past 64 bits is ULONG_MAX (even negative), then cut to unsigned int
+		if(overflow){
+			value = UINT64_MAX;
+		}else if(negative){
+			value = (uint64_t)0 - value;
+		}
+		out[n++] = (uint32_t)value;
+	}
+
+	*used = i;
+	return n;
+}
+
+__attribute__((target("avx2,bmi")))
+static size_t parseUintsAvx2(const char* buf, size_t len, bool last, uint32_t* out, size_t max, size_t* used, bool* stop)
+{
+	return parseLoop(parseBlockAvx2, buf, len, last, out, max, used, stop);
+}
+
+static size_t parseUintsSse2(const char* buf, size_t len, bool last, uint32_t* out, size_t max, size_t* used, bool* stop)
+{
+	return parseLoop(parseBlock, buf, len, last, out, max, used, stop);
+}
+
+//same first call dispatch as CountSequenceBatch in bits.c ("make check" also
+//builds the test with PARSE_NO_AVX2 so the SSE2 copy gets tested on any machine)
+static size_t parseUintsDispatch(const char* buf, size_t len, bool last, uint32_t* out, size_t max, size_t* used, bool* stop);
+static size_t (*parseUintsImpl)(const char*, size_t, bool, uint32_t*, size_t, size_t*, bool*) = parseUintsDispatch;
+
+static size_t parseUintsDispatch(const char* buf, size_t len, bool last, uint32_t* out, size_t max, size_t* used, bool* stop)
+{
+	size_t (*chosen)(const char*, size_t, bool, uint32_t*, size_t, size_t*, bool*);
+
+	__builtin_cpu_init();
+
+#ifdef PARSE_NO_AVX2
+	bool avx2 = false;
+#else
+	bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi");
+#endif
+	if(avx2){
+		chosen = parseUintsAvx2;
+	}else{
+		chosen = parseUintsSse2;
+	}
+
+	__atomic_store_n(&parseUintsImpl, chosen, __ATOMIC_RELAXED); //threads can get here at the same time, they all pick the same one
+	return chosen(buf, len, last, out, max, used, stop);
+}
+
+size_t parseUints(const char* buf, size_t len, bool last, uint32_t* out, size_t max, size_t* used, bool* stop)
+{
+	return __atomic_load_n(&parseUintsImpl, __ATOMIC_RELAXED)(buf, len, last, out, max, used, stop);
+}
+
+//values array that doubles when it's full
+static int growValues(uint32_t** values, size_t* capacity, size_t need)
+{
+	if(need <= *capacity){
+		return 0;
+	}
+
+	size_t size = *capacity ? *capacity : 1024;
+	while(size < need){
+		size *= 2;
+	}
+	uint32_t* grown = (uint32_t*)realloc(*values, size * sizeof(**values));
+	if(!grown){
+		return -1;
+	}
+
+	*values = grown;
+	*capacity = size;
+	return 0;
+}
+
+//parses all of buf, growing values as it goes
+static int parseAll(const char* buf, size_t len, bool last, uint32_t** values, size_t* count, size_t* capacity, size_t* used, bool* stop)
+{
+	size_t done = 0;
+	*stop = false;
+
+	while(!*stop){
+		//a number takes at least 2 bytes with its separator, so this is always enough for the rest
+		if(growValues(values, capacity, *count + (len - done) / 2 + 1) != 0){
+			return -1;
+		}
+
+		size_t part;
+		size_t got = parseUints(buf + done, len - done, last, *values + *count, *capacity - *count, &part, stop);
+		*count += got;
+		done += part;
+		if(got == 0 || done == len){
+			break;
+		}
+	}
+
+	*used = done;
+	return 0;
+}
+
+int readValues(const char* path, uint32_t** values, size_t* count)
+{
+	*values = NULL;
+	*count = 0;
+	size_t capacity = 0;
+	bool stop = false;
+	size_t used;
+
+	int fd = open(path, O_RDONLY);
+	if(fd < 0){
+		return -1;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) != 0){
+		close(fd);
+		return -1;
+	}
+
+	//regular file: mmap it and parse it in one go
+	if(S_ISREG(st.st_mode)){
+		size_t len = (size_t)st.st_size;
+		int ret = 0;
+
+		if(len > 0){
+			const char* buf = (const char*)mmap(NULL, len, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+			if(buf == MAP_FAILED){
+				close(fd);
+				return -1;
+			}
+			madvise((void*)buf, len, MADV_SEQUENTIAL);
+
+			//a rough guess (10 digit numbers) so most files don't need a realloc
+			ret = growValues(values, &capacity, len / 11 + 1);
+			if(ret == 0){
+				ret = parseAll(buf, len, true, values, count, &capacity, &used, &stop);
+			}
+			munmap((void*)buf, len);
+		}
+
+		close(fd);
+		if(ret != 0){
+			free(*values);
+			*values = NULL;
+			errno = ENOMEM;
+		}
+		return ret;
+	}
+
+	//pipe or terminal: big reads, a number cut by the end of a read is moved to
+	//the front of the buffer for the next one
+	char* buf = (char*)malloc(PARSE_BLOCK);
+	if(!buf){
+		close(fd);
+		return -1;
+	}
+
+	size_t have = 0;
+	bool eof = false;
+	bool failed = false;
+	while(!eof && !stop){
+		ssize_t got = read(fd, buf + have, PARSE_BLOCK - have);
+		if(got < 0){
+			if(errno == EINTR){
+				continue;
+			}
+			failed = true;
+			break;
+		}
+		eof = got == 0;
+		have += (size_t)got;
+
+		if(parseAll(buf, have, eof, values, count, &capacity, &used, &stop) != 0){
+			errno = ENOMEM;
+			failed = true;
+			break;
+		}
+
+		//a "number" filling the whole block can't be one fscanf would read either
+		if(used == 0 && have == PARSE_BLOCK){
+			stop = true;
+		}
+		memmove(buf, buf + used, have - used);
+		have -= used;
+	}
+
+	int ret = failed ? -1 : 0;
+	int err = errno;
+	free(buf);
+	close(fd);
+	if(ret != 0){
+		free(*values);
+		*values = NULL;
+		errno = err;
+	}
+	return ret;
+}
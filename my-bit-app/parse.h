@@ -0,0 +1,32 @@
+// Noah Hathout
+// nhathout
+// parse.h
+
+#ifndef PARSE_H
+#define PARSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//bytes read at a time when the input isn't a regular file (a pipe), "make check"
+//builds parse.c with a tiny one so numbers get cut by the block often
+#ifndef PARSE_BLOCK
+#define PARSE_BLOCK (1 << 20)
+#endif
+
+//parses unsigned numbers out of buf the way a fscanf("%u") loop does: whitespace
+//between them, an optional +/- (a negative one wraps around), bigger than 32 bits
+//gets cut to 32 bits (or UINT_MAX past 64 bits)
+//
+//stops when max numbers are in out, at the end of buf, or at something that isn't a
+//number (*stop is set, a fscanf loop would end there). If last is false the end
+//of buf might cut a number in half, so one touching the end is left for the next call.
+//*used is how many bytes of buf are done with, returns how many numbers went into out
+size_t parseUints(const char* buf, size_t len, bool last, uint32_t* out, size_t max, size_t* used, bool* stop);
+
+//every number in the file at path, in one pass (mmap for a regular file, PARSE_BLOCK
+//reads otherwise). *values is malloc'd, returns -1 with errno set if reading failed
+int readValues(const char* path, uint32_t** values, size_t* count);
+
+#endif
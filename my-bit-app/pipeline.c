@@ -0,0 +1,488 @@
+// Noah Hathout
+// nhathout
+// pipeline.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include <pthread.h>
+
+#include "pipeline.h"
+#include "bits.h"
+#include "mylist.h"
+
+#define MIRROR_LINE_MAX 14 //"4294967295\t10\n"
+#define SORTED_LINE_MAX 11 //"4294967295\n"
+
+//--- ordered task pool ---
+
+typedef struct{
+	char* buf;
+	size_t len;
+	size_t cap;
+}TextBuf;
+
+static bool textReserve(TextBuf* text, size_t need)
+{
+	if(need <= text->cap){
+		return true;
+	}
+
+	char* grown = (char*)realloc(text->buf, need);
+	if(!grown){
+		return false;
+	}
+	text->buf = grown;
+	text->cap = need;
+	return true;
+}
+
+//formats task number task into text, false if it ran out of memory
+typedef bool (*TaskFn)(void* ctx, size_t task, TextBuf* text);
+
+typedef struct{
+	TaskFn fn;
+	void* ctx;
+	size_t ntasks;
+
+	//task k goes in slot k % window, it can start once task k - window is written
+	size_t window;
+	TextBuf* slots;
+	bool* ready;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	size_t next; //next task to hand out
+	size_t written; //tasks written so far
+	bool failed;
+}Pool;
+
+static void* poolWorker(void* arg)
+{
+	Pool* pool = (Pool*)arg;
+
+	pthread_mutex_lock(&pool->lock);
+	for(;;){
+		while(pool->next < pool->ntasks && pool->next >= pool->written + pool->window && !pool->failed){
+			pthread_cond_wait(&pool->cond, &pool->lock);
+		}
+		if(pool->next >= pool->ntasks || pool->failed){
+			break;
+		}
+
+		size_t task = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+
+		TextBuf* text = &pool->slots[task % pool->window];
+		text->len = 0;
+		bool ok = pool->fn(pool->ctx, task, text);
+
+		pthread_mutex_lock(&pool->lock);
+		if(!ok){
+			pool->failed = true;
+		}
+		pool->ready[task % pool->window] = true;
+		pthread_cond_broadcast(&pool->cond);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+//runs every task, on threads workers (the calling thread writes the results
+//in task order meanwhile), -1 with errno set if a task or a write failed
+static int runOrdered(OutBuf* out, int threads, size_t ntasks, TaskFn fn, void* ctx)
+{
+	//one thread: no pool, same tasks
+	if(threads <= 1){
+		TextBuf text = {NULL, 0, 0};
+		int ret = 0;
+
+		for(size_t task = 0; task < ntasks && ret == 0; ++task){
+			text.len = 0;
+			if(!fn(ctx, task, &text)){
+				errno = ENOMEM;
+				ret = -1;
+			}else if(outWrite(out, text.buf, text.len) != 0){
+				ret = -1;
+			}
+		}
+		free(text.buf);
+		return ret;
+	}
+
+	Pool pool;
+	memset(&pool, 0, sizeof(pool));
+	pool.fn = fn;
+	pool.ctx = ctx;
+	pool.ntasks = ntasks;
+	pool.window = (size_t)threads * 2;
+	pool.slots = (TextBuf*)calloc(pool.window, sizeof(*pool.slots));
+	pool.ready = (bool*)calloc(pool.window, sizeof(*pool.ready));
+	pthread_t* workers = (pthread_t*)malloc((size_t)threads * sizeof(*workers));
+	if(!pool.slots || !pool.ready || !workers){
+		free(pool.slots);
+		free(pool.ready);
+		free(workers);
+		errno = ENOMEM;
+		return -1;
+	}
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.cond, NULL);
+
+	int started = 0;
+	while(started < threads && pthread_create(&workers[started], NULL, poolWorker, &pool) == 0){
+		++started;
+	}
+
+	int ret = 0;
+	int err = 0;
+	if(started == 0){
+		ret = -1;
+		err = EAGAIN;
+	}
+
+	for(size_t task = 0; task < ntasks && ret == 0; ++task){
+		size_t slot = task % pool.window;
+
+		pthread_mutex_lock(&pool.lock);
+		while(!pool.ready[slot] && !pool.failed){
+			pthread_cond_wait(&pool.cond, &pool.lock);
+		}
+		bool failed = pool.failed;
+		pthread_mutex_unlock(&pool.lock);
+
+		if(failed){
+			ret = -1;
+			err = ENOMEM;
+			break;
+		}
+		if(outWrite(out, pool.slots[slot].buf, pool.slots[slot].len) != 0){
+			ret = -1;
+			err = errno;
+		}
+
+		pthread_mutex_lock(&pool.lock);
+		pool.ready[slot] = false;
+		pool.written = task + 1;
+		if(ret != 0){
+			pool.failed = true; //stops the workers
+		}
+		pthread_cond_broadcast(&pool.cond);
+		pthread_mutex_unlock(&pool.lock);
+	}
+
+	for(int i = 0; i < started; ++i){
+		pthread_join(workers[i], NULL);
+	}
+
+	for(size_t i = 0; i < pool.window; ++i){
+		free(pool.slots[i].buf);
+	}
+	free(pool.slots);
+	free(pool.ready);
+	free(workers);
+	pthread_mutex_destroy(&pool.lock);
+	pthread_cond_destroy(&pool.cond);
+
+	if(ret != 0){
+		errno = err;
+	}
+	return ret;
+}
+
+//--- first section ---
+
+typedef struct{
+	const uint32_t* values;
+	uint32_t* mirrors;
+	uint32_t* counts;
+	size_t count;
+}MirrorCtx;
+
+static bool mirrorTask(void* arg, size_t task, TextBuf* text)
+{
+	MirrorCtx* ctx = (MirrorCtx*)arg;
+	size_t begin = task * PIPE_CHUNK;
+	size_t n = ctx->count - begin < PIPE_CHUNK ? ctx->count - begin : PIPE_CHUNK;
+
+	BinaryMirrorBatch(ctx->values + begin, ctx->mirrors + begin, n);
+	CountSequenceBatch(ctx->values + begin, ctx->counts + begin, n);
+
+	if(!textReserve(text, n * MIRROR_LINE_MAX)){
+		return false;
+	}
+
+	char* p = text->buf;
+	for(size_t i = begin; i < begin + n; ++i){
+		p += formatU32(p, ctx->mirrors[i]);
+		*p++ = '\t'; //tab in the middle
+		p += formatU32(p, ctx->counts[i]);
+		*p++ = '\n';
+	}
+	text->len = (size_t)(p - text->buf);
+	return true;
+}
+
+int writeMirrorSection(OutBuf* out, const uint32_t* values, uint32_t* mirrors, size_t count, int threads)
+{
+	MirrorCtx ctx;
+	ctx.values = values;
+	ctx.mirrors = mirrors;
+	ctx.count = count;
+	ctx.counts = (uint32_t*)malloc((count ? count : 1) * sizeof(*ctx.counts));
+	if(!ctx.counts){
+		return -1;
+	}
+
+	int ret = runOrdered(out, threads, (count + PIPE_CHUNK - 1) / PIPE_CHUNK, mirrorTask, &ctx);
+	free(ctx.counts);
+	return ret;
+}
+
+//--- second section ---
+
+typedef struct{
+	const uint32_t* mirrors;
+	uint64_t* keys;
+	uint64_t* tmp;
+
+	int runs; //slices sorted on their own
+	size_t* runBegin; //runs + 1
+	const uint64_t** run; //where each sorted slice ended up (keys or tmp)
+
+	size_t parts; //merge tasks
+	size_t* bounds; //bounds[r * (parts + 1) + p] = where part p starts in run r
+}SortCtx;
+
+static size_t runLen(const SortCtx* ctx, int r)
+{
+	return ctx->runBegin[r + 1] - ctx->runBegin[r];
+}
+
+static bool runSortTask(void* arg, size_t task, TextBuf* text)
+{
+	SortCtx* ctx = (SortCtx*)arg;
+	size_t begin = ctx->runBegin[task];
+	size_t n = runLen(ctx, (int)task);
+
+	for(size_t i = begin; i < begin + n; ++i){
+		ctx->keys[i] = asciiKey(ctx->mirrors[i]);
+	}
+	ctx->run[task] = sortKeys(ctx->keys + begin, ctx->tmp + begin, n);
+
+	(void)text; //nothing to write yet
+	return true;
+}
+
+//first index in run with a key >= key
+static size_t lowerBound(const uint64_t* run, size_t n, uint64_t key)
+{
+	size_t lo = 0;
+	size_t hi = n;
+	while(lo < hi){
+		size_t mid = lo + (hi - lo) / 2;
+		if(run[mid] < key){
+			lo = mid + 1;
+		}else{
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+static int cmpKeys(const void* a, const void* b)
+{
+	uint64_t x = *(const uint64_t*)a;
+	uint64_t y = *(const uint64_t*)b;
+	return (x > y) - (x < y);
+}
+
+//cuts the key range into parts of about PIPE_CHUNK keys: parts keys sampled
+//evenly from every run, sorted, every runs-th one is a splitter
+static bool splitRuns(SortCtx* ctx, size_t count)
+{
+	ctx->parts = (count + PIPE_CHUNK - 1) / PIPE_CHUNK;
+	if(ctx->parts == 0){
+		ctx->parts = 1;
+	}
+
+	size_t stride = ctx->parts + 1;
+	ctx->bounds = (size_t*)malloc((size_t)ctx->runs * stride * sizeof(*ctx->bounds));
+	if(!ctx->bounds){
+		return false;
+	}
+
+	//one run: any cut works
+	if(ctx->runs == 1){
+		for(size_t p = 0; p <= ctx->parts; ++p){
+			ctx->bounds[p] = count * p / ctx->parts;
+		}
+		return true;
+	}
+
+	size_t nsample = 0;
+	uint64_t* sample = (uint64_t*)malloc((size_t)ctx->runs * ctx->parts * sizeof(*sample));
+	if(!sample){
+		return false;
+	}
+	for(int r = 0; r < ctx->runs; ++r){
+		size_t n = runLen(ctx, r);
+		for(size_t s = 0; s < ctx->parts && n > 0; ++s){
+			sample[nsample++] = ctx->run[r][n * s / ctx->parts];
+		}
+	}
+	qsort(sample, nsample, sizeof(*sample), cmpKeys);
+
+	for(int r = 0; r < ctx->runs; ++r){
+		ctx->bounds[(size_t)r * stride] = 0;
+		ctx->bounds[(size_t)r * stride + ctx->parts] = runLen(ctx, r);
+	}
+
+	//a key that is a lot of the input is several splitters in a row, those cut
+	//its equal range by position (equal keys are the same line, any cut is fine),
+	//otherwise all of them would end up in one part
+	for(size_t p = 1; p < ctx->parts; ){
+		uint64_t key = sample[nsample * p / ctx->parts];
+		size_t same = 1;
+		while(p + same < ctx->parts && sample[nsample * (p + same) / ctx->parts] == key){
+			++same;
+		}
+
+		for(int r = 0; r < ctx->runs; ++r){
+			size_t* b = ctx->bounds + (size_t)r * stride;
+			size_t n = runLen(ctx, r);
+			size_t lo = lowerBound(ctx->run[r], n, key);
+			size_t hi = lowerBound(ctx->run[r], n, key + 1); //keys never get near UINT64_MAX
+			for(size_t j = 0; j < same; ++j){
+				b[p + j] = lo + (hi - lo) * j / same;
+			}
+		}
+		p += same;
+	}
+
+	free(sample);
+	return true;
+}
+
+//k-way merge of part task from every run, a binary heap of run heads
+static bool mergeTask(void* arg, size_t task, TextBuf* text)
+{
+	SortCtx* ctx = (SortCtx*)arg;
+	size_t stride = ctx->parts + 1;
+	const uint64_t* head[PIPE_MAX_THREADS];
+	const uint64_t* end[PIPE_MAX_THREADS];
+	int heap[PIPE_MAX_THREADS];
+	int nheap = 0;
+	size_t total = 0;
+
+	for(int r = 0; r < ctx->runs; ++r){
+		const size_t* b = ctx->bounds + (size_t)r * stride;
+		head[r] = ctx->run[r] + b[task];
+		end[r] = ctx->run[r] + b[task + 1];
+		total += b[task + 1] - b[task];
+	}
+
+	if(!textReserve(text, total * SORTED_LINE_MAX)){
+		return false;
+	}
+	char* p = text->buf;
+
+	//one run (-j 1) is already in order
+	if(ctx->runs == 1){
+		for(const uint64_t* k = head[0]; k < end[0]; ++k){
+			p += formatU32(p, asciiKeyNum(*k));
+			*p++ = '\n';
+		}
+		text->len = (size_t)(p - text->buf);
+		return true;
+	}
+
+	for(int r = 0; r < ctx->runs; ++r){
+		if(head[r] == end[r]){
+			continue;
+		}
+
+		//sift up
+		int i = nheap++;
+		while(i > 0 && *head[heap[(i - 1) / 2]] > *head[r]){
+			heap[i] = heap[(i - 1) / 2];
+			i = (i - 1) / 2;
+		}
+		heap[i] = r;
+	}
+
+	while(nheap > 0){
+		int r = heap[0];
+		p += formatU32(p, asciiKeyNum(*head[r]));
+		*p++ = '\n';
+
+		//next key of the same run, or the last heap entry, sifts down from the top
+		if(++head[r] == end[r]){
+			r = heap[--nheap];
+		}
+		int i = 0;
+		for(;;){
+			int child = 2 * i + 1;
+			if(child >= nheap){
+				break;
+			}
+			if(child + 1 < nheap && *head[heap[child + 1]] < *head[heap[child]]){
+				++child;
+			}
+			if(*head[heap[child]] >= *head[r]){
+				break;
+			}
+			heap[i] = heap[child];
+			i = child;
+		}
+		if(nheap > 0){
+			heap[i] = r;
+		}
+	}
+
+	text->len = (size_t)(p - text->buf);
+	return true;
+}
+
+int writeSortedSection(OutBuf* out, const uint32_t* mirrors, size_t count, int threads)
+{
+	SortCtx ctx;
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.mirrors = mirrors;
+	ctx.runs = threads < 1 ? 1 : threads;
+	ctx.keys = (uint64_t*)malloc((count ? count : 1) * sizeof(*ctx.keys));
+	ctx.tmp = (uint64_t*)malloc((count ? count : 1) * sizeof(*ctx.tmp));
+	ctx.runBegin = (size_t*)malloc(((size_t)ctx.runs + 1) * sizeof(*ctx.runBegin));
+	ctx.run = (const uint64_t**)malloc((size_t)ctx.runs * sizeof(*ctx.run));
+
+	int ret = -1;
+	if(!ctx.keys || !ctx.tmp || !ctx.runBegin || !ctx.run){
+		errno = ENOMEM;
+		goto out;
+	}
+
+	for(int r = 0; r <= ctx.runs; ++r){
+		ctx.runBegin[r] = count * (size_t)r / (size_t)ctx.runs;
+	}
+
+	//sort the slices (nothing is written), cut them into parts, merge the parts
+	if(runOrdered(out, threads, (size_t)ctx.runs, runSortTask, &ctx) != 0){
+		goto out;
+	}
+	if(!splitRuns(&ctx, count)){
+		errno = ENOMEM;
+		goto out;
+	}
+	ret = runOrdered(out, threads, ctx.parts, mergeTask, &ctx);
+
+out:
+	free(ctx.keys);
+	free(ctx.tmp);
+	free(ctx.runBegin);
+	free(ctx.run);
+	free(ctx.bounds);
+	return ret;
+}
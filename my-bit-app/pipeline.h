@@ -0,0 +1,31 @@
+// Noah Hathout
+// nhathout
+// pipeline.h
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "output.h"
+
+//values per task: every task formats its part of the output into its own buffer
+//on a worker thread, the buffers are written in order (at most 2 per thread wait
+//to be written, so memory doesn't grow with the input)
+#define PIPE_CHUNK (64 * 1024)
+
+#define PIPE_MAX_THREADS 256 //-j
+
+//first section, "mirror\tcount\n" per value in input order. mirrors gets every
+//BinaryMirror() for the sorted section. Returns -1 with errno set if a write or an
+//allocation failed
+int writeMirrorSection(OutBuf* out, const uint32_t* values, uint32_t* mirrors, size_t count, int threads);
+
+//second section, the mirrors in decToASCII() string order. Each thread radix sorts
+//a slice, then the slices are merged: the key range is cut into parts (splitters
+//sampled from the sorted slices), so every part is a merge of its piece of
+//each slice that a thread can do on its own
+int writeSortedSection(OutBuf* out, const uint32_t* mirrors, size_t count, int threads);
+
+#endif
@@ -0,0 +1,395 @@
+// Noah Hathout
+// nhathout
+// stream.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "stream.h"
+#include "parse.h"
+#include "bits.h"
+#include "mylist.h"
+
+#define STREAM_BATCH (64 * 1024) //values parsed and formatted at a time
+
+//--- run files ---
+
+//a run on disk is just the sorted mirrors as raw uint32_t, the key is cheap to
+//work out again while merging
+static int tempRun(void)
+{
+	const char* dir = getenv("TMPDIR");
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/mybitapp-run-XXXXXX", dir && dir[0] ? dir : "/tmp");
+
+	int fd = mkstemp(path);
+	if(fd >= 0){
+		unlink(path); //gone as soon as it's closed, even if the program dies
+	}
+	return fd;
+}
+
+static int writeAll(int fd, const void* data, size_t len)
+{
+	const char* p = (const char*)data;
+	while(len > 0){
+		ssize_t wrote = write(fd, p, len);
+		if(wrote < 0){
+			if(errno == EINTR){
+				continue;
+			}
+			return -1;
+		}
+		p += wrote;
+		len -= (size_t)wrote;
+	}
+	return 0;
+}
+
+typedef struct{
+	int fd;
+	uint32_t* buf;
+	size_t pos;
+	size_t len;
+	size_t cap; //values
+
+	uint32_t num; //current value and its key (only valid while not done)
+	uint64_t key;
+	bool done;
+}RunReader;
+
+//moves to the next value, -1 if reading failed
+static int readerNext(RunReader* r)
+{
+	if(r->pos == r->len){
+		ssize_t got;
+		do{
+			got = read(r->fd, r->buf, r->cap * sizeof(*r->buf));
+		}while(got < 0 && errno == EINTR);
+
+		if(got < 0){
+			return -1;
+		}
+		r->pos = 0;
+		r->len = (size_t)got / sizeof(*r->buf); //runs are only ever whole values
+		if(r->len == 0){
+			r->done = true;
+			return 0;
+		}
+	}
+
+	r->num = r->buf[r->pos++];
+	r->key = asciiKey(r->num);
+	return 0;
+}
+
+//--- external sort ---
+
+typedef struct{
+	size_t mem;
+
+	//the run being filled
+	uint64_t* keys;
+	uint64_t* tmp;
+	size_t len;
+	size_t cap;
+
+	int* runs; //temp file descriptors, each rewound before merging
+	size_t nruns;
+	size_t runsCap;
+}ExtSort;
+
+static int spillRun(ExtSort* s)
+{
+	if(s->nruns == s->runsCap){
+		size_t cap = s->runsCap ? s->runsCap * 2 : 16;
+		int* grown = (int*)realloc(s->runs, cap * sizeof(*grown));
+		if(!grown){
+			return -1;
+		}
+		s->runs = grown;
+		s->runsCap = cap;
+	}
+
+	int fd = tempRun();
+	if(fd < 0){
+		return -1;
+	}
+	s->runs[s->nruns++] = fd;
+
+	//the sorted keys become mirrors again in tmp's space (it's free once sorted)
+	const uint64_t* sorted = sortKeys(s->keys, s->tmp, s->len);
+	uint32_t* nums = (uint32_t*)(sorted == s->keys ? s->tmp : s->keys);
+	for(size_t i = 0; i < s->len; ++i){
+		nums[i] = asciiKeyNum(sorted[i]);
+	}
+
+	int ret = writeAll(fd, nums, s->len * sizeof(*nums));
+	s->len = 0;
+	return ret;
+}
+
+static int extAdd(ExtSort* s, const uint32_t* mirrors, size_t n)
+{
+	for(size_t i = 0; i < n; ++i){
+		if(s->len == s->cap && spillRun(s) != 0){
+			return -1;
+		}
+		s->keys[s->len++] = asciiKey(mirrors[i]);
+	}
+	return 0;
+}
+
+//merges runs[first, first + n) into out (if out_fd < 0) or the run file out_fd
+static int mergeRuns(ExtSort* s, size_t first, size_t n, OutBuf* out, int out_fd)
+{
+	RunReader* readers = (RunReader*)calloc(n, sizeof(*readers));
+	size_t* heap = (size_t*)malloc(n * sizeof(*heap));
+	uint32_t* outBuf = (uint32_t*)malloc(STREAM_READ_BUF);
+	size_t outLen = 0;
+	size_t nheap = 0;
+	int ret = -1;
+
+	if(!readers || !heap || !outBuf){
+		errno = ENOMEM;
+		goto out;
+	}
+
+	for(size_t i = 0; i < n; ++i){
+		RunReader* r = &readers[i];
+		r->fd = s->runs[first + i];
+		r->cap = STREAM_READ_BUF / sizeof(*r->buf);
+		r->buf = (uint32_t*)malloc(STREAM_READ_BUF);
+		if(!r->buf){
+			errno = ENOMEM;
+			goto out;
+		}
+		if(lseek(r->fd, 0, SEEK_SET) != 0 || readerNext(r) != 0){
+			goto out;
+		}
+		if(r->done){
+			continue;
+		}
+
+		//sift up
+		size_t k = nheap++;
+		while(k > 0 && readers[heap[(k - 1) / 2]].key > r->key){
+			heap[k] = heap[(k - 1) / 2];
+			k = (k - 1) / 2;
+		}
+		heap[k] = i;
+	}
+
+	while(nheap > 0){
+		size_t top = heap[0];
+		RunReader* r = &readers[top];
+
+		if(out_fd < 0){
+			outU32(out, r->num, '\n');
+		}else{
+			outBuf[outLen++] = r->num;
+			if(outLen == STREAM_READ_BUF / sizeof(*outBuf)){
+				if(writeAll(out_fd, outBuf, outLen * sizeof(*outBuf)) != 0){
+					goto out;
+				}
+				outLen = 0;
+			}
+		}
+
+		if(readerNext(r) != 0){
+			goto out;
+		}
+		if(r->done){
+			top = heap[--nheap];
+		}
+
+		//sift down whatever is at the top now
+		uint64_t key = readers[top].key;
+		size_t k = 0;
+		for(;;){
+			size_t child = 2 * k + 1;
+			if(child >= nheap){
+				break;
+			}
+			if(child + 1 < nheap && readers[heap[child + 1]].key < readers[heap[child]].key){
+				++child;
+			}
+			if(readers[heap[child]].key >= key){
+				break;
+			}
+			heap[k] = heap[child];
+			k = child;
+		}
+		if(nheap > 0){
+			heap[k] = top;
+		}
+	}
+
+	if(out_fd >= 0 && writeAll(out_fd, outBuf, outLen * sizeof(*outBuf)) != 0){
+		goto out;
+	}
+	ret = out_fd < 0 && out->error ? -1 : 0;
+	if(ret != 0){
+		errno = out->error;
+	}
+
+out:
+	if(readers){
+		for(size_t i = 0; i < n; ++i){
+			free(readers[i].buf);
+		}
+	}
+	free(readers);
+	free(heap);
+	free(outBuf);
+	return ret;
+}
+
+//writes the sorted section: straight from memory if nothing was spilled,
+//otherwise merge passes until the runs fit in one
+static int extFinish(ExtSort* s, OutBuf* out)
+{
+	if(s->nruns == 0){
+		const uint64_t* sorted = sortKeys(s->keys, s->tmp, s->len);
+		for(size_t i = 0; i < s->len; ++i){
+			outU32(out, asciiKeyNum(sorted[i]), '\n');
+		}
+		return out->error ? -1 : 0;
+	}
+
+	if(s->len > 0 && spillRun(s) != 0){
+		return -1;
+	}
+
+	//the run buffers aren't needed anymore, their memory goes to the readers
+	free(s->keys);
+	free(s->tmp);
+	s->keys = s->tmp = NULL;
+
+	//one reader buffer per run and one for the output of a pass
+	size_t fanIn = s->mem / STREAM_READ_BUF - 1;
+	if(fanIn < 2){
+		fanIn = 2;
+	}
+
+	while(s->nruns > fanIn){
+		size_t merged = 0; //runs[0, merged) are this pass' output
+		for(size_t first = 0; first < s->nruns; first += fanIn){
+			size_t n = s->nruns - first < fanIn ? s->nruns - first : fanIn;
+			int fd = tempRun();
+			if(fd < 0 || mergeRuns(s, first, n, NULL, fd) != 0){
+				if(fd >= 0){
+					close(fd);
+				}
+				return -1;
+			}
+
+			for(size_t i = first; i < first + n; ++i){
+				close(s->runs[i]);
+			}
+			s->runs[merged++] = fd;
+		}
+		s->nruns = merged;
+	}
+
+	return mergeRuns(s, 0, s->nruns, out, -1);
+}
+
+int streamSections(const char* input_path, OutBuf* out, size_t mem)
+{
+	ExtSort s;
+	memset(&s, 0, sizeof(s));
+	s.mem = mem;
+	s.cap = mem / (2 * sizeof(uint64_t)); //keys + the radix sort's temp
+
+	int fd = open(input_path, O_RDONLY);
+	if(fd < 0){
+		return -1;
+	}
+
+	char* buf = (char*)malloc(PARSE_BLOCK);
+	uint32_t* values = (uint32_t*)malloc(STREAM_BATCH * sizeof(*values));
+	uint32_t* mirrors = (uint32_t*)malloc(STREAM_BATCH * sizeof(*mirrors));
+	uint32_t* counts = (uint32_t*)malloc(STREAM_BATCH * sizeof(*counts));
+	s.keys = (uint64_t*)malloc(s.cap * sizeof(*s.keys));
+	s.tmp = (uint64_t*)malloc(s.cap * sizeof(*s.tmp));
+
+	int ret = -1;
+	if(!buf || !values || !mirrors || !counts || !s.keys || !s.tmp){
+		errno = ENOMEM;
+		goto out;
+	}
+
+	//first section as the input comes in, like readValues() reads a pipe
+	size_t have = 0;
+	bool eof = false;
+	bool stop = false;
+	while(!eof && !stop){
+		ssize_t got = read(fd, buf + have, PARSE_BLOCK - have);
+		if(got < 0){
+			if(errno == EINTR){
+				continue;
+			}
+			goto out;
+		}
+		eof = got == 0;
+		have += (size_t)got;
+
+		size_t done = 0;
+		for(;;){
+			size_t used;
+			size_t n = parseUints(buf + done, have - done, eof, values, STREAM_BATCH, &used, &stop);
+			done += used;
+			if(n == 0){
+				break;
+			}
+
+			BinaryMirrorBatch(values, mirrors, n);
+			CountSequenceBatch(values, counts, n);
+			for(size_t i = 0; i < n; ++i){
+				outU32(out, mirrors[i], '\t'); //tab in the middle
+				outU32(out, counts[i], '\n');
+			}
+			if(out->error || extAdd(&s, mirrors, n) != 0){
+				goto out;
+			}
+			if(stop){
+				break;
+			}
+		}
+
+		//a "number" filling the whole block can't be one fscanf would read either
+		if(done == 0 && have == PARSE_BLOCK){
+			stop = true;
+		}
+		memmove(buf, buf + done, have - done);
+		have -= done;
+	}
+
+	outChar(out, '\n');
+	ret = extFinish(&s, out);
+
+out:
+	if(ret != 0 && out->error){
+		errno = out->error;
+	}
+	for(size_t i = 0; i < s.nruns; ++i){
+		close(s.runs[i]);
+	}
+	free(s.runs);
+	free(s.keys);
+	free(s.tmp);
+	free(buf);
+	free(values);
+	free(mirrors);
+	free(counts);
+	close(fd);
+	return ret;
+}
@@ -0,0 +1,24 @@
+// Noah Hathout
+// nhathout
+// stream.h
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stddef.h>
+
+#include "output.h"
+
+//--mem: input of any size from a file or a pipe. The first section is written
+//while the input is still being read, the mirrors for the sorted section go into
+//sorted runs that are spilled to temp files ($TMPDIR, /tmp if unset) when mem is
+//used up, and the runs are k-way merged at the end (in more than one pass if
+//there are too many to read at once). mem covers the runs and the merge buffers,
+//the read and output buffers (about 3 MB) come on top
+#define STREAM_MIN_MEM (1 << 20)
+#define STREAM_READ_BUF (256 * 1024) //per run while merging
+
+//returns -1 with errno set if reading, writing or a temp file failed
+int streamSections(const char* input_path, OutBuf* out, size_t mem);
+
+#endif
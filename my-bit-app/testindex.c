@@ -0,0 +1,146 @@
+// Noah Hathout
+// nhathout
+// testindex.c
+
+//"make check": the B+-tree against insertSorted() on random values, with lots
+//of repeats and short asciis so runs of equal keys span leaves and ranges/prefixes
+//hit something. Every node goes into both (the index doesn't use next), so
+//comparing pointers also checks that equal mirrors keep their insert order.
+//Every so often the whole order and a batch of random indexRange()/indexPrefix()
+//queries are checked against a walk over the list with strcmp()/strncmp().
+//Built twice, with INDEX_FANOUT 64 and 4 (a deep tree with lots of splits)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "myindex.h"
+#include "mylist.h"
+#include "bits.h"
+
+#define TEST_VALUES 20000
+#define TEST_CHECKS 20 //full checks over the run
+#define TEST_QUERIES 200 //range + prefix queries per check
+
+static uint64_t state = 12345;
+
+static uint32_t rnd(void)
+{
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return (uint32_t)state;
+}
+
+//0 to 4 digits, now and then "99" (its prefix has no next string)
+static void randomBound(char* s)
+{
+	int len = (int)(rnd() % 5);
+	for(int i = 0; i < len; ++i){
+		s[i] = (char)('0' + rnd() % 10);
+	}
+	s[len] = '\0';
+	if(rnd() % 7 == 0){
+		strcpy(s, "99");
+	}
+}
+
+static bool checkOrder(const AsciiIndex* index, const Node* head)
+{
+	IndexIter iter;
+	indexBegin(index, &iter);
+	size_t count = 0;
+	const Node* curr = head;
+	for(Node* node; (node = indexNext(&iter)); ++count){
+		if(node != curr){
+			return false;
+		}
+		curr = curr->next;
+	}
+	return !curr && count == indexSize(index);
+}
+
+//what's left in iter has to be exactly the list nodes in [lo, hi) (or with
+//prefix lo if hi is NULL and prefix is true)
+static bool checkQuery(IndexIter* iter, const Node* head, const char* lo, const char* hi, bool prefix)
+{
+	char ascii[11];
+	for(const Node* curr = head; curr; curr = curr->next){
+		nodeAscii(curr, ascii);
+		bool in;
+		if(prefix){
+			in = strncmp(ascii, lo, strlen(lo)) == 0;
+		}else{
+			in = (!lo || strcmp(ascii, lo) >= 0) && (!hi || strcmp(ascii, hi) < 0);
+		}
+		if(in && indexNext(iter) != curr){
+			return false;
+		}
+	}
+	return indexNext(iter) == NULL;
+}
+
+int main(void)
+{
+	NodeArena* arena = createArena();
+	AsciiIndex* index = createIndex();
+	if(!arena || !index){
+		perror("createIndex");
+		return 1;
+	}
+	Node* head = NULL;
+
+	for(int i = 0; i < TEST_VALUES; ++i){
+		uint32_t value = rnd() % 4 == 0 ? rnd() % 50 : rnd();
+		if(rnd() % 3 == 0){
+			value = BinaryMirror(rnd() % 200); //small mirror, short ascii
+		}
+		Node* node = createNode(arena, value);
+		if(!node || indexInsert(index, node) != 0){
+			perror("indexInsert");
+			return 1;
+		}
+		insertSorted(&head, node);
+
+		if(i % (TEST_VALUES / TEST_CHECKS) != 0 && i != TEST_VALUES - 1){
+			continue;
+		}
+
+		if(!checkOrder(index, head)){
+			printf("testindex: order differs from insertSorted() after %d inserts\n", i + 1);
+			return 1;
+		}
+		for(int q = 0; q < TEST_QUERIES; ++q){
+			char lo[11];
+			char hi[11];
+			randomBound(lo);
+			randomBound(hi);
+			const char* useLo = rnd() % 4 ? lo : NULL;
+			const char* useHi = rnd() % 4 ? hi : NULL;
+
+			IndexIter iter;
+			if(indexRange(index, useLo, useHi, &iter) != 0 || !checkQuery(&iter, head, useLo, useHi, false)){
+				printf("testindex: indexRange(\"%s\", \"%s\") is wrong\n", useLo ? lo : "NULL", useHi ? hi : "NULL");
+				return 1;
+			}
+			if(indexPrefix(index, lo, &iter) != 0 || !checkQuery(&iter, head, lo, NULL, true)){
+				printf("testindex: indexPrefix(\"%s\") is wrong\n", lo);
+				return 1;
+			}
+		}
+	}
+
+	//bounds that aren't digit strings of up to 10 digits
+	IndexIter iter;
+	if(indexRange(index, "12a", NULL, &iter) != -1 || indexPrefix(index, "12345678901", &iter) != -1){
+		printf("testindex: a bad bound was accepted\n");
+		return 1;
+	}
+
+	freeIndex(index);
+	freeArena(arena);
+	printf("testindex: ok, %d values, fanout %d\n", TEST_VALUES, INDEX_FANOUT);
+	return 0;
+}
@@ -0,0 +1,157 @@
+// Noah Hathout
+// nhathout
+// testoutput.c
+
+//"make check": formatU32() on every 32-bit value against sprintf("%u"). sprintf
+//for all 2^32 would take minutes, so each thread sprintf's the start of its
+//slice once and then counts up in a decimal string (an increment is a few
+//bytes), which is compared with formatU32()'s digits. Then outU32() through a
+//real file against fprintf() on a sample
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "output.h"
+
+#define TEST_THREADS 8
+#define TEST_SAMPLE 1000000
+
+typedef struct{
+	uint64_t begin;
+	uint64_t end;
+	uint64_t bad; //first value that didn't match, end if none
+}Slice;
+
+//"999" -> "1000", len is the digit count, returns the new one
+static int increment(char* digits, int len)
+{
+	int i = len - 1;
+	while(i >= 0 && digits[i] == '9'){
+		digits[i--] = '0';
+	}
+	if(i >= 0){
+		digits[i]++;
+		return len;
+	}
+	memmove(digits + 1, digits, (size_t)len);
+	digits[0] = '1';
+	return len + 1;
+}
+
+//values only get longer within a slice, so the bytes of got past the digits
+//stay 0 like want's and a fixed size compare (no call) works
+static void* checkSlice(void* arg)
+{
+	Slice* s = (Slice*)arg;
+	char want[16] = {0};
+	char got[16] = {0};
+	int len = sprintf(want, "%u", (unsigned)s->begin);
+
+	s->bad = s->end;
+	for(uint64_t v = s->begin; v < s->end; ++v){
+		int n = formatU32(got, (uint32_t)v);
+		if(n != len || memcmp(got, want, sizeof(got)) != 0){
+			s->bad = v;
+			break;
+		}
+		len = increment(want, len);
+	}
+	return NULL;
+}
+
+static uint32_t rnd(uint64_t* state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return (uint32_t)(*state >> 32);
+}
+
+//outU32() lines in a file against the same lines from fprintf()
+static bool checkOutBuf(void)
+{
+	char outPath[] = "/tmp/mybitapp-testoutput-XXXXXX";
+	int fd = mkstemp(outPath);
+	if(fd < 0){
+		perror("temp file");
+		exit(1);
+	}
+	close(fd);
+
+	OutBuf out;
+	if(outOpen(&out, outPath) != 0){
+		perror("outOpen");
+		exit(1);
+	}
+	char* want = (char*)malloc((size_t)TEST_SAMPLE * 24);
+	char* p = want;
+	uint64_t state = 0x9e3779b97f4a7c15ull;
+	for(int i = 0; i < TEST_SAMPLE; ++i){
+		uint32_t a = rnd(&state) >> (rnd(&state) & 31); //every length
+		uint32_t b = rnd(&state) & 31;
+		outU32(&out, a, '\t');
+		outU32(&out, b, '\n');
+		p += sprintf(p, "%u\t%u\n", a, b);
+	}
+	if(outClose(&out) != 0){
+		perror("outClose");
+		exit(1);
+	}
+
+	size_t wantLen = (size_t)(p - want);
+	char* got = (char*)malloc(wantLen + 1);
+	FILE* f = fopen(outPath, "r");
+	size_t gotLen = f ? fread(got, 1, wantLen + 1, f) : 0;
+	if(f){
+		fclose(f);
+	}
+	unlink(outPath);
+
+	bool ok = gotLen == wantLen && memcmp(got, want, wantLen) == 0;
+	free(want);
+	free(got);
+	return ok;
+}
+
+int main(void)
+{
+	pthread_t threads[TEST_THREADS];
+	Slice slices[TEST_THREADS];
+	uint64_t all = 1ull << 32;
+
+	for(int t = 0; t < TEST_THREADS; ++t){
+		slices[t].begin = all * (uint64_t)t / TEST_THREADS;
+		slices[t].end = all * (uint64_t)(t + 1) / TEST_THREADS;
+		if(pthread_create(&threads[t], NULL, checkSlice, &slices[t]) != 0){
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	int ret = 0;
+	for(int t = 0; t < TEST_THREADS; ++t){
+		pthread_join(threads[t], NULL);
+		if(slices[t].bad != slices[t].end){
+			char got[OUT_MAX_PUT + 1] = {0};
+			got[formatU32(got, (uint32_t)slices[t].bad)] = '\0';
+			printf("testoutput: formatU32(%u) gives \"%s\"\n", (unsigned)slices[t].bad, got);
+			ret = 1;
+		}
+	}
+	if(ret != 0){
+		return ret;
+	}
+
+	if(!checkOutBuf()){
+		printf("testoutput: outU32() output differs from fprintf()\n");
+		return 1;
+	}
+
+	printf("testoutput: ok, every 32-bit value and %d outU32() lines\n", TEST_SAMPLE);
+	return 0;
+}
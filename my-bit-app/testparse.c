@@ -0,0 +1,186 @@
+// Noah Hathout
+// nhathout
+// testparse.c
+
+//"make check": parseUints()/readValues() against a fscanf("%u") loop on random
+//text (signs, numbers past 32 and 64 bits, every kind of whitespace, junk that
+//stops the loop). Every other text is clean (only digits and whitespace, what
+//parseUints() takes 64 bytes at a time). readValues() gets it once as a file
+//(the mmap path) and once through a pipe written 1-7 bytes at a time, with
+//parse.c built with a small PARSE_BLOCK so numbers get split between reads.
+//TestParseSse2 is the same test on the copy of parseUints() CPUs without AVX2 get
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "parse.h"
+
+#define TEST_ROUNDS 20000
+#define TEST_MAX_TEXT 8192 //fits the longest text a round makes
+#define TEST_MAX_VALUES 1024
+
+static uint64_t state = 0x2545f4914f6cdd1dull;
+
+static unsigned rnd(unsigned n)
+{
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return (unsigned)(state % n);
+}
+
+//random tokens, mostly numbers of up to 10 digits, some up to 22 (past 64
+//bits). Unless clean, some are signed and now and then there's a byte that
+//isn't part of a number (clean text is what parseUints() does 64 bytes at a time,
+//a third of it 1 or 1-2 digit numbers and 1 byte whitespace, up to 32 a block)
+static size_t makeText(char* buf, bool clean)
+{
+	static const char* space[] = {" ", "\n", "\t", "\r\n", "  ", "\v", "\f"};
+	size_t len = 0;
+	int tokens = (int)rnd(clean ? 200 : 40);
+	bool dense = clean && rnd(3) == 0;
+	unsigned longest = dense ? 1 + rnd(2) : 10;
+
+	for(int t = 0; t < tokens; ++t){
+		if(!clean && rnd(30) == 0){
+			buf[len++] = "xa-+."[rnd(5)];
+		}else{
+			if(!clean && rnd(10) == 0){
+				buf[len++] = rnd(2) ? '-' : '+';
+			}
+			int digits = rnd(clean ? 40 : 4) == 0 ? 1 + (int)rnd(22) : 1 + (int)rnd(longest);
+			for(int d = 0; d < digits; ++d){
+				buf[len++] = (char)('0' + rnd(10));
+			}
+		}
+
+		//the last token sometimes runs into the end of the text
+		if(t < tokens - 1 || rnd(50)){
+			const char* s = space[rnd(dense ? 3 : 7)];
+			memcpy(buf + len, s, strlen(s));
+			len += strlen(s);
+		}
+	}
+	buf[len] = '\0';
+	return len;
+}
+
+static size_t reference(const char* buf, size_t len, uint32_t* out)
+{
+	FILE* f = fmemopen((void*)buf, len ? len : 1, "r");
+	if(!f){
+		perror("fmemopen");
+		exit(1);
+	}
+
+	size_t n = 0;
+	unsigned v;
+	while(len > 0 && fscanf(f, "%u", &v) == 1){
+		out[n++] = v;
+	}
+	fclose(f);
+	return n;
+}
+
+static bool same(const uint32_t* a, size_t na, const uint32_t* b, size_t nb)
+{
+	return na == nb && (na == 0 || memcmp(a, b, na * sizeof(*a)) == 0); //readValues() leaves NULL for none
+}
+
+//readValues() on path, the text written to it by a child process when piped
+static bool checkRead(const char* text, size_t len, bool piped, const uint32_t* want, size_t n)
+{
+	char path[64] = "/tmp/mybitapp-testparse-XXXXXX";
+	int fd = mkstemp(path);
+	if(fd < 0 || write(fd, text, len) != (ssize_t)len){
+		perror("temp file");
+		exit(1);
+	}
+	close(fd);
+
+	pid_t child = -1;
+	int p[2] = {-1, -1};
+	if(piped){
+		if(pipe(p) != 0){
+			perror("pipe");
+			exit(1);
+		}
+		child = fork();
+		if(child == 0){
+			close(p[0]);
+			for(size_t done = 0; done < len; ){
+				size_t chunk = 1 + rnd(7);
+				chunk = chunk < len - done ? chunk : len - done;
+				if(write(p[1], text + done, chunk) != (ssize_t)chunk){
+					_exit(1);
+				}
+				done += chunk;
+			}
+			_exit(0);
+		}
+		close(p[1]);
+	}
+
+	char readPath[64];
+	snprintf(readPath, sizeof(readPath), "/dev/fd/%d", p[0]);
+
+	uint32_t* values;
+	size_t count;
+	int ret = readValues(piped ? readPath : path, &values, &count);
+	if(piped){
+		close(p[0]);
+		waitpid(child, NULL, 0);
+	}
+	unlink(path);
+
+	if(ret != 0){
+		perror("readValues");
+		return false;
+	}
+	bool ok = same(values, count, want, n);
+	free(values);
+	return ok;
+}
+
+int main(void)
+{
+	char* text = (char*)malloc(TEST_MAX_TEXT);
+	uint32_t want[TEST_MAX_VALUES];
+	uint32_t got[TEST_MAX_VALUES];
+
+	for(int round = 0; round < TEST_ROUNDS; ++round){
+		size_t len = makeText(text, round % 2 == 0);
+		size_t n = reference(text, len, want);
+
+		size_t used;
+		bool stop;
+		size_t m = parseUints(text, len, true, got, TEST_MAX_VALUES, &used, &stop);
+		if(!same(got, m, want, n)){
+			printf("testparse: parseUints gives %zu numbers, fscanf %zu, on:\n%s\n", m, n, text);
+			return 1;
+		}
+
+		//the file and pipe paths take a while, every 10th round is plenty
+		if(round % 10 == 0){
+			if(!checkRead(text, len, false, want, n)){
+				printf("testparse: readValues on a file differs from fscanf on:\n%s\n", text);
+				return 1;
+			}
+			if(!checkRead(text, len, true, want, n)){
+				printf("testparse: readValues on a pipe differs from fscanf on:\n%s\n", text);
+				return 1;
+			}
+		}
+	}
+
+	free(text);
+	printf("testparse: ok, %d texts\n", TEST_ROUNDS);
+	return 0;
+}